@@ -0,0 +1,575 @@
+#!/usr/bin/env python3
+
+"""
+`ai_moves.py` is a command line utility and Python module for evaluating the
+move choices of AI-controlled monsters for many monsters and frames at once,
+with numpy.
+
+Frames of DUNGEON_STRUCT are read like in `entity_query.py` (RAM dumps, a
+stream of raw frames, or a trace file written by `trace_store.py`), and the
+monster slots are resolved with `entity_query.EntityTable`. Move data
+(struct move_data) comes from MOVE_DATA_TABLE in a RAM dump. For every frame,
+monster and move slot, the result mirrors struct ai_possible_move
+(can_be_used, direction, weight), with every quantity computed as a
+(frames x monsters x moves) or (frames x monsters x moves x targets) array.
+
+The following parts of the AI's move evaluation are modeled, from their
+documentation in the symbol tables and headers:
+    - Whether the AI can use a move (CanAiUseMove and CanMonsterUseMove with
+      extra checks): the move must exist, not be a subsequent move in a link
+      chain, not be disabled or sealed, be enabled for the AI, and have PP
+      left. Taunt and Encore are not checked.
+    - Which monsters a move can target, based on the move's AI target and
+      range (move_data::ai_target_range, see GetEntityMoveTargetAndRange):
+      opponents, allies or the user, within 1 tile for the front/nearby
+      ranges, in a straight line within 2 or 10 tiles for the line ranges, in
+      the same room, or anywhere on the floor. Walls, line of sight
+      (CanSeeTarget) and IQ skills are not accounted for.
+    - The move's AI condition (enum move_ai_condition, see
+      IsAiTargetEligible), checked against each target. "Negative status
+      condition" isn't documented precisely, and is approximated by the
+      sleep (except sleepless), burn and poison, freeze (except Wrap and
+      Ingrain), cringe, curse, Leech Seed, blinker and muzzle status groups.
+      Low HP is modeled like HasLowHealth (HP <= max HP / 4).
+    - The move's AI weight (move_data::ai_weight), for moves with at least
+      one eligible target, and the direction towards the nearest one.
+    - HasSuperEffectiveMoveAgainstUser, using the move's base type (without
+      the special cases of GetMoveTypeForMonster) and `type_matchups.py`.
+
+Picking a move (see RunMonsterAi and SetActionUseMoveAi) is modeled as a
+weighted random choice among the usable moves, drawing
+DungeonRandInt(total weight) and picking the first move whose running total
+of weights exceeds the draw. DungeonRandInt(high) is modeled as
+(DungeonRand16Bit() * high) >> 16; the symbol tables only document its
+output range. Neither this nor anything that precedes it in RunMonsterAi
+(ShouldMonsterRunAway, movement, items) is documented in enough detail to be
+reproduced, so the results are move probabilities under this model, not
+exact game behavior.
+
+`--benchmark` replicates the input frames and reports how many monster
+decisions per second the engine evaluates.
+
+Example usage:
+python3 ai_moves.py -l layouts.bin ram.bin
+python3 ai_moves.py -l layouts.bin --stream frames.bin -m ram.bin -d rom_data
+python3 ai_moves.py -l layouts.bin ram.bin --sample 0x12345
+python3 ai_moves.py -l layouts.bin ram.bin --benchmark 100000
+"""
+
+import argparse
+import sys
+import time
+from typing import Dict, NamedTuple, Optional, Union
+
+import numpy as np
+
+import dungeon_rng
+from entity_query import (
+    DEFAULT_BATCH_FRAMES,
+    DUNGEON_TYPE,
+    EntityTable,
+    N_MONSTER_SLOTS,
+    dump_frames,
+    dungeon_address,
+    stream_batches,
+    trace_batches,
+)
+from layouts import BinaryData, Layouts, RamDump
+from type_matchups import TypeMatchups
+
+MOVE_DATA_GLOBAL = "MOVE_DATA_TABLE"
+MOVE_DATA_TYPE = "struct move_data"
+N_MOVES = 4
+# entity::room_idx in hallways
+ROOM_HALLWAY = 0xFF
+# HasSuperEffectiveMoveAgainstUser can skip moves with another max Ginseng boost
+GINSENG_BOOST_CHECKED = 99
+MATCHUP_SUPER_EFFECTIVE = 3
+# Maximum distance of the straight-line ranges
+RANGE_FRONT_2_DISTANCE = 2
+RANGE_FRONT_10_DISTANCE = 10
+# Direction IDs indexed by [sign(dx) + 1][sign(dy) + 1], with y pointing down
+DIRECTIONS = np.array([[5, 6, 7], [4, -1, 0], [3, 2, 1]], dtype=np.int64)
+
+# Column -> path within struct move_data
+MOVE_DATA_FIELDS = {
+    "type": "type.val",
+    "ai_target": "ai_target_range.target",
+    "ai_range": "ai_target_range.range",
+    "ai_condition": "ai_target_range.ai_condition",
+    "ai_weight": "ai_weight",
+    "ai_condition_random_chance": "ai_condition_random_chance",
+    "max_ginseng_boost": "max_ginseng_boost",
+}
+
+# Status fields and their values (per the status groups in enum status_id)
+# counted as negative status conditions, or None for any nonzero value
+NEGATIVE_STATUSES = {
+    "statuses.sleep": (1, 3, 4, 5),
+    "statuses.burn": None,
+    "statuses.freeze": (1, 2, 4, 6, 7, 8),
+    "statuses.cringe": None,
+    "statuses.curse": (1,),
+    "statuses.leech_seed": (1,),
+    "statuses.blinded": None,
+    "statuses.muzzled": (1,),
+}
+# statuses::sleep values for IsMonsterSleeping (sleep, nightmare, napping)
+SLEEPING = (1, 3, 5)
+
+
+def modeled_rand_int(values16: np.ndarray, high: Union[int, np.ndarray]) -> np.ndarray:
+    """Modeled DungeonRandInt(high) for each 16-bit output of DungeonRand16Bit"""
+    return (np.asarray(values16, dtype=np.int64) * high) >> 16
+
+
+class MoveData:
+    """The columns of MOVE_DATA_TABLE used by the AI, indexed by move ID"""
+
+    def __init__(self, layouts: Layouts, table: bytes):
+        entry_len = layouts.sizeof(MOVE_DATA_TYPE)
+        n = len(table) // entry_len
+        entries = np.frombuffer(table, dtype=np.uint8)[: n * entry_len]
+        entries = entries.reshape(n, entry_len).astype(np.int64)
+        self.columns: Dict[str, np.ndarray] = {}
+        for name, path in MOVE_DATA_FIELDS.items():
+            leaf = layouts.leaf(MOVE_DATA_TYPE, path)
+            value = np.zeros(n, dtype=np.int64)
+            for i in range(leaf.size):
+                value |= entries[:, leaf.offset + i] << (8 * i)
+            if leaf.bit_width is not None:
+                value = (value >> (leaf.bit_offset - 8 * leaf.offset)) & (
+                    (1 << leaf.bit_width) - 1
+                )
+            self.columns[name] = value
+
+    def __len__(self) -> int:
+        return len(self.columns["type"])
+
+    def __getitem__(self, name: str) -> np.ndarray:
+        return self.columns[name]
+
+    @classmethod
+    def from_dump(cls, path: str, layouts: Layouts, version: str) -> "MoveData":
+        """Reads MOVE_DATA_TABLE from a RAM dump"""
+        g = layouts.globals[MOVE_DATA_GLOBAL]
+        size = layouts.sizeof(g.type, g.pointer)
+        with RamDump(path, layouts, version) as dump:
+            start = dump.mapped.relative(dump.address_of(MOVE_DATA_GLOBAL))
+            return cls(layouts, bytes(dump.contents[start : start + size]))
+
+
+class AiPossibleMoves(NamedTuple):
+    """struct ai_possible_move for every (frame, monster, move slot)"""
+
+    can_be_used: np.ndarray
+    direction: np.ndarray
+    weight: np.ndarray
+    n_targets: np.ndarray
+
+
+class AiEvaluator:
+    """
+    Evaluates AI move choices for every monster of an EntityTable. Arrays
+    have shape (frames, monsters, moves), with a trailing targets axis for
+    per-target arrays.
+    """
+
+    def __init__(
+        self,
+        table: EntityTable,
+        moves: MoveData,
+        matchups: Optional[TypeMatchups] = None,
+    ):
+        self.table = table
+        self.moves = moves
+        self.matchups = matchups
+        lts = table.layouts
+        self._enums = {
+            name: value for e in lts.enums.values() for name, value in e.items()
+        }
+        self.valid = table.valid
+        self.x = table.field("entity.pos.x")
+        self.y = table.field("entity.pos.y")
+        self.room = table.field("entity.room_idx")
+        self.opponent_side = table.field("is_not_team_member") != 0
+
+        def move_field(path: str) -> np.ndarray:
+            return np.stack(
+                [table.field(f"moves[{i}].{path}") for i in range(N_MOVES)], axis=-1
+            )
+
+        self.move_ids = np.clip(move_field("id"), 0, len(moves) - 1)
+        self.pp = move_field("pp")
+        self._flags = {
+            flag: move_field(flag) != 0
+            for flag in (
+                "f_exists",
+                "f_subsequent_in_link_chain",
+                "f_enabled_for_ai",
+                "f_disabled",
+                "f_sealed",
+            )
+        }
+        self.exists = self._flags["f_exists"]
+
+    def move_column(self, name: str) -> np.ndarray:
+        """A column of the move data for every move slot"""
+        return self.moves[name][self.move_ids]
+
+    def can_be_used(self) -> np.ndarray:
+        """CanAiUseMove (with extra checks) and move::f_enabled_for_ai"""
+        f = self._flags
+        return (
+            self.valid[:, :, None]
+            & f["f_exists"]
+            & ~f["f_subsequent_in_link_chain"]
+            & f["f_enabled_for_ai"]
+            & ~f["f_disabled"]
+            & ~f["f_sealed"]
+            & (self.pp > 0)
+        )
+
+    def negative_status(self) -> np.ndarray:
+        """Whether each monster has a negative status condition (approximate)"""
+        result = np.zeros(self.valid.shape, dtype=bool)
+        for path, values in NEGATIVE_STATUSES.items():
+            status = self.table.field(path)
+            result |= status != 0 if values is None else np.isin(status, values)
+        return result
+
+    def target_conditions(self) -> np.ndarray:
+        """
+        Whether each monster satisfies each enum move_ai_condition as a
+        target, as a (frames, monsters, conditions) array. AI_CONDITION_RANDOM
+        is treated as satisfied here; see `ranges()`.
+        """
+        t = self.table
+        max_hp = t.field("max_hp_stat") + t.field("max_hp_boost")
+        low_hp = t.field("hp") <= max_hp // 4
+        status = self.negative_status()
+        asleep = np.isin(t.field("statuses.sleep"), SLEEPING)
+        ghost_type = self._enums["TYPE_GHOST"]
+        ghost = (
+            (t.field("types[0]") == ghost_type) | (t.field("types[1]") == ghost_type)
+        ) & (t.field("statuses.exposed") == 0)
+        always = np.ones(self.valid.shape, dtype=bool)
+        conditions = {
+            "AI_CONDITION_NONE": always,
+            "AI_CONDITION_RANDOM": always,
+            "AI_CONDITION_HP_25": low_hp,
+            "AI_CONDITION_STATUS": status,
+            "AI_CONDITION_ASLEEP": asleep,
+            "AI_CONDITION_GHOST": ghost,
+            "AI_CONDITION_HP_25_OR_STATUS": low_hp | status,
+        }
+        n = max(self._enums[name] for name in conditions) + 1
+        # Unknown conditions are never satisfied
+        result = np.zeros(self.valid.shape + (n,), dtype=bool)
+        for name, mask in conditions.items():
+            result[:, :, self._enums[name]] = mask
+        return result
+
+    def ranges(self, random_values: Optional[np.ndarray] = None) -> np.ndarray:
+        """
+        Whether each monster is an eligible target of each move, as a
+        (frames, users, moves, targets) array. If random_values (16-bit
+        values of the same shape) are given, targets of AI_CONDITION_RANDOM
+        moves are only eligible if DungeonRandInt(100) falls below the move's
+        ai_condition_random_chance; otherwise they're always eligible.
+        """
+        e = self._enums
+        dx = self.x[:, None, :] - self.x[:, :, None]  # (frames, users, targets)
+        dy = self.y[:, None, :] - self.y[:, :, None]
+        dist = np.maximum(np.abs(dx), np.abs(dy))
+        straight = (dx == 0) | (dy == 0) | (np.abs(dx) == np.abs(dy))
+        same_room = (self.room[:, None, :] == self.room[:, :, None]) & (
+            self.room[:, :, None] != ROOM_HALLWAY
+        )
+        is_self = np.eye(N_MONSTER_SLOTS, dtype=bool)[None]
+        others = self.valid[:, None, :] & ~is_self
+        opponents = others & (
+            self.opponent_side[:, None, :] != self.opponent_side[:, :, None]
+        )
+        allies = others & ~opponents
+        by_range = {
+            "RANGE_FRONT": dist == 1,
+            "RANGE_FRONT_AND_SIDES": dist == 1,
+            "RANGE_NEARBY": dist == 1,
+            "RANGE_FRONT_WITH_CORNER_CUTTING": dist == 1,
+            "RANGE_ROOM": same_room | (dist == 1),
+            "RANGE_FRONT_2": straight & (dist <= RANGE_FRONT_2_DISTANCE),
+            "RANGE_FRONT_2_WITH_CORNER_CUTTING": straight
+            & (dist <= RANGE_FRONT_2_DISTANCE),
+            "RANGE_FRONT_10": straight & (dist <= RANGE_FRONT_10_DISTANCE),
+            "RANGE_FLOOR": np.ones_like(dist, dtype=bool),
+        }
+        by_target = {
+            "TARGET_ENEMIES": opponents,
+            "TARGET_ENEMIES_AFTER_CHARGING": opponents,
+            "TARGET_PARTY": allies | is_self,
+            "TARGET_TEAMMATES": allies,
+            "TARGET_ALL": others | is_self,
+            "TARGET_ALL_EXCEPT_USER": others,
+        }
+        ai_range = self.move_column("ai_range")
+        ai_target = self.move_column("ai_target")
+        eligible = np.zeros(ai_range.shape + (N_MONSTER_SLOTS,), dtype=bool)
+        for range_name, in_range in by_range.items():
+            r = ai_range == e[range_name]
+            if not r.any():
+                continue
+            for target_name, side in by_target.items():
+                m = r & (ai_target == e[target_name])
+                if m.any():
+                    eligible |= m[..., None] & (in_range & side)[:, :, None, :]
+        # Moves that target the user, or have the user range, only target
+        # the user
+        user_only = (ai_target == e["TARGET_USER"]) | (ai_range == e["RANGE_USER"])
+        eligible |= user_only[..., None] & is_self[:, :, None, :]
+
+        conditions = self.target_conditions()
+        ai_condition = self.move_column("ai_condition")
+        n_conditions = conditions.shape[-1]
+        cond = np.clip(ai_condition, 0, n_conditions - 1)
+        rows = np.arange(len(self.table))[:, None, None, None]
+        targets = np.arange(N_MONSTER_SLOTS)[None, None, None, :]
+        ok = conditions[rows, targets, cond[..., None]]
+        ok &= (ai_condition < n_conditions)[..., None]
+        if random_values is not None:
+            chance = self.move_column("ai_condition_random_chance")
+            roll = modeled_rand_int(random_values, 100)
+            is_random = ai_condition == e["AI_CONDITION_RANDOM"]
+            ok &= ~is_random[..., None] | (roll < chance[..., None])
+        return eligible & ok & self.valid[:, :, None, None]
+
+    def evaluate(self, random_values: Optional[np.ndarray] = None) -> AiPossibleMoves:
+        """Fills struct ai_possible_move for every monster and move slot"""
+        eligible = self.ranges(random_values)
+        n_targets = eligible.sum(axis=-1)
+        can_be_used = self.can_be_used() & (n_targets > 0)
+        weight = np.where(can_be_used, self.move_column("ai_weight"), 0)
+
+        dx = self.x[:, None, :] - self.x[:, :, None]
+        dy = self.y[:, None, :] - self.y[:, :, None]
+        dist = np.maximum(np.abs(dx), np.abs(dy))
+        big = np.iinfo(np.int64).max
+        target_dist = np.where(eligible, dist[:, :, None, :], big)
+        nearest = target_dist.argmin(axis=-1)
+        rows = np.arange(len(self.table))[:, None, None]
+        users = np.arange(N_MONSTER_SLOTS)[None, :, None]
+        ndx = np.sign(dx[rows, users, nearest])
+        ndy = np.sign(dy[rows, users, nearest])
+        direction = np.where(can_be_used, DIRECTIONS[ndx + 1, ndy + 1], -1)
+        return AiPossibleMoves(can_be_used, direction, weight, n_targets)
+
+    def probabilities(self, possible: AiPossibleMoves) -> np.ndarray:
+        """The probability of each move being picked, under the weighted model"""
+        total = possible.weight.sum(axis=-1, keepdims=True)
+        return np.divide(
+            possible.weight,
+            total,
+            out=np.zeros(possible.weight.shape, dtype=np.float64),
+            where=total > 0,
+        )
+
+    def choose(self, possible: AiPossibleMoves, values16: np.ndarray) -> np.ndarray:
+        """
+        Picks a move slot for every monster from (frames, monsters) 16-bit
+        random values, or -1 if no move can be used.
+        """
+        cum = np.cumsum(possible.weight, axis=-1)
+        total = cum[..., -1]
+        r = modeled_rand_int(values16, total)
+        choice = (cum <= r[..., None]).sum(axis=-1)
+        return np.where(total > 0, choice, -1)
+
+    def has_super_effective_move(self, ignore_ginseng: bool = False) -> np.ndarray:
+        """
+        HasSuperEffectiveMoveAgainstUser for every (frame, user, target), as a
+        (frames, users, targets) array.
+        """
+        if self.matchups is None:
+            raise ValueError("type matchup tables are required")
+        t = self.table
+        move_types = self.move_column("type")  # (frames, targets, moves)
+        exists = self.valid[:, :, None] & self.exists
+        if ignore_ginseng:
+            exists &= self.move_column("max_ginseng_boost") == GINSENG_BOOST_CHECKED
+        user_t1 = t.field("types[0]")[:, :, None, None]
+        user_t2 = t.field("types[1]")[:, :, None, None]
+        exposed = t.field("statuses.exposed")[:, :, None, None]
+        matchup = self.matchups.matchup_both_batch(
+            move_types[:, None, :, :], user_t1, user_t2, exposed
+        )
+        super_effective = (matchup == MATCHUP_SUPER_EFFECTIVE) & exists[:, None]
+        result = super_effective.any(axis=-1)
+        return result & self.valid[:, :, None] & self.valid[:, None, :]
+
+
+def benchmark(
+    layouts: Layouts,
+    frames: np.ndarray,
+    base: int,
+    moves: MoveData,
+    n_frames: int,
+    batch: int,
+) -> float:
+    """Evaluates and picks moves for n_frames frames, returning decisions/s"""
+    reps = -(-batch // len(frames))
+    batch_frames = np.ascontiguousarray(np.tile(frames, (reps, 1))[:batch])
+    values = np.zeros((batch, N_MONSTER_SLOTS), dtype=np.int64)
+    decisions = 0
+    start = time.perf_counter()
+    done = 0
+    while done < n_frames:
+        n = min(batch, n_frames - done)
+        table = EntityTable(layouts, batch_frames[:n], base)
+        evaluator = AiEvaluator(table, moves)
+        evaluator.choose(evaluator.evaluate(), values[:n])
+        decisions += int(table.valid.sum())
+        done += n
+    return decisions / (time.perf_counter() - start)
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(
+        description="Evaluate AI move choices for many monsters and frames"
+    )
+    parser.add_argument("dumps", nargs="*", help="RAM dumps, one per frame")
+    parser.add_argument(
+        "--stream",
+        help="file of raw concatenated frames of sizeof(struct dungeon) bytes",
+    )
+    parser.add_argument("--trace", help="trace file written by trace_store.py")
+    parser.add_argument(
+        "-m",
+        "--move-data",
+        help="RAM dump to read MOVE_DATA_TABLE from (default: the first dump)",
+    )
+    parser.add_argument(
+        "-d",
+        "--data-dir",
+        help="data directory for unpacked EoS ROM, for type matchups",
+    )
+    parser.add_argument(
+        "--sample",
+        type=lambda x: int(x, 0),
+        help="pick moves with the dungeon PRNG seeded with this value, rather "
+        + "than printing probabilities",
+    )
+    parser.add_argument(
+        "--benchmark",
+        type=int,
+        metavar="N",
+        help="evaluate N frames (replicating the input) and report decisions/s",
+    )
+    parser.add_argument(
+        "-b",
+        "--batch",
+        type=int,
+        default=DEFAULT_BATCH_FRAMES,
+        help="number of frames to process at once",
+    )
+    parser.add_argument(
+        "--base",
+        type=lambda x: int(x, 0),
+        help="address of DUNGEON_STRUCT (default: from the symbol tables)",
+    )
+    parser.add_argument(
+        "-v",
+        "--version",
+        choices=["NA", "EU", "JP"],
+        default="NA",
+        help="game version of the frames",
+    )
+    parser.add_argument(
+        "-l",
+        "--layouts",
+        help="load previously emitted layout tables instead of the headers",
+    )
+    args = parser.parse_args()
+
+    if sum((bool(args.dumps), args.stream is not None, args.trace is not None)) != 1:
+        parser.error("give exactly one of RAM dumps, --stream or --trace")
+    move_dump = args.move_data or (args.dumps[0] if args.dumps else None)
+    if move_dump is None:
+        parser.error("--move-data is required with --stream or --trace")
+
+    layouts = Layouts.load(args.layouts) if args.layouts else Layouts.from_headers()
+    base = args.base if args.base is not None else dungeon_address(args.version)
+    frame_len = layouts.sizeof(DUNGEON_TYPE)
+    moves = MoveData.from_dump(move_dump, layouts, args.version)
+    matchups = None
+    if args.data_dir is not None:
+        with BinaryData(args.data_dir, layouts, args.version) as data:
+            matchups = TypeMatchups.load(data)
+
+    if args.stream is not None:
+        batches = stream_batches(args.stream, frame_len, 0, None, args.batch)
+    elif args.trace is not None:
+        batches = trace_batches(args.trace, layouts, 0, None, args.batch)
+    else:
+        batches = iter([(0, dump_frames(args.dumps, layouts, args.version))])
+
+    if args.benchmark is not None:
+        first_batch = next(batches)[1]
+        rate = benchmark(layouts, first_batch, base, moves, args.benchmark, args.batch)
+        print(f"{rate:,.0f} decisions/s")
+        sys.exit(0)
+
+    rng_values = None
+    if args.sample is not None:
+        columns = ["frame", "slot", "choice", "move_id", "direction"]
+    else:
+        columns = ["frame", "slot", "move", "move_id", "targets", "direction"]
+        columns += ["weight", "probability"]
+    if matchups is not None:
+        columns.append("threatened")
+    print("\t".join(columns))
+    offset = 0
+    for first, frames in batches:
+        table = EntityTable(layouts, frames, base, first)
+        evaluator = AiEvaluator(table, moves, matchups)
+        possible = evaluator.evaluate()
+        threatened = None
+        if matchups is not None:
+            # Whether any opponent has a super effective move against the monster
+            opponents = (
+                evaluator.opponent_side[:, None, :]
+                != evaluator.opponent_side[:, :, None]
+            )
+            threatened = (evaluator.has_super_effective_move() & opponents).any(-1)
+        if args.sample is not None:
+            values = dungeon_rng.sequences(
+                [args.sample], table.valid.size, skip=offset
+            )[0]
+            offset += table.valid.size
+            choice = evaluator.choose(
+                possible, np.asarray(values).reshape(table.valid.shape)
+            )
+        else:
+            prob = evaluator.probabilities(possible)
+        for f, s in zip(*np.nonzero(table.valid)):
+            extra = [str(int(threatened[f, s]))] if threatened is not None else []
+            if args.sample is not None:
+                c = int(choice[f, s])
+                move_id = int(evaluator.move_ids[f, s, c]) if c >= 0 else -1
+                direction = int(possible.direction[f, s, c]) if c >= 0 else -1
+                row = [first + f, s, c, move_id, direction]
+                print("\t".join(str(v) for v in row + extra))
+                continue
+            for m in range(N_MOVES):
+                if not evaluator.exists[f, s, m]:
+                    continue
+                row = [
+                    first + f,
+                    s,
+                    m,
+                    int(evaluator.move_ids[f, s, m]),
+                    int(possible.n_targets[f, s, m]),
+                    int(possible.direction[f, s, m]),
+                    int(possible.weight[f, s, m]),
+                    f"{prob[f, s, m]:.4f}",
+                ]
+                print("\t".join(str(v) for v in row + extra))
@@ -15,13 +15,18 @@ python3 arm5find.py -d 0x77330 0x14 </path/to/overlay29_NA.bin> </path/to/overla
 
 You can include more than one `-a`/`-d` inputs to search for multiple segments
 at once. You can also include more than one target file to search multiple
-files at once.
+files at once. With the `-r` flag, target directories (e.g., an extracted ROM
+filesystem) are searched recursively. Target files are memory-mapped rather
+than read into memory, so large numbers of big files can be scanned cheaply.
 """
 
 import argparse
+from pathlib import Path
 import re
 from typing import BinaryIO, Iterator, List, Union
 
+import offsets
+
 
 class Segment:
     """Represents a contiguous segment of bytes within a file"""
@@ -139,10 +144,10 @@ def armv5_search(
             for seg, regex in zip(segments, search_regexes):
                 print(f"{seg} regex: {regex.pattern}")
 
-        # The outer loop is over target files to search. Only load one at a time.
+        # The outer loop is over target files to search. Only map one at a time.
         for t, target_fname in enumerate(target_filenames):
-            with open(target_fname, "rb") as target_file:
-                contents = target_file.read()
+            with offsets.MappedBinary(target_fname) as target_file:
+                contents = target_file.contents
 
                 # The inner loop is over search segments
                 for seg, regex, seg_matches in zip(
@@ -164,6 +169,25 @@ def armv5_search(
     return search_results
 
 
+def expand_targets(targets: List[str]) -> List[str]:
+    """Expand target directories into the (sorted) files they contain, recursively
+
+    Args:
+        targets (List[str]): target file or directory names
+
+    Returns:
+        List[str]: target file names
+    """
+    expanded: List[str] = []
+    for target in targets:
+        path = Path(target)
+        if path.is_dir():
+            expanded += sorted(str(p) for p in path.glob("**/*") if p.is_file())
+        else:
+            expanded.append(target)
+    return expanded
+
+
 if __name__ == "__main__":
     parser = argparse.ArgumentParser(
         description="Find ARMv5 assembly or raw data from one binary within another binary"
@@ -192,6 +216,12 @@ if __name__ == "__main__":
         action="store_true",
         help="include self-matches from the source file in search results",
     )
+    parser.add_argument(
+        "-r",
+        "--recursive",
+        action="store_true",
+        help="search all files within target directories recursively",
+    )
     parser.add_argument("-v", "--verbose", action="store_true", help="verbose output")
     parser.add_argument(
         "source", help="source binary file to take search segments from"
@@ -202,6 +232,8 @@ if __name__ == "__main__":
     # If no target files were provided, search the source file
     if not args.target:
         args.target = [args.source]
+    elif args.recursive:
+        args.target = expand_targets(args.target)
 
     segments: List[Segment] = []
     for a in args.asm:
@@ -0,0 +1,601 @@
+#!/usr/bin/env python3
+
+"""
+`at_compression.py` is a command line utility and Python module for
+decompressing and compressing the "AT" containers used by the game's assets
+(handled in arm9 by `DecompressAtNormal`, `DecompressAtHalf`,
+`DecompressAtFromMemoryPointer` and `GetAtSize`), in bulk.
+
+Container formats are identified by their 5-byte magic:
+    AT4PN                   magic, u16 container length, uncompressed data
+    AT3PX, AT4PX            magic, u16 container length, 9 control flags,
+                            u16 decompressed length, compressed data
+    ATUPX, PKDPX            magic, u16 container length, 9 control flags,
+                            u32 decompressed length, compressed data
+The container length includes the header.
+
+Compressed data (PX compression) is a sequence of command bytes, each
+followed by the operands of up to 8 operations, one per bit from the most
+significant bit down:
+- bit set: copy 1 literal byte.
+- bit clear: read a byte; its high nibble h and low nibble n select
+  - if h is the i-th control flag: emit 2 bytes (4 nibbles, high nibble
+    first) following the i-th nibble pattern. All 4 nibbles start as n,
+    raised to n + 1 for i = 1 and lowered to n - 1 for i = 5. Then for
+    i = 1-4, nibble i - 1 is decremented, and for i = 5-8, nibble i - 5 is
+    incremented. For example, i = 2 gives n, n - 1, n, n and i = 5 gives
+    n, n - 1, n - 1, n - 1.
+  - otherwise: a back-reference. With the next byte b, copy h + 3 bytes from
+    ((n << 8) | b) - 0x1000 bytes before the end of the output.
+Decompression stops once the decompressed length has been produced.
+
+The symbol tables only have unverified notes on these functions, so the
+format follows the community documentation of PX compression (as used by
+ppmdu and SkyTemple). `DecompressAtHalf` additionally expands each
+decompressed byte into two bytes, one per nibble (low nibble first), with a
+given high nibble added; this is provided by `expand_nibbles()`, but the
+exact semantics of the high nibble argument are also unverified.
+
+The library provides one-shot functions (`decompress()`, `compress()`), and a
+streaming decompressor (`AtDecompressor`) that can be fed input incrementally
+and returns output as soon as it's available. Back-references are copied as
+slices rather than byte by byte (with overlapping copies done by repeating
+the referenced run), which is where most of the time goes in naive
+implementations. The command line interface processes batches of files (for
+example, all the assets extracted from a ROM) in parallel across all CPU
+cores.
+
+The compressor picks the 9 control flags as the back-reference lengths least
+useful for the input, and greedily encodes the longest back-reference within
+the 4 KiB window, a nibble pattern, or a literal at each position. Its
+output decompresses to the original data, but it isn't byte-identical to
+the game's own compressed files.
+
+Example usage:
+python3 at_compression.py info file.at4px
+python3 at_compression.py decompress -o out -r extracted_rom
+python3 at_compression.py decompress -j 4 -o out a.bin b.bin
+python3 at_compression.py compress -f AT4PX -o out raw/*.bin
+
+Library usage:
+    data = decompress(container)
+    decomp = AtDecompressor()
+    for chunk in chunks:
+        out += decomp.feed(chunk)
+"""
+
+import argparse
+from multiprocessing import Pool
+import os
+import struct
+import sys
+from typing import Dict, Iterator, List, NamedTuple, Optional, Tuple
+
+MAGIC_LEN = 5
+# Magic -> (header length, decompressed length format), or None if uncompressed
+FORMATS: Dict[bytes, Optional[Tuple[int, str]]] = {
+    b"AT4PN": None,
+    b"AT3PX": (18, "<H"),
+    b"AT4PX": (18, "<H"),
+    b"ATUPX": (20, "<I"),
+    b"PKDPX": (20, "<I"),
+}
+N_FLAGS = 9
+# Distance range of back-references
+WINDOW = 0x1000
+MIN_MATCH = 3
+MAX_MATCH = 0xF + MIN_MATCH
+
+
+class AtHeader(NamedTuple):
+    magic: bytes
+    container_length: int
+    flags: bytes  # Empty for uncompressed containers
+    decompressed_length: int
+    header_length: int
+
+    @property
+    def compressed(self) -> bool:
+        return bool(self.flags)
+
+
+def parse_header(data: bytes) -> AtHeader:
+    """Parses the header of an AT container"""
+    magic = bytes(data[:MAGIC_LEN])
+    if magic not in FORMATS:
+        raise ValueError(f"not an AT container (magic {magic!r})")
+    fmt = FORMATS[magic]
+    header_length = MAGIC_LEN + 2 if fmt is None else fmt[0]
+    if len(data) < header_length:
+        raise ValueError(f"truncated {magic.decode()} header")
+    (container_length,) = struct.unpack_from("<H", data, MAGIC_LEN)
+    if fmt is None:
+        return AtHeader(
+            magic,
+            container_length,
+            b"",
+            container_length - header_length,
+            header_length,
+        )
+    flags = bytes(data[MAGIC_LEN + 2 : MAGIC_LEN + 2 + N_FLAGS])
+    (decompressed_length,) = struct.unpack_from(fmt[1], data, MAGIC_LEN + 2 + N_FLAGS)
+    return AtHeader(magic, container_length, flags, decompressed_length, header_length)
+
+
+def is_at_container(data: bytes) -> bool:
+    return bytes(data[:MAGIC_LEN]) in FORMATS
+
+
+def pattern_nibbles(i: int, n: int) -> List[int]:
+    """
+    The 4 nibbles produced by the nibble pattern operation of the i-th control
+    flag with low nibble n, before wrapping to 4 bits
+    """
+    base = n
+    if i == 1:
+        base += 1
+    elif i == 5:
+        base -= 1
+    nibbles = [base] * 4
+    if 1 <= i <= 4:
+        nibbles[i - 1] -= 1
+    elif i >= 5:
+        nibbles[i - 5] += 1
+    return nibbles
+
+
+def nibble_patterns(flags: bytes) -> List[Optional[List[bytes]]]:
+    """
+    The 2-byte outputs of nibble pattern operations, indexed by the high
+    nibble of the operation byte, then the low nibble. Entries for high
+    nibbles that aren't control flags are None (back-references).
+    """
+    table: List[Optional[List[bytes]]] = [None] * 16
+    for i, flag in reversed(list(enumerate(flags))):
+        patterns = []
+        for n in range(16):
+            nibbles = [x & 0xF for x in pattern_nibbles(i, n)]
+            patterns.append(
+                bytes([nibbles[0] << 4 | nibbles[1], nibbles[2] << 4 | nibbles[3]])
+            )
+        # The first matching flag takes precedence
+        table[flag & 0xF] = patterns
+    return table
+
+
+def _decompress_px(
+    src: bytes,
+    pos: int,
+    end: int,
+    out: bytearray,
+    size: int,
+    patterns: List[Optional[List[bytes]]],
+    final: bool,
+) -> int:
+    """
+    Decompresses commands from src[pos:end] into out until size bytes have
+    been produced. If not final, stops before a command whose operands might
+    not be fully available yet. Returns the new input position.
+    """
+    # A command is 1 byte plus at most 2 bytes for each of its 8 operations
+    safe_end = end if final else end - 17
+    while len(out) < size:
+        if pos >= safe_end:
+            if not final or pos >= end:
+                break
+        cmd = src[pos]
+        pos += 1
+        for bit in (0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01):
+            if len(out) >= size:
+                break
+            if cmd & bit:
+                out.append(src[pos])
+                pos += 1
+                continue
+            op = src[pos]
+            pos += 1
+            pattern = patterns[op >> 4]
+            if pattern is not None:
+                out += pattern[op & 0xF]
+                continue
+            n = (op >> 4) + MIN_MATCH
+            dist = WINDOW - (((op & 0xF) << 8) | src[pos])
+            pos += 1
+            start = len(out) - dist
+            if start < 0:
+                raise ValueError(
+                    f"back-reference {dist:#x} bytes before the start of the output"
+                )
+            if dist >= n:
+                out += out[start : start + n]
+            else:
+                # Overlapping copy: repeats the last dist bytes
+                run = out[start:]
+                out += (run * (n // dist + 1))[:n]
+    if len(out) > size:
+        # The last pattern operation may overshoot by a byte
+        del out[size:]
+    return pos
+
+
+def decompress(data: bytes) -> bytes:
+    """Decompresses an AT container"""
+    header = parse_header(data)
+    if len(data) < header.container_length:
+        raise ValueError(
+            f"truncated {header.magic.decode()} container "
+            + f"({len(data):#x} < {header.container_length:#x} bytes)"
+        )
+    if not header.compressed:
+        return bytes(data[header.header_length : header.container_length])
+    out = bytearray()
+    try:
+        _decompress_px(
+            data,
+            header.header_length,
+            header.container_length,
+            out,
+            header.decompressed_length,
+            nibble_patterns(header.flags),
+            True,
+        )
+    except IndexError:
+        raise ValueError("compressed data ends before the decompressed length")
+    if len(out) < header.decompressed_length:
+        raise ValueError("compressed data ends before the decompressed length")
+    return bytes(out)
+
+
+def expand_nibbles(data: bytes, high_nibble: int = 0) -> bytes:
+    """
+    The extra step of DecompressAtHalf: stores each nibble as a byte (low
+    nibble first), with high_nibble as the high nibble of every byte.
+    """
+    high = (high_nibble & 0xF) << 4
+    lo = bytes(high | (b & 0xF) for b in range(256))
+    hi = bytes(high | (b >> 4) for b in range(256))
+    out = bytearray(2 * len(data))
+    out[0::2] = data.translate(lo)
+    out[1::2] = data.translate(hi)
+    return bytes(out)
+
+
+class AtDecompressor:
+    """
+    Streaming AT decompressor. Feed it the container in chunks of any size;
+    each call returns the decompressed bytes that became available.
+    """
+
+    def __init__(self):
+        self.header: Optional[AtHeader] = None
+        self.total_out = 0  # Number of decompressed bytes returned so far
+        self._buf = bytearray()
+        self._consumed = 0  # Number of container bytes dropped from _buf
+        # Recent output, kept for back-references
+        self._window = bytearray()
+        self._patterns: List[Optional[List[bytes]]] = []
+
+    @property
+    def finished(self) -> bool:
+        return (
+            self.header is not None
+            and self.total_out >= self.header.decompressed_length
+        )
+
+    def _parse_header(self) -> bool:
+        if len(self._buf) < MAGIC_LEN:
+            return False
+        magic = bytes(self._buf[:MAGIC_LEN])
+        if magic not in FORMATS:
+            raise ValueError(f"not an AT container (magic {magic!r})")
+        fmt = FORMATS[magic]
+        if len(self._buf) < (MAGIC_LEN + 2 if fmt is None else fmt[0]):
+            return False
+        self.header = parse_header(self._buf)
+        self._patterns = nibble_patterns(self.header.flags)
+        self._consumed = self.header.header_length
+        del self._buf[: self.header.header_length]
+        return True
+
+    def feed(self, data: bytes) -> bytes:
+        if self.finished:
+            return b""
+        self._buf += data
+        if self.header is None and not self._parse_header():
+            return b""
+
+        h = self.header
+        end = min(len(self._buf), h.container_length - self._consumed)
+        final = self._consumed + len(self._buf) >= h.container_length
+        if not h.compressed:
+            chunk = bytes(self._buf[:end])
+            pos = end
+        else:
+            start = len(self._window)
+            # Output produced before the start of the window
+            base = self.total_out - start
+            try:
+                pos = _decompress_px(
+                    self._buf,
+                    0,
+                    end,
+                    self._window,
+                    h.decompressed_length - base,
+                    self._patterns,
+                    final,
+                )
+            except IndexError:
+                raise ValueError("compressed data ends before the decompressed length")
+            chunk = bytes(self._window[start:])
+            if len(self._window) > 2 * WINDOW:
+                del self._window[:-WINDOW]
+        self._consumed += pos
+        del self._buf[:pos]
+        self.total_out += len(chunk)
+        if final and not self.finished:
+            raise ValueError("compressed data ends before the decompressed length")
+        return chunk
+
+
+def iter_decompress(f, chunk_size: int = 0x10000) -> Iterator[bytes]:
+    """Decompresses an AT container from a file object, chunk by chunk"""
+    decomp = AtDecompressor()
+    while not decomp.finished:
+        data = f.read(chunk_size)
+        if not data:
+            raise ValueError("file ends before the end of the AT container")
+        out = decomp.feed(data)
+        if out:
+            yield out
+
+
+def _pattern_lookup(flags: bytes) -> Dict[bytes, int]:
+    """Maps 2-byte outputs of nibble pattern operations to operation bytes"""
+    lookup = {}
+    patterns = nibble_patterns(flags)
+    seen = set()
+    for i, flag in enumerate(flags):
+        h = flag & 0xF
+        if h in seen:
+            # The first matching flag takes precedence
+            continue
+        seen.add(h)
+        for n in range(16):
+            # Skip patterns whose nibbles wrap around, since their output
+            # depends on how a decoder truncates nibbles to 4 bits
+            if all(0 <= x <= 0xF for x in pattern_nibbles(i, n)):
+                lookup.setdefault(patterns[h][n], h << 4 | n)
+    return lookup
+
+
+def _find_matches(
+    data: bytes, allowed_lengths: Optional[List[int]] = None, max_chain: int = 64
+) -> Iterator[Tuple[int, int, int]]:
+    """
+    Greedy back-reference search. Yields (position, distance, length) for the
+    longest match at each position (length 0 if none), restricted to the
+    allowed lengths if given. The caller advances through the data by sending
+    the number of bytes it consumed.
+    """
+    chains: Dict[bytes, List[int]] = {}
+    pos = 0
+    indexed = 0
+    n = len(data)
+    while pos < n:
+        # Index all positions before pos
+        while indexed < pos:
+            key = data[indexed : indexed + MIN_MATCH]
+            if len(key) == MIN_MATCH:
+                chains.setdefault(key, []).append(indexed)
+            indexed += 1
+        best_len = best_dist = 0
+        candidates = chains.get(data[pos : pos + MIN_MATCH])
+        if candidates:
+            limit = min(MAX_MATCH, n - pos)
+            for start in reversed(candidates[-max_chain:]):
+                dist = pos - start
+                if dist > WINDOW:
+                    break
+                length = MIN_MATCH
+                while length < limit and data[start + length] == data[pos + length]:
+                    length += 1
+                if length > best_len:
+                    best_len, best_dist = length, dist
+                    if length == limit:
+                        break
+        if allowed_lengths is not None and best_len:
+            while best_len >= MIN_MATCH and not allowed_lengths[best_len]:
+                best_len -= 1
+            if best_len < MIN_MATCH:
+                best_len = 0
+        pos += yield (pos, best_dist, best_len)
+
+
+def _encode(data: bytes, flags: bytes, allowed: List[bool]) -> bytes:
+    if not data:
+        return b""
+    lookup = _pattern_lookup(flags)
+    out = bytearray()
+    ops: List[bytes] = []
+    cmd = 0
+    matches = _find_matches(data, allowed)
+    pos, dist, length = next(matches)
+    while True:
+        pattern_op = lookup.get(data[pos : pos + 2]) if pos + 2 <= len(data) else None
+        if length >= 4 or (length == MIN_MATCH and pattern_op is None):
+            value = WINDOW - dist
+            ops.append(bytes([(length - MIN_MATCH) << 4 | value >> 8, value & 0xFF]))
+            step = length
+        elif pattern_op is not None:
+            ops.append(bytes([pattern_op]))
+            step = 2
+        else:
+            cmd |= 0x80 >> len(ops)
+            ops.append(data[pos : pos + 1])
+            step = 1
+        if len(ops) == 8:
+            out.append(cmd)
+            out += b"".join(ops)
+            ops, cmd = [], 0
+        try:
+            pos, dist, length = matches.send(step)
+        except StopIteration:
+            break
+    if ops:
+        out.append(cmd)
+        out += b"".join(ops)
+    return bytes(out)
+
+
+def choose_flags(data: bytes) -> bytes:
+    """
+    Picks the control flags: the 9 back-reference length codes that are used
+    least when compressing the data with every length allowed.
+    """
+    counts = [0] * 16
+    matches = _find_matches(data)
+    try:
+        _, _, length = next(matches)
+        while True:
+            if length:
+                counts[length - MIN_MATCH] += 1
+            _, _, length = matches.send(max(length, 1))
+    except StopIteration:
+        pass
+    # Stable sort, so that ties go to the lower codes
+    return bytes(sorted(range(16), key=lambda h: counts[h])[:N_FLAGS])
+
+
+def compress(data: bytes, magic: bytes = b"AT4PX") -> bytes:
+    """Compresses data into an AT container of the given format"""
+    if magic not in FORMATS:
+        raise ValueError(f"unknown AT format {magic!r}")
+    fmt = FORMATS[magic]
+    if fmt is None:
+        if len(data) + MAGIC_LEN + 2 > 0xFFFF:
+            raise ValueError("data too large for an AT4PN container")
+        return magic + struct.pack("<H", len(data) + MAGIC_LEN + 2) + bytes(data)
+    header_length, size_fmt = fmt
+    if len(data) >= 1 << (8 * struct.calcsize(size_fmt)):
+        raise ValueError(f"data too large for a {magic.decode()} container")
+    flags = choose_flags(data)
+    allowed = [False] * (MAX_MATCH + 1)
+    for h in set(range(16)) - set(flags):
+        allowed[h + MIN_MATCH] = True
+    body = _encode(data, flags, allowed)
+    container_length = header_length + len(body)
+    if container_length > 0xFFFF:
+        raise ValueError(f"compressed data too large for a {magic.decode()} container")
+    return (
+        magic
+        + struct.pack("<H", container_length)
+        + flags
+        + struct.pack(size_fmt, len(data))
+        + body
+    )
+
+
+def expand_paths(paths: List[str], recursive: bool) -> List[Tuple[str, str]]:
+    """Lists (path, output-relative path) pairs for all input files"""
+    expanded = []
+    for path in paths:
+        if recursive and os.path.isdir(path):
+            for root, _, files in os.walk(path):
+                for f in sorted(files):
+                    full = os.path.join(root, f)
+                    expanded.append((full, os.path.relpath(full, path)))
+        else:
+            expanded.append((path, os.path.basename(path)))
+    return expanded
+
+
+def _process(job: Tuple[str, str, str, str, str]) -> Tuple[str, Optional[str]]:
+    mode, path, rel, out_dir, magic = job
+    try:
+        with open(path, "rb") as f:
+            data = f.read()
+        if mode == "decompress":
+            if not is_at_container(data):
+                return path, "skipped (not an AT container)"
+            result = decompress(data)
+        else:
+            result = compress(data, magic.encode())
+        out_path = os.path.join(out_dir, rel)
+        os.makedirs(os.path.dirname(out_path) or ".", exist_ok=True)
+        with open(out_path, "wb") as f:
+            f.write(result)
+        return path, None
+    except (OSError, ValueError) as e:
+        return path, f"error: {e}"
+
+
+def print_info(path: str):
+    with open(path, "rb") as f:
+        data = f.read(32)
+    try:
+        h = parse_header(data)
+    except ValueError as e:
+        print(f"{path}: {e}")
+        return
+    desc = f"{path}: {h.magic.decode()}, container {h.container_length:#x} bytes"
+    if h.compressed:
+        desc += (
+            f", decompressed {h.decompressed_length:#x} bytes, "
+            + f"flags {h.flags.hex(' ')}"
+        )
+    print(desc)
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(
+        description="Decompress and compress AT containers (PX compression)"
+    )
+    subparsers = parser.add_subparsers(dest="command", required=True)
+    info_parser = subparsers.add_parser("info", help="print AT container headers")
+    info_parser.add_argument("paths", nargs="+", help="AT container files")
+    for name in ("decompress", "compress"):
+        sub = subparsers.add_parser(name, help=f"{name} files in bulk")
+        sub.add_argument("paths", nargs="+", help="input files")
+        sub.add_argument("-o", "--output", required=True, help="output directory")
+        sub.add_argument(
+            "-r",
+            "--recursive",
+            action="store_true",
+            help="recursively process all files in directory arguments",
+        )
+        sub.add_argument(
+            "-j",
+            "--jobs",
+            type=int,
+            default=os.cpu_count(),
+            help="number of worker processes (default: number of CPUs)",
+        )
+        if name == "compress":
+            sub.add_argument(
+                "-f",
+                "--format",
+                choices=[m.decode() for m in FORMATS],
+                default="AT4PX",
+                help="container format",
+            )
+    args = parser.parse_args()
+
+    if args.command == "info":
+        for path in args.paths:
+            print_info(path)
+        sys.exit(0)
+
+    magic = getattr(args, "format", "")
+    jobs = [
+        (args.command, path, rel, args.output, magic)
+        for path, rel in expand_paths(args.paths, args.recursive)
+    ]
+    n_errors = 0
+    with Pool(max(1, args.jobs)) as pool:
+        for path, message in pool.imap_unordered(_process, jobs, chunksize=16):
+            if message is not None:
+                print(f"{path}: {message}", file=sys.stderr)
+                n_errors += message.startswith("error")
+    print(f"Processed {len(jobs)} files ({n_errors} errors)")
+    if n_errors:
+        sys.exit(1)
@@ -0,0 +1,553 @@
+#!/usr/bin/env python3
+
+"""
+`damage_calc.py` is a command line utility (and importable module) for
+evaluating the dungeon damage formula (CalcDamage in overlay29) over large
+batches of inputs, such as the full cross product of a range of attacker
+stats, defender stats, stat stages, levels, move powers and types. For every
+input, it reports the intermediate quantities that the game records in
+struct damage_calc_diag, along with the type matchups and final damage.
+
+As documented for CalcDamage, the base damage formula is:
+  [(153/256)*(A + P) - 0.5*D + 50*ln(10*[L + (A - D)/8 + 50]) - 311]
+which is divided by 85/64 if the attacker isn't a team member, clamped to
+[1, 999], and then multiplied by the type matchup multiplier and the static
+damage multiplier. The formula constants, stat stage multipliers, type matchup
+tables and ln table are read from the game's binaries (arm9, overlay10,
+overlay29) using the symbol tables, falling back to the documented values for
+scalar constants whose addresses are unknown for a version. Struct layouts come
+from `layouts.py`, fixed-point arithmetic from `fixed_point.py`, and type
+matchup lookups from `type_matchups.py`.
+
+`calc_damage` evaluates a single input with plain Python ints, and serves as
+the reference implementation. `calc_damage_batch` evaluates columns of inputs
+(struct-of-arrays) at once, and is vectorized with numpy.
+
+Note that only the documented parts of the damage pipeline are modeled:
+    - Stat stages, offensive/defensive multipliers (struct
+      monster_stat_modifiers), level, move power, non-team-member modifier,
+      the static damage multiplier passed to CalcDamage.
+    - Type matchups against both defender types (TYPE_MATCHUP_TABLE combined
+      with TYPE_MATCHUP_COMBINATOR_TABLE), including the hard-coded Ghost
+      immunity to Normal and Fighting moves unless the defender is exposed.
+Abilities, items, IQ skills, weather, STAB, critical hits and random variation
+are not modeled. Also, the points at which the game rounds intermediate
+values are not fully documented; the rounding used here (round half up for
+FLV and the final results, truncation for stat multipliers) is unverified.
+
+Example usage:
+python3 damage_calc.py -d rom_data --atk 50:201:50 --def 50:201:50 --power 10
+python3 damage_calc.py -d rom_data --level 1:101 --move-type FIRE \\
+    --defender-type GRASS --defender-type WATER/GROUND
+python3 damage_calc.py -d rom_data --atk-stage 0:21 --non-team --summary
+"""
+
+import argparse
+import itertools
+import struct
+import sys
+from typing import Dict, List, NamedTuple, Optional, Sequence
+
+try:
+    import numpy as np
+except ImportError:
+    np = None
+
+import fixed_point as fx
+import layouts
+from type_matchups import TypeMatchups
+
+N_STAT_STAGES = 21
+DEFAULT_STAT_STAGE = 10
+FX8_ONE = 1 << fx.FX32_FRACTION_BITS
+# Clamp for the offense term, as documented for damage_calc_diag::damage_calc_at
+MAX_OFFENSE = 999
+
+
+class DamageConstants(NamedTuple):
+    """
+    Constants of the damage formula, as binary fixed-point numbers with 8
+    fraction bits unless otherwise noted. Defaults are the documented values.
+    """
+
+    flv_shift: int = 50 * FX8_ONE
+    constant_shift: int = -311 * FX8_ONE
+    flv_deficit_divisor: int = 8 * FX8_ONE
+    non_team_member_modifier: int = 85 * FX8_ONE // 64
+    ln_prefactor: int = 50 * FX8_ONE
+    at_prefactor: int = 153
+    def_prefactor: int = -FX8_ONE // 2
+    ln_arg_prefactor: int = 10 * FX8_ONE
+    # 64-bit fixed-point numbers with 16 fraction bits
+    min_base: int = 1 << fx.FX64_FRACTION_BITS
+    max_base: int = 999 << fx.FX64_FRACTION_BITS
+
+
+# Damage formula constant symbols, with their binaries
+CONSTANT_SYMBOLS = {
+    "flv_shift": ("arm9", "DAMAGE_FORMULA_FLV_SHIFT"),
+    "constant_shift": ("arm9", "DAMAGE_FORMULA_CONSTANT_SHIFT"),
+    "flv_deficit_divisor": ("arm9", "DAMAGE_FORMULA_FLV_DEFICIT_DIVISOR"),
+    "non_team_member_modifier": ("arm9", "DAMAGE_FORMULA_NON_TEAM_MEMBER_MODIFIER"),
+    "ln_prefactor": ("arm9", "DAMAGE_FORMULA_LN_PREFACTOR"),
+    "at_prefactor": ("arm9", "DAMAGE_FORMULA_AT_PREFACTOR"),
+    "def_prefactor": ("arm9", "DAMAGE_FORMULA_DEF_PREFACTOR"),
+    "ln_arg_prefactor": ("arm9", "DAMAGE_FORMULA_LN_ARG_PREFACTOR"),
+    "min_base": ("overlay29", "DAMAGE_FORMULA_MIN_BASE"),
+    "max_base": ("overlay29", "DAMAGE_FORMULA_MAX_BASE"),
+}
+
+# Type matchup multiplier symbols in overlay10, indexed by enum type_matchup
+MATCHUP_MULTIPLIER_SYMBOLS = [
+    "MATCHUP_IMMUNE_MULTIPLIER",
+    "MATCHUP_NOT_VERY_EFFECTIVE_MULTIPLIER",
+    "MATCHUP_NEUTRAL_MULTIPLIER",
+    "MATCHUP_SUPER_EFFECTIVE_MULTIPLIER",
+]
+
+# Input columns, with their defaults
+INPUT_DEFAULTS = {
+    "offensive_stat": 50,
+    "defensive_stat": 50,
+    "offensive_stage": DEFAULT_STAT_STAGE,
+    "defensive_stage": DEFAULT_STAT_STAGE,
+    "offensive_multiplier": FX8_ONE,
+    "defensive_multiplier": FX8_ONE,
+    "level": 50,
+    "power": 0,
+    "move_type": 0,
+    "defender_type1": 0,
+    "defender_type2": 0,
+    "is_team_member": 1,
+    "exposed": 0,
+    "static_damage_mult": FX8_ONE,
+}
+
+# Output columns, named after the fields of struct damage_calc_diag where
+# applicable
+OUTPUT_COLUMNS = [
+    "offense_calc",
+    "defense_calc",
+    "damage_calc_at",
+    "damage_calc_def",
+    "damage_calc_flv",
+    "damage_calc_base",
+    "move_indiv_type_matchup1",
+    "move_indiv_type_matchup2",
+    "type_matchup",
+    "damage_calc",
+]
+
+
+class DamageTables:
+    """The data tables used by the damage formula"""
+
+    def __init__(
+        self,
+        constants: DamageConstants,
+        offensive_stage_multipliers: Sequence[int],
+        defensive_stage_multipliers: Sequence[int],
+        type_matchups: Sequence[Sequence[int]],
+        matchup_combinations: Sequence[Sequence[int]],
+        matchup_multipliers: Sequence[int],
+        ln_table: Sequence[int],
+        ghost_type: int,
+        ghost_ineffective_types: Sequence[int],
+    ):
+        self.constants = constants
+        self.offensive_stage_multipliers = list(offensive_stage_multipliers)
+        self.defensive_stage_multipliers = list(defensive_stage_multipliers)
+        self.type_matchups = [list(row) for row in type_matchups]
+        self.matchup_combinations = [list(row) for row in matchup_combinations]
+        self.matchup_multipliers = list(matchup_multipliers)
+        self.ln_table = list(ln_table)
+        self.ghost_type = ghost_type
+        self.ghost_ineffective_types = list(ghost_ineffective_types)
+        self.matchups = TypeMatchups(
+            type_matchups, matchup_combinations, ghost_type, ghost_ineffective_types
+        )
+
+    @classmethod
+    def load(cls, data: layouts.BinaryData) -> "DamageTables":
+        """Loads the tables from the binaries extracted from a ROM"""
+        lts = data.layouts
+        values = {}
+        addresses = {
+            field: layouts.symbol_address(data.symbol(binary, name), data.version)
+            for field, (binary, name) in CONSTANT_SYMBOLS.items()
+        }
+        for field, (binary, name) in CONSTANT_SYMBOLS.items():
+            # Constants that share an address with another constant in the
+            # symbol tables can't be told apart, so keep the documented value
+            shared = list(addresses.values()).count(addresses[field]) > 1
+            if data.has(binary, name) and not shared:
+                values[field] = data.read_int(binary, name)
+        constants = DamageConstants(**values)
+
+        def stage_table(name: str) -> List[int]:
+            raw = data.raw("overlay10", name)
+            return list(struct.unpack(f"<{N_STAT_STAGES}i", raw))
+
+        matchup_table = data.read("overlay10", "TYPE_MATCHUP_TABLE").matchups
+        type_matchups = [[m.val for m in row] for row in matchup_table]
+        combinator = data.read("overlay10", "TYPE_MATCHUP_COMBINATOR_TABLE")
+        matchup_combinations = [list(row) for row in combinator.combination]
+        matchup_multipliers = [
+            data.read_int("overlay10", name) for name in MATCHUP_MULTIPLIER_SYMBOLS
+        ]
+        if data.has("arm9", "NATURAL_LOG_VALUE_TABLE"):
+            ln_table = list(data.read("arm9", "NATURAL_LOG_VALUE_TABLE"))
+        else:
+            ln_table = fx.approximate_ln_table()
+        types = lts.enums["enum type_id"]
+        return cls(
+            constants,
+            stage_table("OFFENSIVE_STAT_STAGE_MULTIPLIERS"),
+            stage_table("DEFENSIVE_STAT_STAGE_MULTIPLIERS"),
+            type_matchups,
+            matchup_combinations,
+            matchup_multipliers,
+            ln_table,
+            # See IsTypeIneffectiveAgainstGhost
+            types["TYPE_GHOST"],
+            [types["TYPE_NORMAL"], types["TYPE_FIGHTING"]],
+        )
+
+
+def round_fx64(x: int) -> int:
+    """Round a 64-bit fixed-point number to the nearest integer, halves up"""
+    return (x + (1 << (fx.FX64_FRACTION_BITS - 1))) >> fx.FX64_FRACTION_BITS
+
+
+def indiv_type_matchup(
+    tables: DamageTables, move_type: int, defender_type: int, exposed: bool
+) -> int:
+    """The matchup of a move type against a single defender type"""
+    return tables.matchups.matchup(move_type, defender_type, exposed)
+
+
+def calc_damage(tables: DamageTables, **inputs: int) -> Dict[str, int]:
+    """
+    Evaluates the damage formula for a single input, given as keyword
+    arguments named after the keys of INPUT_DEFAULTS.
+    """
+    unknown = set(inputs) - set(INPUT_DEFAULTS)
+    if unknown:
+        raise TypeError(f"unknown inputs: {', '.join(sorted(unknown))}")
+    x = {**INPUT_DEFAULTS, **inputs}
+    c = tables.constants
+    to64 = fx.fixed_point32_to_64
+    F = fx.FX64_FRACTION_BITS
+
+    def stage(table: List[int], s: int) -> int:
+        return table[min(max(s, 0), N_STAT_STAGES - 1)]
+
+    off_mult = fx.umultiply_by_fixed_point(
+        stage(tables.offensive_stage_multipliers, x["offensive_stage"]),
+        x["offensive_multiplier"],
+    )
+    def_mult = fx.umultiply_by_fixed_point(
+        stage(tables.defensive_stage_multipliers, x["defensive_stage"]),
+        x["defensive_multiplier"],
+    )
+    offense = fx.multiply_by_fixed_point(x["offensive_stat"], off_mult)
+    power = fx.multiply_by_fixed_point(x["power"], off_mult)
+    defense = fx.multiply_by_fixed_point(x["defensive_stat"], def_mult)
+    at = min(max(offense, 0), MAX_OFFENSE) + power
+
+    flv = round_fx64(
+        fx.add_fixed_point64(
+            fx.divide_fixed_point64(
+                (offense - defense) << F, to64(c.flv_deficit_divisor)
+            ),
+            x["level"] << F,
+        )
+    )
+    ln_arg = fx.multiply_fixed_point64(
+        fx.add_fixed_point64(flv << F, to64(c.flv_shift)), to64(c.ln_arg_prefactor)
+    )
+    ln = fx.clamped_ln(fx.fixed_point64_to_int(ln_arg), tables.ln_table)
+    base = fx.add_fixed_point64(
+        fx.add_fixed_point64(
+            fx.multiply_fixed_point64(at << F, to64(c.at_prefactor)),
+            fx.multiply_fixed_point64(defense << F, to64(c.def_prefactor)),
+        ),
+        fx.add_fixed_point64(
+            fx.multiply_fixed_point64(ln, to64(c.ln_prefactor)),
+            to64(c.constant_shift),
+        ),
+    )
+    if not x["is_team_member"]:
+        base = fx.divide_fixed_point64(base, to64(c.non_team_member_modifier))
+    base = min(max(base, c.min_base), c.max_base)
+
+    m1 = indiv_type_matchup(
+        tables, x["move_type"], x["defender_type1"], bool(x["exposed"])
+    )
+    m2 = indiv_type_matchup(
+        tables, x["move_type"], x["defender_type2"], bool(x["exposed"])
+    )
+    matchup = tables.matchup_combinations[m1][m2]
+    mult = fx.multiply_fixed_point64(
+        to64(x["static_damage_mult"]), to64(tables.matchup_multipliers[matchup])
+    )
+    return {
+        "offense_calc": offense,
+        "defense_calc": defense,
+        "damage_calc_at": at,
+        "damage_calc_def": defense,
+        "damage_calc_flv": flv,
+        "damage_calc_base": round_fx64(base),
+        "move_indiv_type_matchup1": m1,
+        "move_indiv_type_matchup2": m2,
+        "type_matchup": matchup,
+        "damage_calc": round_fx64(fx.multiply_fixed_point64(base, mult)),
+    }
+
+
+def calc_damage_batch(tables: DamageTables, inputs: Dict[str, Sequence[int]]):
+    """
+    Evaluates the damage formula over columns of inputs (all of the same
+    length, named after the keys of INPUT_DEFAULTS; missing columns take
+    their default values). Returns a dict of output columns.
+    """
+    unknown = set(inputs) - set(INPUT_DEFAULTS)
+    if unknown:
+        raise TypeError(f"unknown inputs: {', '.join(sorted(unknown))}")
+    n = len(next(iter(inputs.values()))) if inputs else 1
+    if np is None:
+        rows = [
+            calc_damage(tables, **{k: int(v[i]) for k, v in inputs.items()})
+            for i in range(n)
+        ]
+        return {col: [r[col] for r in rows] for col in OUTPUT_COLUMNS}
+
+    x = {
+        k: np.broadcast_to(np.asarray(inputs.get(k, v), dtype=np.int64), (n,))
+        for k, v in INPUT_DEFAULTS.items()
+    }
+    c = tables.constants
+    F = np.int64(fx.FX64_FRACTION_BITS)
+    half = np.int64(1 << (fx.FX64_FRACTION_BITS - 1))
+
+    def to64(v: int):
+        return np.int64(fx.fixed_point32_to_64(v))
+
+    def mul8(a, b):
+        # MultiplyByFixedPoint/UMultiplyByFixedPoint for small operands,
+        # where the 64-bit intermediate product can't overflow
+        return (a * b) >> np.int64(fx.FX32_FRACTION_BITS)
+
+    def stage(table: List[int], s):
+        return np.asarray(table, dtype=np.int64)[np.clip(s, 0, N_STAT_STAGES - 1)]
+
+    def round64(v):
+        return (v + half) >> F
+
+    off_mult = mul8(
+        stage(tables.offensive_stage_multipliers, x["offensive_stage"]),
+        x["offensive_multiplier"],
+    )
+    def_mult = mul8(
+        stage(tables.defensive_stage_multipliers, x["defensive_stage"]),
+        x["defensive_multiplier"],
+    )
+    offense = mul8(x["offensive_stat"], off_mult)
+    power = mul8(x["power"], off_mult)
+    defense = mul8(x["defensive_stat"], def_mult)
+    at = np.clip(offense, 0, MAX_OFFENSE) + power
+
+    divisor = np.full(n, to64(c.flv_deficit_divisor))
+    flv = round64(
+        fx.divide_fixed_point64_batch((offense - defense) << F, divisor)
+        + (x["level"] << F)
+    )
+    ln_arg = fx.multiply_fixed_point64_batch(
+        (flv << F) + to64(c.flv_shift), np.full(n, to64(c.ln_arg_prefactor))
+    )
+    ln = fx.clamped_ln_batch(ln_arg >> F, tables.ln_table)
+    base = (
+        fx.multiply_fixed_point64_batch(at << F, np.full(n, to64(c.at_prefactor)))
+        + fx.multiply_fixed_point64_batch(
+            defense << F, np.full(n, to64(c.def_prefactor))
+        )
+        + fx.multiply_fixed_point64_batch(ln, np.full(n, to64(c.ln_prefactor)))
+        + to64(c.constant_shift)
+    )
+    non_team = x["is_team_member"] == 0
+    if non_team.any():
+        base = np.where(
+            non_team,
+            fx.divide_fixed_point64_batch(
+                base, np.full(n, to64(c.non_team_member_modifier))
+            ),
+            base,
+        )
+    base = np.clip(base, c.min_base, c.max_base)
+
+    m1 = tables.matchups.matchup_batch(
+        x["move_type"], x["defender_type1"], x["exposed"]
+    )
+    m2 = tables.matchups.matchup_batch(
+        x["move_type"], x["defender_type2"], x["exposed"]
+    )
+    matchup = tables.matchups.matchup_both_batch(
+        x["move_type"], x["defender_type1"], x["defender_type2"], x["exposed"]
+    )
+    type_mult = np.asarray(
+        [fx.fixed_point32_to_64(m) for m in tables.matchup_multipliers], dtype=np.int64
+    )[matchup]
+    mult = fx.multiply_fixed_point64_batch(
+        x["static_damage_mult"] << np.int64(8), type_mult
+    )
+    return {
+        "offense_calc": offense,
+        "defense_calc": defense,
+        "damage_calc_at": at,
+        "damage_calc_def": defense,
+        "damage_calc_flv": flv,
+        "damage_calc_base": round64(base),
+        "move_indiv_type_matchup1": m1,
+        "move_indiv_type_matchup2": m2,
+        "type_matchup": matchup,
+        "damage_calc": round64(fx.multiply_fixed_point64_batch(base, mult)),
+    }
+
+
+def cross_product(columns: Dict[str, Sequence[int]]) -> Dict[str, Sequence[int]]:
+    """Expands value lists for each input into columns over their cross product"""
+    names = list(columns)
+    if np is not None:
+        grids = np.meshgrid(*(np.asarray(columns[k]) for k in names), indexing="ij")
+        return {k: g.ravel() for k, g in zip(names, grids)}
+    rows = list(itertools.product(*(columns[k] for k in names)))
+    return {k: [r[i] for r in rows] for i, k in enumerate(names)}
+
+
+if __name__ == "__main__":
+
+    def int_range(s: str) -> List[int]:
+        """Parses an int, or a Python-style range start:stop[:step]"""
+        parts = [int(p, 0) for p in s.split(":")]
+        if len(parts) == 1:
+            return parts
+        return list(range(*parts))
+
+    parser = argparse.ArgumentParser(
+        description="Evaluate the dungeon damage formula over batches of inputs"
+    )
+    parser.add_argument(
+        "-d", "--data-dir", required=True, help="data directory for unpacked EoS ROM"
+    )
+    parser.add_argument(
+        "-v",
+        "--version",
+        choices=["NA", "EU", "JP"],
+        default="NA",
+        help="game version of the ROM",
+    )
+    for flag, column in (
+        ("--atk", "offensive_stat"),
+        ("--def", "defensive_stat"),
+        ("--atk-stage", "offensive_stage"),
+        ("--def-stage", "defensive_stage"),
+        ("--atk-mult", "offensive_multiplier"),
+        ("--def-mult", "defensive_multiplier"),
+        ("--level", "level"),
+        ("--power", "power"),
+        ("--static-mult", "static_damage_mult"),
+    ):
+        parser.add_argument(
+            flag,
+            dest=column,
+            type=int_range,
+            action="append",
+            help=f"{column} values: an int or a range start:stop[:step] "
+            + f"(default: {INPUT_DEFAULTS[column]})",
+        )
+    parser.add_argument(
+        "--move-type", action="append", help="move type name (e.g., FIRE)"
+    )
+    parser.add_argument(
+        "--defender-type",
+        action="append",
+        help="defender type name, or two names separated by '/' (e.g., WATER/GROUND)",
+    )
+    parser.add_argument(
+        "--non-team",
+        action="store_true",
+        help="the attacker is not a team member",
+    )
+    parser.add_argument(
+        "--exposed",
+        action="store_true",
+        help="the defender is exposed (no Ghost immunities)",
+    )
+    parser.add_argument(
+        "-s",
+        "--summary",
+        action="store_true",
+        help="print summary statistics instead of every row",
+    )
+    args = parser.parse_args()
+
+    lts = layouts.Layouts.from_headers()
+    types = lts.enums["enum type_id"]
+
+    def type_id(name: str) -> int:
+        key = name.upper()
+        key = key if key.startswith("TYPE_") else f"TYPE_{key}"
+        if key not in types:
+            sys.exit(f"Unknown type: '{name}'")
+        return types[key]
+
+    columns: Dict[str, List[int]] = {}
+    for column in INPUT_DEFAULTS:
+        values = getattr(args, column, None)
+        if values:
+            columns[column] = [v for vals in values for v in vals]
+    if args.move_type:
+        columns["move_type"] = [type_id(t) for t in args.move_type]
+    if args.defender_type:
+        pairs = sorted(
+            {
+                tuple(type_id(t) for t in (s.split("/") + ["NONE"])[:2])
+                for s in args.defender_type
+            }
+        )
+        # Expand an index into the defender type pairs, resolved below
+        columns["defender_type1"] = list(range(len(pairs)))
+    columns["is_team_member"] = [0 if args.non_team else 1]
+    columns["exposed"] = [1 if args.exposed else 0]
+    inputs = cross_product(columns)
+    if args.defender_type:
+        pair_idx = inputs["defender_type1"]
+        inputs["defender_type1"] = [pairs[i][0] for i in pair_idx]
+        inputs["defender_type2"] = [pairs[i][1] for i in pair_idx]
+
+    with layouts.BinaryData(args.data_dir, lts, args.version) as data:
+        tables = DamageTables.load(data)
+    outputs = calc_damage_batch(tables, inputs)
+
+    if args.summary:
+        damage = list(outputs["damage_calc"])
+        print(f"Inputs: {len(damage)}")
+        if damage:
+            print(
+                f"damage_calc: min {min(damage)}, max {max(damage)}, "
+                + f"mean {sum(damage) / len(damage):.2f}"
+            )
+    else:
+        in_cols = [k for k in INPUT_DEFAULTS if k in inputs]
+        print(",".join(in_cols + OUTPUT_COLUMNS))
+        if np is not None:
+            table = np.column_stack(
+                [np.asarray(inputs[k], dtype=np.int64) for k in in_cols]
+                + [np.asarray(outputs[k], dtype=np.int64) for k in OUTPUT_COLUMNS]
+            )
+            np.savetxt(sys.stdout, table, fmt="%d", delimiter=",")
+        else:
+            for i in range(len(outputs["damage_calc"])):
+                row = [inputs[k][i] for k in in_cols]
+                row += [outputs[k][i] for k in OUTPUT_COLUMNS]
+                print(",".join(str(v) for v in row))
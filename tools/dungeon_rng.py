@@ -0,0 +1,439 @@
+#!/usr/bin/env python3
+
+"""
+`dungeon_rng.py` is a command line utility (and importable module) that
+reproduces the dungeon PRNG from overlay 29 on the host, based on the behavior
+documented in the symbol tables (see DungeonRand16Bit, InitDungeonRng,
+GenerateDungeonRngSeed and the related symbols in overlay29.yml, and
+struct prng_state in the C headers).
+
+The dungeon PRNG consists of 6 linear congruential generators (LCGs) with a
+modulus of 2^32 and a shared multiplier: a primary LCG with an increment of 1,
+which yields the upper 16 bits of each value, and 5 secondary LCGs with an
+increment of 2531011, which yield the lower 16 bits of each value.
+
+`DungeonRng` mirrors the global PRNG state of the game, and is meant for
+stepping a single sequence. For stepping many independent seeds at once (e.g.,
+for seed hunting), the module-level functions operate on whole sequences of
+seeds, and are vectorized if numpy is installed. Sequences can also be jumped
+ahead by any number of steps in logarithmic time.
+
+`DungeonRng` can also be loaded from the live state in a RAM dump
+(DUNGEON_PRNG_STATE and DUNGEON_PRNG_STATE_SECONDARY_VALUES), with the struct
+fields read through the layouts emitted by `layouts.py`.
+
+Note that only the LCGs themselves are documented exactly. The symbol tables
+only document the output ranges of DungeonRandInt, DungeonRandRange and
+DungeonRandOutcome, not how they reduce the 16-bit values, so they are not
+reproduced here; tools that need them have to model the reduction themselves
+and say so. The bookkeeping of seq_num_primary is presumed, and has not been
+verified against the game: it is the number of primary values generated since
+InitDungeonRng.
+
+The command line interface has four modes:
+    - "sequence" prints the values generated by an LCG from a given seed.
+    - "find" recovers the possible primary LCG seeds (as passed to
+      InitDungeonRng) from a sequence of observed 16-bit primary outputs.
+    - "preseed" prints the seeds generated by GenerateDungeonRngSeed from a
+      given preseed.
+    - "state" prints the dungeon PRNG state in a RAM dump, followed by the
+      next values the active LCG will generate.
+
+Example usage:
+python3 dungeon_rng.py sequence 0x12345 -n 8
+python3 dungeon_rng.py sequence 0x12345 -n 8 --secondary 2
+python3 dungeon_rng.py find 0x8F2C 0x1B77 0xE203
+python3 dungeon_rng.py preseed 1 -n 4
+python3 dungeon_rng.py state ram.bin -l layouts.bin -n 8
+
+Library usage:
+rng = DungeonRng.from_dump(RamDump("ram.bin", Layouts.load("layouts.bin")))
+rng.rand16()
+"""
+
+import argparse
+import struct
+from typing import Any, List, Optional, Sequence, Tuple
+
+from layouts import Layouts, RamDump, load_data_symbols, symbol_address
+
+try:
+    import numpy as np
+except ImportError:
+    np = None
+
+# See DUNGEON_PRNG_LCG_MULTIPLIER
+LCG_MULTIPLIER = 1566083941
+LCG_INCREMENT_PRIMARY = 1
+# See DUNGEON_PRNG_LCG_INCREMENT_SECONDARY
+LCG_INCREMENT_SECONDARY = 2531011
+N_SECONDARY_LCGS = 5
+MASK32 = 0xFFFFFFFF
+
+STATE_TYPE = "struct prng_state"
+STATE_GLOBAL = "DUNGEON_PRNG_STATE"
+SECONDARY_VALUES_GLOBAL = "DUNGEON_PRNG_STATE_SECONDARY_VALUES"
+
+
+def lcg_step(x: int, increment: int) -> int:
+    """Compute the next 32-bit value of a dungeon LCG"""
+    return (LCG_MULTIPLIER * x + increment) & MASK32
+
+
+def lcg_jump(n: int, increment: int) -> Tuple[int, int]:
+    """Compute the affine map equivalent to n steps of a dungeon LCG.
+
+    Args:
+        n (int): number of steps (nonnegative)
+        increment (int): LCG increment
+
+    Returns:
+        Tuple[int, int]: (a, c) such that n steps map x to (a*x + c) % 2^32
+    """
+    if n < 0:
+        raise ValueError("number of steps must be nonnegative")
+    # Square-and-multiply over affine maps
+    a, c = 1, 0
+    step_a, step_c = LCG_MULTIPLIER, increment
+    while n:
+        if n & 1:
+            a, c = (step_a * a) & MASK32, (step_a * c + step_c) & MASK32
+        step_a, step_c = (step_a * step_a) & MASK32, (step_a * step_c + step_c) & MASK32
+        n >>= 1
+    return a, c
+
+
+def output16(x: int, secondary: bool) -> int:
+    """Get the 16-bit output corresponding to a 32-bit LCG value"""
+    return (x & 0xFFFF) if secondary else (x >> 16)
+
+
+class DungeonRng:
+    """The dungeon PRNG state.
+
+    This mirrors DUNGEON_PRNG_STATE (struct prng_state) and
+    DUNGEON_PRNG_STATE_SECONDARY_VALUES.
+    """
+
+    def __init__(self, seed: int = 1):
+        # All LCGs have a hard-coded default seed of 1
+        self.use_secondary = False
+        self.preseed = 1
+        self.idx_secondary = 0
+        self.init(seed)
+
+    @classmethod
+    def from_state(
+        cls, state: Any, secondary_values: Optional[Sequence[int]] = None
+    ) -> "DungeonRng":
+        """Creates a PRNG from a view of a struct prng_state.
+
+        Args:
+            state (Any): view of a struct prng_state (see Layouts.view), or
+                anything else with the same attributes
+            secondary_values (Optional[Sequence[int]], optional): the last
+                values of the secondary LCGs (DUNGEON_PRNG_STATE_SECONDARY_VALUES).
+                Defaults to None, in which case they are left at their
+                hard-coded default seed.
+
+        Returns:
+            DungeonRng: PRNG with the given state
+        """
+        rng = cls()
+        rng.use_secondary = bool(state.use_secondary)
+        rng.seq_num_primary = state.seq_num_primary & MASK32
+        rng.preseed = state.preseed & MASK32
+        rng.last_value_primary = state.last_value_primary & MASK32
+        rng.idx_secondary = state.idx_secondary
+        if secondary_values is not None:
+            if len(secondary_values) != N_SECONDARY_LCGS:
+                raise ValueError(f"expected {N_SECONDARY_LCGS} secondary values")
+            rng.secondary_values = [x & MASK32 for x in secondary_values]
+        return rng
+
+    @classmethod
+    def from_dump(cls, dump: RamDump) -> "DungeonRng":
+        """Reads the dungeon PRNG state from a RAM dump"""
+        symbols = load_data_symbols("overlay29")
+        addrs = {}
+        for name in (STATE_GLOBAL, SECONDARY_VALUES_GLOBAL):
+            addrs[name] = symbol_address(symbols[name], dump.version)
+            if addrs[name] is None:
+                raise KeyError(f"no {dump.version} address for '{name}'")
+        state = dump.view_at(STATE_TYPE, addrs[STATE_GLOBAL])
+        secondary_values = struct.unpack_from(
+            f"<{N_SECONDARY_LCGS}I",
+            dump.contents,
+            dump.mapped.relative(addrs[SECONDARY_VALUES_GLOBAL]),
+        )
+        return cls.from_state(state, secondary_values)
+
+    def init(self, seed: int):
+        """InitDungeonRng: seed the primary and secondary LCGs jointly"""
+        self.seq_num_primary = 0
+        self.last_value_primary = seed & MASK32
+        self.secondary_values = [seed & MASK32] * N_SECONDARY_LCGS
+
+    def set_primary(self):
+        """DungeonRngSetPrimary"""
+        self.use_secondary = False
+
+    def unset_secondary(self):
+        """DungeonRngUnsetSecondary"""
+        self.use_secondary = False
+        self.idx_secondary = 0
+
+    def set_secondary(self, idx: int):
+        """DungeonRngSetSecondary"""
+        if idx < 0 or idx >= N_SECONDARY_LCGS:
+            raise ValueError(f"invalid secondary LCG index {idx}")
+        self.use_secondary = True
+        self.idx_secondary = idx
+
+    def rand16(self) -> int:
+        """DungeonRand16Bit: advance the active LCG and return a 16-bit value"""
+        if self.use_secondary:
+            x = lcg_step(
+                self.secondary_values[self.idx_secondary], LCG_INCREMENT_SECONDARY
+            )
+            self.secondary_values[self.idx_secondary] = x
+            return output16(x, True)
+        self.last_value_primary = lcg_step(
+            self.last_value_primary, LCG_INCREMENT_PRIMARY
+        )
+        self.seq_num_primary = (self.seq_num_primary + 1) & MASK32
+        return output16(self.last_value_primary, False)
+
+    def advance(self, n: int):
+        """Advance the active LCG by n steps without generating the outputs"""
+        if self.use_secondary:
+            a, c = lcg_jump(n, LCG_INCREMENT_SECONDARY)
+            x = self.secondary_values[self.idx_secondary]
+            self.secondary_values[self.idx_secondary] = (a * x + c) & MASK32
+        else:
+            a, c = lcg_jump(n, LCG_INCREMENT_PRIMARY)
+            self.last_value_primary = (a * self.last_value_primary + c) & MASK32
+            self.seq_num_primary = (self.seq_num_primary + n) & MASK32
+
+    def set_preseed(self, preseed: int):
+        """SetDungeonRngPreseed"""
+        self.preseed = preseed & MASK32
+
+    def set_preseed_23bit(self, preseed23: int):
+        """SetDungeonRngPreseed23Bit"""
+        self.preseed = (preseed23 & 0xFFFFFF) | 1
+
+    def generate_seed(self) -> int:
+        """GenerateDungeonRngSeed: compute a seed and update the preseed"""
+        x1 = lcg_step(self.preseed, LCG_INCREMENT_PRIMARY)
+        x2 = lcg_step(x1, LCG_INCREMENT_PRIMARY)
+        self.preseed = x1
+        return (x1 & 0xFF0000) | (x2 >> 16) | 1
+
+
+def sequences(
+    seeds: Sequence[int], n: int, *, secondary: bool = False, skip: int = 0
+) -> Sequence[Sequence[int]]:
+    """Generate 16-bit outputs for many independent seeds at once.
+
+    Each seed is treated as if passed to InitDungeonRng, followed by n calls to
+    DungeonRand16Bit with the primary LCG (or one of the secondary LCGs, which
+    all behave the same way after initialization).
+
+    Args:
+        seeds (Sequence[int]): 32-bit seeds
+        n (int): number of outputs to generate per seed
+        secondary (bool, optional): use a secondary LCG rather than the primary
+            LCG. Defaults to False.
+        skip (int, optional): number of values to skip before generating
+            outputs. Defaults to 0.
+
+    Returns:
+        Sequence[Sequence[int]]: a len(seeds) x n matrix of outputs. This is a
+            uint16 array if numpy is available, or a list of lists otherwise.
+    """
+    increment = LCG_INCREMENT_SECONDARY if secondary else LCG_INCREMENT_PRIMARY
+    jump_a, jump_c = lcg_jump(skip, increment)
+    if np is not None:
+        # uint32 arithmetic wraps modulo 2^32, which is exactly what we want
+        x = np.asarray(seeds, dtype=np.uint64).astype(np.uint32)
+        x = x * np.uint32(jump_a) + np.uint32(jump_c)
+        out = np.empty((len(x), n), dtype=np.uint16)
+        a = np.uint32(LCG_MULTIPLIER)
+        c = np.uint32(increment)
+        for i in range(n):
+            x = x * a + c
+            out[:, i] = (x & np.uint32(0xFFFF)) if secondary else (x >> np.uint32(16))
+        return out
+
+    out_lists: List[List[int]] = []
+    for seed in seeds:
+        x = (jump_a * seed + jump_c) & MASK32
+        outputs = []
+        for _ in range(n):
+            x = lcg_step(x, increment)
+            outputs.append(output16(x, secondary))
+        out_lists.append(outputs)
+    return out_lists
+
+
+def find_seeds(outputs: Sequence[int], skip: int = 0) -> List[int]:
+    """Recover the possible seeds of the primary LCG from observed outputs.
+
+    The first output fixes the upper 16 bits of the corresponding 32-bit LCG
+    value, so there are only 2^16 candidates to check against the remaining
+    outputs. Each candidate is then stepped backwards to the seed. At least 3
+    outputs are usually needed for a unique result.
+
+    Args:
+        outputs (Sequence[int]): consecutive 16-bit outputs of DungeonRand16Bit
+            using the primary LCG
+        skip (int, optional): number of primary LCG values generated between
+            InitDungeonRng and the first observed output. Defaults to 0.
+
+    Returns:
+        List[int]: all seeds consistent with the outputs, in ascending order
+    """
+    if not outputs:
+        raise ValueError("at least one output is needed")
+    if any(o < 0 or o > 0xFFFF for o in outputs):
+        raise ValueError("outputs must be 16-bit values")
+
+    # Map from the first value back to the seed. The seed is the value
+    # (skip + 1) steps before the first value
+    jump_a, jump_c = lcg_jump(skip + 1, LCG_INCREMENT_PRIMARY)
+    # The multiplier is odd, so the map is invertible modulo 2^32
+    inv_a = pow(jump_a, -1, 1 << 32)
+
+    if np is not None:
+        x = np.arange(1 << 16, dtype=np.uint32) | np.uint32(outputs[0] << 16)
+        candidates = x
+        for o in outputs[1:]:
+            x = x * np.uint32(LCG_MULTIPLIER) + np.uint32(LCG_INCREMENT_PRIMARY)
+            mask = (x >> np.uint32(16)) == o
+            x = x[mask]
+            candidates = candidates[mask]
+        seeds = (candidates - np.uint32(jump_c)) * np.uint32(inv_a)
+        return sorted(int(s) for s in seeds)
+
+    seeds: List[int] = []
+    for low in range(1 << 16):
+        first = (outputs[0] << 16) | low
+        x = first
+        for o in outputs[1:]:
+            x = lcg_step(x, LCG_INCREMENT_PRIMARY)
+            if (x >> 16) != o:
+                break
+        else:
+            seeds.append(((first - jump_c) * inv_a) & MASK32)
+    return sorted(seeds)
+
+
+if __name__ == "__main__":
+
+    def int_literal(x: str) -> int:
+        return int(x, 0)
+
+    parser = argparse.ArgumentParser(
+        description="Reproduce the EoS dungeon PRNG on the host"
+    )
+    subparsers = parser.add_subparsers(dest="command", required=True)
+
+    sequence_parser = subparsers.add_parser(
+        "sequence", help="print the outputs of an LCG from a seed"
+    )
+    sequence_parser.add_argument("seed", type=int_literal, help="LCG seed")
+    sequence_parser.add_argument(
+        "-n", "--count", type=int, default=16, help="number of outputs"
+    )
+    sequence_parser.add_argument(
+        "-s",
+        "--secondary",
+        type=int,
+        choices=range(N_SECONDARY_LCGS),
+        help="use the given secondary LCG rather than the primary LCG",
+    )
+    sequence_parser.add_argument(
+        "--skip", type=int, default=0, help="number of values to skip first"
+    )
+
+    find_parser = subparsers.add_parser(
+        "find", help="recover primary LCG seeds from observed outputs"
+    )
+    find_parser.add_argument(
+        "output", nargs="+", type=int_literal, help="observed 16-bit output"
+    )
+    find_parser.add_argument(
+        "--skip",
+        type=int,
+        default=0,
+        help="number of primary values generated before the first observed output",
+    )
+
+    preseed_parser = subparsers.add_parser(
+        "preseed", help="print the seeds generated from a preseed"
+    )
+    preseed_parser.add_argument("preseed", type=int_literal, help="preseed")
+    preseed_parser.add_argument(
+        "-n", "--count", type=int, default=1, help="number of seeds"
+    )
+
+    state_parser = subparsers.add_parser(
+        "state", help="print the dungeon PRNG state in a RAM dump"
+    )
+    state_parser.add_argument("dump", help="RAM dump file")
+    state_parser.add_argument(
+        "-l",
+        "--layouts",
+        help="layouts file emitted by layouts.py (default: parse the headers)",
+    )
+    state_parser.add_argument(
+        "-v",
+        "--version",
+        choices=["NA", "EU", "JP"],
+        default="NA",
+        help="game version of the dump",
+    )
+    state_parser.add_argument(
+        "-n", "--count", type=int, default=0, help="number of next outputs to print"
+    )
+    args = parser.parse_args()
+
+    if args.command == "sequence":
+        rng = DungeonRng(args.seed)
+        if args.secondary is not None:
+            rng.set_secondary(args.secondary)
+        rng.advance(args.skip)
+        for _ in range(args.count):
+            print(f"0x{rng.rand16():04X}")
+    elif args.command == "find":
+        try:
+            seeds = find_seeds(args.output, args.skip)
+        except ValueError as e:
+            raise SystemExit(str(e))
+        print(f"{len(seeds)} seed(s) found")
+        for seed in seeds:
+            print(f"0x{seed:08X}")
+    elif args.command == "preseed":
+        rng = DungeonRng()
+        rng.set_preseed(args.preseed)
+        for _ in range(args.count):
+            print(f"0x{rng.generate_seed():08X}")
+    elif args.command == "state":
+        layouts = Layouts.load(args.layouts) if args.layouts else Layouts.from_headers()
+        with RamDump(args.dump, layouts, args.version) as dump:
+            try:
+                rng = DungeonRng.from_dump(dump)
+            except KeyError as e:
+                raise SystemExit(f"error: {e.args[0]}")
+        if rng.use_secondary:
+            print(f"active: secondary LCG {rng.idx_secondary}")
+        else:
+            print("active: primary LCG")
+        print(f"seq_num_primary: {rng.seq_num_primary}")
+        print(f"preseed: 0x{rng.preseed:08X}")
+        print(f"last_value_primary: 0x{rng.last_value_primary:08X}")
+        for i, x in enumerate(rng.secondary_values):
+            print(f"secondary_values[{i}]: 0x{x:08X}")
+        for _ in range(args.count):
+            print(f"0x{rng.rand16():04X}")
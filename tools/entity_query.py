@@ -0,0 +1,442 @@
+#!/usr/bin/env python3
+
+"""
+`entity_query.py` is a command line utility and Python module for querying
+the monsters in the dungeon entity table (`struct entity_table` within
+`struct dungeon`) over many frames at once, with numpy.
+
+Frames of DUNGEON_STRUCT can come from RAM dumps, a stream of raw frames
+(each sizeof(struct dungeon) bytes, as used by `snapshot_diff.py`), or a trace
+file written by `trace_store.py`. For every frame, the 20 monster slots
+(entity_table.header.monster_slot_ptrs) are resolved the way the game does:
+a slot holds a monster if its entity pointer is non-null and the entity type
+is ENTITY_MONSTER (EntityIsValid and IsMonster), and the monster data is
+found through entity::info. Pointers are converted to offsets within the
+struct using the address of DUNGEON_STRUCT from the symbol tables. The leader
+is found like GetLeader: the first of the first 4 slots holding a valid
+monster with is_team_leader set.
+
+Everything is computed as (frames x slots) numpy arrays, so a query over
+thousands of frames costs a handful of vectorized operations per field.
+
+Queries are Python-like expressions over the fields of `struct monster`
+(e.g., `hp`, `statuses.sleep`, `moves[0].pp`), or of `struct entity` with an
+`entity.` prefix (e.g., `entity.room_idx`), combined with comparisons,
+arithmetic, `and`, `or` and `not`. Enumerator names (e.g.,
+`MONSTER_BEHAVIOR_ITEM_MASTER`) can be used as constants. The following
+names are also defined:
+    frame: the frame number
+    slot: the monster slot index (0-19)
+    x, y: the position of the monster (entity.pos)
+    is_leader: whether the monster is the leader
+    leader_distance: the Chebyshev distance to the leader (a large number if
+        there's no leader)
+Wrapper structs with a single field (like `struct monster_id_16`) can be
+used directly, without naming the inner field.
+
+Example usage:
+python3 entity_query.py -w "is_not_team_member and leader_distance <= 3" ram.bin
+python3 entity_query.py --stream frames.bin -w "statuses.sleep != 0" -s "hp,x,y"
+python3 entity_query.py --trace capture.pmdt -r 0-999 -w "hp < 10" --count
+
+Library usage:
+    table = EntityTable(layouts, frames, base)  # frames: (n, size) uint8 array
+    mask = table.query("is_not_team_member and leader_distance <= 3")
+    hp = table.field("hp")[mask]
+"""
+
+import argparse
+import ast
+import sys
+from typing import Any, Dict, Iterator, List, Optional, Tuple
+
+import numpy as np
+
+from layouts import Layouts, Leaf, load_ram_addresses, RamDump
+
+DUNGEON_TYPE = "struct dungeon"
+DUNGEON_GLOBAL = "DUNGEON_STRUCT"
+MONSTER_TYPE = "struct monster"
+ENTITY_TYPE = "struct entity"
+N_MONSTER_SLOTS = 20
+# GetLeader only checks the first few slots
+N_LEADER_SLOTS = 4
+ENTITY_PREFIX = "entity."
+NO_LEADER_DISTANCE = np.iinfo(np.int64).max
+DEFAULT_BATCH_FRAMES = 4096
+
+_COMPARE_OPS = {
+    ast.Eq: np.equal,
+    ast.NotEq: np.not_equal,
+    ast.Lt: np.less,
+    ast.LtE: np.less_equal,
+    ast.Gt: np.greater,
+    ast.GtE: np.greater_equal,
+}
+_BIN_OPS = {
+    ast.Add: np.add,
+    ast.Sub: np.subtract,
+    ast.Mult: np.multiply,
+    ast.FloorDiv: np.floor_divide,
+    ast.Mod: np.mod,
+    ast.BitAnd: np.bitwise_and,
+    ast.BitOr: np.bitwise_or,
+    ast.BitXor: np.bitwise_xor,
+    ast.LShift: np.left_shift,
+    ast.RShift: np.right_shift,
+}
+
+
+class EntityTable:
+    """
+    The monster slots of the entity table over a batch of frames. Arrays
+    returned by this class have shape (frames, slots).
+    """
+
+    def __init__(
+        self, layouts: Layouts, frames: np.ndarray, base: int, first_frame: int = 0
+    ):
+        """
+        frames is a (n, sizeof(struct dungeon)) uint8 array of snapshots, and
+        base is the address of the struct in RAM, for resolving pointers.
+        """
+        self.layouts = layouts
+        self.frames = frames
+        self.base = base
+        self.first_frame = first_frame
+        self.frame_len = layouts.sizeof(DUNGEON_TYPE)
+        if frames.ndim != 2 or frames.shape[1] != self.frame_len:
+            raise ValueError(f"frames must have shape (n, {self.frame_len:#x})")
+        self._enumerators: Dict[str, int] = {}
+        for values in layouts.enums.values():
+            for name, value in values.items():
+                self._enumerators.setdefault(name, value)
+        self._cache: Dict[str, np.ndarray] = {}
+
+        slot_ptrs = layouts.leaf(
+            DUNGEON_TYPE, "entity_table.header.monster_slot_ptrs[0]"
+        )
+        # Offsets relative to the first slot pointer
+        ptr_offsets = slot_ptrs.size * np.arange(N_MONSTER_SLOTS)
+        n = frames.shape[0]
+        # Offsets of the entities within the struct
+        self.entity_offsets, valid = self._resolve(
+            self._gather(np.broadcast_to(ptr_offsets, (n, N_MONSTER_SLOTS)), slot_ptrs),
+            layouts.sizeof(ENTITY_TYPE),
+        )
+        entity_type = self._gather(
+            self.entity_offsets, layouts.leaf(ENTITY_TYPE, "type")
+        )
+        valid &= entity_type == layouts.enums["enum entity_type"]["ENTITY_MONSTER"]
+        # Offsets of the monster data (entity::info) within the struct
+        self.monster_offsets, info_valid = self._resolve(
+            self._gather(self.entity_offsets, layouts.leaf(ENTITY_TYPE, "info")),
+            layouts.sizeof(MONSTER_TYPE),
+        )
+        self.valid = valid & info_valid
+
+    def __len__(self) -> int:
+        return self.frames.shape[0]
+
+    def _resolve(
+        self, pointers: np.ndarray, size: int
+    ) -> Tuple[np.ndarray, np.ndarray]:
+        """Converts pointers into the struct to offsets, and whether they're valid"""
+        offsets = pointers - self.base
+        valid = (pointers != 0) & (offsets >= 0) & (offsets + size <= self.frame_len)
+        return np.where(valid, offsets, 0), valid
+
+    def _gather(self, offsets: np.ndarray, leaf: Leaf) -> np.ndarray:
+        """Reads a leaf at the given (frames x slots) struct offsets"""
+        rows = np.arange(len(self))[:, None, None]
+        cols = offsets[:, :, None] + leaf.offset + np.arange(leaf.size)
+        raw = self.frames[rows, cols].astype(np.int64)
+        value = np.zeros(offsets.shape, dtype=np.int64)
+        for i in range(leaf.size):
+            value |= raw[:, :, i] << (8 * i)
+        width = 8 * leaf.size
+        if leaf.bit_width is not None:
+            value = (value >> (leaf.bit_offset - 8 * leaf.offset)) & (
+                (1 << leaf.bit_width) - 1
+            )
+            width = leaf.bit_width
+        if not leaf.pointer and self.layouts.is_signed(leaf.type):
+            value = np.where(value >> (width - 1) & 1, value - (1 << width), value)
+        return value
+
+    def _leaf(self, type_name: str, path: str) -> Leaf:
+        try:
+            return self.layouts.leaf(type_name, path)
+        except ValueError:
+            # Unwrap single-field wrapper structs, like struct monster_id_16
+            _, t, pointer, dims = self.layouts.resolve_path(type_name, path)
+            agg = self.layouts.aggregates.get(self.layouts.resolve_typedef(t)[0])
+            if pointer or dims or agg is None or len(agg.fields) != 1:
+                raise
+            return self._leaf(type_name, f"{path}.{agg.fields[0].name}")
+
+    def field(self, path: str) -> np.ndarray:
+        """
+        The values of a field of struct monster (or struct entity, with an
+        "entity." prefix) for every slot. Values of invalid slots are
+        meaningless; see `valid`.
+        """
+        value = self._cache.get(path)
+        if value is None:
+            if path.startswith(ENTITY_PREFIX):
+                leaf = self._leaf(ENTITY_TYPE, path[len(ENTITY_PREFIX) :])
+                value = self._gather(self.entity_offsets, leaf)
+            else:
+                value = self._gather(
+                    self.monster_offsets, self._leaf(MONSTER_TYPE, path)
+                )
+            self._cache[path] = value
+        return value
+
+    @property
+    def leader_slot(self) -> np.ndarray:
+        """The slot of the leader in each frame, or -1 if there's none"""
+        is_leader = self.valid[:, :N_LEADER_SLOTS] & (
+            self.field("is_team_leader")[:, :N_LEADER_SLOTS] != 0
+        )
+        return np.where(is_leader.any(axis=1), is_leader.argmax(axis=1), -1)
+
+    def leader_distance(self) -> np.ndarray:
+        """The Chebyshev distance of each monster to the leader"""
+        leader = self.leader_slot
+        rows = np.arange(len(self))
+        slot = np.maximum(leader, 0)
+        x, y = self.field("entity.pos.x"), self.field("entity.pos.y")
+        dist = np.maximum(
+            np.abs(x - x[rows, slot][:, None]), np.abs(y - y[rows, slot][:, None])
+        )
+        return np.where((leader >= 0)[:, None], dist, NO_LEADER_DISTANCE)
+
+    def name(self, name: str) -> Any:
+        """Resolves a name in a query expression"""
+        n_frames = len(self)
+        if name == "frame":
+            return np.broadcast_to(
+                np.arange(self.first_frame, self.first_frame + n_frames)[:, None],
+                (n_frames, N_MONSTER_SLOTS),
+            )
+        if name == "slot":
+            return np.broadcast_to(
+                np.arange(N_MONSTER_SLOTS), (n_frames, N_MONSTER_SLOTS)
+            )
+        if name in ("x", "y"):
+            return self.field(f"entity.pos.{name}")
+        if name == "is_leader":
+            return np.arange(N_MONSTER_SLOTS) == self.leader_slot[:, None]
+        if name == "leader_distance":
+            return self.leader_distance()
+        if name in self._enumerators:
+            return self._enumerators[name]
+        return self.field(name)
+
+    def evaluate(self, expr: str) -> Any:
+        """Evaluates an expression for every slot"""
+        return self._eval(ast.parse(expr.strip(), mode="eval").body)
+
+    def _eval(self, node: ast.AST) -> Any:
+        if isinstance(node, ast.Constant) and isinstance(node.value, (int, bool)):
+            return node.value
+        if isinstance(node, (ast.Name, ast.Attribute, ast.Subscript)):
+            return self.name(ast.unparse(node))
+        if isinstance(node, ast.BoolOp):
+            values = [np.asarray(self._eval(v)) != 0 for v in node.values]
+            combine = np.logical_and if isinstance(node.op, ast.And) else np.logical_or
+            result = values[0]
+            for v in values[1:]:
+                result = combine(result, v)
+            return result
+        if isinstance(node, ast.UnaryOp):
+            operand = self._eval(node.operand)
+            if isinstance(node.op, ast.Not):
+                return np.asarray(operand) == 0
+            if isinstance(node.op, ast.USub):
+                return -operand
+            if isinstance(node.op, ast.Invert):
+                return ~operand
+        if isinstance(node, ast.BinOp) and type(node.op) in _BIN_OPS:
+            return _BIN_OPS[type(node.op)](
+                self._eval(node.left), self._eval(node.right)
+            )
+        if isinstance(node, ast.Compare):
+            left = self._eval(node.left)
+            result = None
+            for op, comparator in zip(node.ops, node.comparators):
+                if type(op) not in _COMPARE_OPS:
+                    break
+                right = self._eval(comparator)
+                cmp = _COMPARE_OPS[type(op)](left, right)
+                result = cmp if result is None else result & cmp
+                left = right
+            else:
+                return result
+        raise ValueError(f"unsupported expression: {ast.unparse(node)}")
+
+    def query(self, where: str) -> np.ndarray:
+        """A (frames x slots) mask of the valid monsters matching a predicate"""
+        result = np.broadcast_to(self.evaluate(where), self.valid.shape)
+        return self.valid & (result != 0)
+
+
+def dungeon_address(version: str) -> int:
+    return load_ram_addresses(version)[DUNGEON_GLOBAL]
+
+
+def stream_batches(
+    path: str, frame_len: int, start: int, stop: Optional[int], batch: int
+) -> Iterator[Tuple[int, np.ndarray]]:
+    """Memory-maps a file of raw frames, in batches of (first frame, frames)"""
+    frames = np.memmap(path, dtype=np.uint8, mode="r")
+    frames = frames[: len(frames) // frame_len * frame_len].reshape(-1, frame_len)
+    stop = len(frames) if stop is None else min(stop, len(frames))
+    for first in range(start, stop, batch):
+        yield first, frames[first : min(first + batch, stop)]
+
+
+def trace_batches(
+    path: str, layouts: Layouts, start: int, stop: Optional[int], batch: int
+) -> Iterator[Tuple[int, np.ndarray]]:
+    """
+    Reads frames from a trace file in batches. Only the parts of the struct
+    needed for queries (the monsters and the entity table) are decoded.
+    """
+    from trace_store import TraceReader
+
+    regions = []
+    for name in ("monsters", "entity_table"):
+        offset, t, pointer, dims = layouts.resolve_path(DUNGEON_TYPE, name)
+        length = layouts.sizeof(t, pointer)
+        for d in dims:
+            length *= d
+        regions.append((offset, length))
+    with TraceReader(path) as trace:
+        if trace.type_name != DUNGEON_TYPE:
+            raise ValueError(f"{path} holds {trace.type_name}, not {DUNGEON_TYPE}")
+        stop = len(trace) if stop is None else min(stop, len(trace))
+        for first in range(start, stop, batch):
+            last = min(first + batch, stop)
+            frames = np.zeros((last - first, trace.frame_len), dtype=np.uint8)
+            for offset, length in regions:
+                for i, data in enumerate(trace.read_bytes(offset, length, first, last)):
+                    frames[i, offset : offset + length] = np.frombuffer(
+                        data, dtype=np.uint8
+                    )
+            yield first, frames
+
+
+def dump_frames(paths: List[str], layouts: Layouts, version: str) -> np.ndarray:
+    """Reads DUNGEON_STRUCT out of a list of RAM dumps, one frame per dump"""
+    size = layouts.sizeof(DUNGEON_TYPE)
+    frames = np.zeros((len(paths), size), dtype=np.uint8)
+    for i, path in enumerate(paths):
+        with RamDump(path, layouts, version) as dump:
+            start = dump.mapped.relative(dump.address_of(DUNGEON_GLOBAL))
+            frames[i] = np.frombuffer(dump.contents[start : start + size], np.uint8)
+    return frames
+
+
+def split_select(select: str) -> List[str]:
+    """Splits a comma-separated list of expressions"""
+    node = ast.parse(select.strip(), mode="eval").body
+    elts = node.elts if isinstance(node, ast.Tuple) else [node]
+    return [ast.unparse(e) for e in elts]
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(
+        description="Query the monsters in the dungeon entity table over many frames"
+    )
+    parser.add_argument("dumps", nargs="*", help="RAM dumps, one per frame")
+    parser.add_argument(
+        "--stream",
+        help="file of raw concatenated frames of sizeof(struct dungeon) bytes",
+    )
+    parser.add_argument("--trace", help="trace file written by trace_store.py")
+    parser.add_argument(
+        "-w", "--where", default="True", help="predicate selecting monsters"
+    )
+    parser.add_argument(
+        "-s",
+        "--select",
+        default="hp,x,y",
+        help="comma-separated expressions to print for each selected monster",
+    )
+    parser.add_argument(
+        "-c",
+        "--count",
+        action="store_true",
+        help="only print the number of selected monsters in each frame",
+    )
+    parser.add_argument(
+        "-r", "--range", help="frame or inclusive frame range, e.g. 100-200"
+    )
+    parser.add_argument(
+        "-b",
+        "--batch",
+        type=int,
+        default=DEFAULT_BATCH_FRAMES,
+        help="number of frames to process at once",
+    )
+    parser.add_argument(
+        "--base",
+        type=lambda x: int(x, 0),
+        help="address of DUNGEON_STRUCT (default: from the symbol tables)",
+    )
+    parser.add_argument(
+        "-v",
+        "--version",
+        choices=["NA", "EU", "JP"],
+        default="NA",
+        help="game version of the frames",
+    )
+    parser.add_argument(
+        "-l",
+        "--layouts",
+        help="load previously emitted layout tables instead of the headers",
+    )
+    args = parser.parse_args()
+
+    if sum((bool(args.dumps), args.stream is not None, args.trace is not None)) != 1:
+        parser.error("give exactly one of RAM dumps, --stream or --trace")
+
+    start, stop = 0, None
+    if args.range:
+        lo, _, hi = args.range.partition("-")
+        start = int(lo, 0)
+        stop = int(hi, 0) + 1 if hi else start + 1
+
+    layouts = Layouts.load(args.layouts) if args.layouts else Layouts.from_headers()
+    base = args.base if args.base is not None else dungeon_address(args.version)
+    frame_len = layouts.sizeof(DUNGEON_TYPE)
+    if args.stream is not None:
+        batches = stream_batches(args.stream, frame_len, start, stop, args.batch)
+    elif args.trace is not None:
+        batches = trace_batches(args.trace, layouts, start, stop, args.batch)
+    else:
+        batches = iter([(0, dump_frames(args.dumps, layouts, args.version))])
+    columns = split_select(args.select)
+
+    total = 0
+    try:
+        for first, frames in batches:
+            table = EntityTable(layouts, frames, base, first)
+            mask = table.query(args.where)
+            if args.count:
+                for i, n in enumerate(mask.sum(axis=1)):
+                    print(f"{first + i}: {n}")
+                continue
+            values = [
+                np.broadcast_to(table.evaluate(c), mask.shape)[mask] for c in columns
+            ]
+            frame_idx, slot_idx = np.nonzero(mask)
+            if total == 0 and len(frame_idx):
+                print("\t".join(["frame", "slot"] + columns))
+            for row in zip(frame_idx + first, slot_idx, *values):
+                print("\t".join(str(int(v)) for v in row))
+            total += len(frame_idx)
+    except (ValueError, KeyError, SyntaxError) as e:
+        sys.exit(f"Error: {e}")
@@ -0,0 +1,374 @@
+#!/usr/bin/env python3
+
+"""
+`fixed_point.py` is a command line utility (and importable module) that
+reproduces the fixed-point arithmetic routines from arm9 on the host, based on
+the behavior documented in the symbol tables (see MultiplyByFixedPoint,
+MultiplyFixedPoint64, DivideFixedPoint64, AddFixedPoint64, ClampedLn and the
+related symbols in arm9.yml, and struct fx64 in the C headers).
+
+There are two fixed-point formats:
+    - 32-bit binary fixed-point numbers with 8 fraction bits, used as
+      multipliers by MultiplyByFixedPoint/UMultiplyByFixedPoint and by the
+      damage formula constants.
+    - 64-bit fixed-point numbers with 16 fraction bits (struct fx64). In this
+      module, these are represented by their raw two's complement value as a
+      Python int (i.e., (upper << 32) | lower, sign-extended), and can be
+      converted to and from the struct halves with `fx64_from_parts` and
+      `fx64_to_parts`.
+
+All results wrap around like their 32-bit and 64-bit machine equivalents. For
+evaluating the same operation over many inputs at once, the `*_batch`
+functions operate on whole sequences of values, and are vectorized if numpy
+is installed. `test_fixed_point.py` checks every batch function against its
+scalar counterpart, and the scalar functions against values that follow from
+the symbol table documentation.
+
+Note that some details aren't documented, and are inferred:
+    - Signed 64-bit multiplication and division are assumed to operate on
+      magnitudes (like their unsigned counterparts) and then apply the sign,
+      so fractional bits are truncated toward zero.
+    - 32-bit multiplication by an 8-bit fixed-point multiplier is assumed to
+      compute the full product and shift it right, rounding toward negative
+      infinity for signed values.
+    - ClampedLn is assumed to convert the 12-fraction-bit table value from
+      NATURAL_LOG_VALUE_TABLE to 16 fraction bits without rounding.
+These have not been verified against the ARM implementations.
+
+The command line interface evaluates a single operation on fx64 operands,
+which can be given as decimal numbers (e.g., 1.5) or raw hex values (e.g.,
+0x18000), and prints the result in both forms.
+
+Example usage:
+python3 fixed_point.py mul 1.5 -2.25
+python3 fixed_point.py div 1 3
+python3 fixed_point.py add 0x7FFFFFFFFFFFFFFF 0x1
+python3 fixed_point.py ln 100 --arm9 arm9.bin
+"""
+
+import argparse
+import math
+from typing import List, Optional, Sequence, Tuple
+
+try:
+    import numpy as np
+except ImportError:
+    np = None
+
+import layouts
+import offsets
+
+FX64_FRACTION_BITS = 16
+FX32_FRACTION_BITS = 8
+# Returned by division by zero: (INT64_MAX >> 16) + (UINT16_MAX * 2^-16)
+FX64_MAX = (1 << 63) - 1
+# NATURAL_LOG_VALUE_TABLE covers the domain [0, 2047], with 12 fraction bits
+LN_TABLE_SIZE = 2048
+LN_TABLE_FRACTION_BITS = 12
+MASK32 = 0xFFFFFFFF
+MASK64 = 0xFFFFFFFFFFFFFFFF
+
+
+def wrap32(x: int) -> int:
+    """Wrap to a signed 32-bit integer"""
+    x &= MASK32
+    return x - (1 << 32) if x >> 31 else x
+
+
+def wrap64(x: int) -> int:
+    """Wrap to a signed 64-bit integer"""
+    x &= MASK64
+    return x - (1 << 64) if x >> 63 else x
+
+
+def fx64_from_parts(upper: int, lower: int) -> int:
+    """Build an fx64 value from the upper and lower fields of struct fx64"""
+    return wrap64(((upper & MASK32) << 32) | (lower & MASK32))
+
+
+def fx64_to_parts(x: int) -> Tuple[int, int]:
+    """Split an fx64 value into the (upper, lower) fields of struct fx64"""
+    return wrap32(x >> 32), x & MASK32
+
+
+def fx64_from_float(x: float) -> int:
+    """Convert a real number to the nearest fx64 value (a host convenience)"""
+    return wrap64(round(x * (1 << FX64_FRACTION_BITS)))
+
+
+def fx64_to_float(x: int) -> float:
+    return x / (1 << FX64_FRACTION_BITS)
+
+
+def multiply_by_fixed_point(x: int, mult_fp: int) -> int:
+    """MultiplyByFixedPoint: signed int times an 8-fraction-bit multiplier"""
+    return wrap32((wrap32(x) * wrap32(mult_fp)) >> FX32_FRACTION_BITS)
+
+
+def umultiply_by_fixed_point(x: int, mult_fp: int) -> int:
+    """UMultiplyByFixedPoint: unsigned int times an 8-fraction-bit multiplier"""
+    return (((x & MASK32) * (mult_fp & MASK32)) >> FX32_FRACTION_BITS) & MASK32
+
+
+def int_to_fixed_point64(x: int) -> int:
+    """
+    IntToFixedPoint64: a signed int converted to fx64.
+
+    The symbol table notes that the sign extension in this function looks
+    bugged, but doesn't pin down what it produces for which inputs, so that
+    isn't emulated here; this computes the intended conversion.
+    """
+    return wrap64(wrap32(x) << FX64_FRACTION_BITS)
+
+
+def fixed_point64_to_int(x: int) -> int:
+    """FixedPoint64ToInt: the integer part, (upper << 16) + (lower >> 16)"""
+    return wrap32(x >> FX64_FRACTION_BITS)
+
+
+def fixed_point32_to_64(x_fp: int) -> int:
+    """FixedPoint32To64: convert 8 fraction bits to 16, sign-extending"""
+    return wrap32(x_fp) << (FX64_FRACTION_BITS - FX32_FRACTION_BITS)
+
+
+def negate_fixed_point64(x: int) -> int:
+    return wrap64(-x)
+
+
+def fixed_point64_is_zero(x: int) -> bool:
+    return wrap64(x) == 0
+
+
+def fixed_point64_is_negative(x: int) -> bool:
+    return wrap64(x) < 0
+
+
+def fixed_point64_cmp_lt(x: int, y: int) -> bool:
+    return wrap64(x) < wrap64(y)
+
+
+def ufixed_point64_cmp_lt(x: int, y: int) -> bool:
+    return (x & MASK64) < (y & MASK64)
+
+
+def umultiply_fixed_point64(x: int, y: int) -> int:
+    """UMultiplyFixedPoint64: unsigned fx64 product"""
+    return wrap64(((x & MASK64) * (y & MASK64)) >> FX64_FRACTION_BITS)
+
+
+def multiply_fixed_point64(x: int, y: int) -> int:
+    """MultiplyFixedPoint64: signed fx64 product"""
+    x, y = wrap64(x), wrap64(y)
+    prod = umultiply_fixed_point64(abs(x), abs(y))
+    return wrap64(-prod) if (x < 0) != (y < 0) else prod
+
+
+def udivide_fixed_point64(dividend: int, divisor: int) -> int:
+    """UDivideFixedPoint64: unsigned fx64 quotient (FX64_MAX if divisor is 0)"""
+    dividend &= MASK64
+    divisor &= MASK64
+    if divisor == 0:
+        return FX64_MAX
+    return wrap64((dividend << FX64_FRACTION_BITS) // divisor)
+
+
+def divide_fixed_point64(dividend: int, divisor: int) -> int:
+    """DivideFixedPoint64: signed fx64 quotient (FX64_MAX if divisor is 0)"""
+    dividend, divisor = wrap64(dividend), wrap64(divisor)
+    if divisor == 0:
+        return FX64_MAX
+    quotient = udivide_fixed_point64(abs(dividend), abs(divisor))
+    return wrap64(-quotient) if (dividend < 0) != (divisor < 0) else quotient
+
+
+def add_fixed_point64(x: int, y: int) -> int:
+    """AddFixedPoint64: fx64 sum"""
+    return wrap64(x + y)
+
+
+def approximate_ln_table() -> List[int]:
+    """
+    Compute an approximation of NATURAL_LOG_VALUE_TABLE, rounding ln(x) to 12
+    fraction bits. Entries may differ from the ROM by rounding; prefer
+    `load_ln_table` for exact results.
+    """
+    return [0] + [
+        round(math.log(x) * (1 << LN_TABLE_FRACTION_BITS))
+        for x in range(1, LN_TABLE_SIZE)
+    ]
+
+
+def load_ln_table(arm9_path: str, version: str = "NA") -> List[int]:
+    """Read NATURAL_LOG_VALUE_TABLE from an arm9 binary"""
+    sym = layouts.load_data_symbols("arm9")["NATURAL_LOG_VALUE_TABLE"]
+    addr = layouts.symbol_address(sym, version)
+    if addr is None:
+        raise ValueError(f"NATURAL_LOG_VALUE_TABLE is unknown in version {version}")
+    offset = addr - offsets.BINARIES[version]["arm9"].address
+    with open(arm9_path, "rb") as f:
+        f.seek(offset)
+        raw = f.read(2 * LN_TABLE_SIZE)
+    if len(raw) != 2 * LN_TABLE_SIZE:
+        raise ValueError(f"{arm9_path} is too short to contain the ln table")
+    return [
+        int.from_bytes(raw[i : i + 2], "little", signed=True)
+        for i in range(0, len(raw), 2)
+    ]
+
+
+def clamped_ln(x: int, table: Sequence[int]) -> int:
+    """ClampedLn: ln(x) as fx64, with x clamped to [1, 2047]"""
+    x = min(max(wrap32(x), 1), LN_TABLE_SIZE - 1)
+    return table[x] << (FX64_FRACTION_BITS - LN_TABLE_FRACTION_BITS)
+
+
+def _u64_mul_shift(a, b):
+    """((a * b) >> 16) mod 2^64 for uint64 arrays, via 32-bit limbs"""
+    lo32 = np.uint64(MASK32)
+    s32 = np.uint64(32)
+    ah, al = a >> s32, a & lo32
+    bh, bl = b >> s32, b & lo32
+    return (
+        ((ah * bh) << np.uint64(48))
+        + ((ah * bl + al * bh) << np.uint64(16))
+        + ((al * bl) >> np.uint64(16))
+    )
+
+
+def multiply_fixed_point64_batch(xs: Sequence[int], ys: Sequence[int]):
+    """MultiplyFixedPoint64 over pairs of fx64 values"""
+    if np is None:
+        return [multiply_fixed_point64(x, y) for x, y in zip(xs, ys)]
+    x = np.asarray(xs, dtype=np.int64)
+    y = np.asarray(ys, dtype=np.int64)
+    # abs() wraps INT64_MIN to itself, which is also its unsigned magnitude
+    prod = _u64_mul_shift(np.abs(x).view(np.uint64), np.abs(y).view(np.uint64))
+    prod = prod.view(np.int64)
+    return np.where((x < 0) != (y < 0), -prod, prod)
+
+
+def umultiply_fixed_point64_batch(xs: Sequence[int], ys: Sequence[int]):
+    """UMultiplyFixedPoint64 over pairs of fx64 values"""
+    if np is None:
+        return [umultiply_fixed_point64(x, y) for x, y in zip(xs, ys)]
+    x = np.asarray(xs, dtype=np.int64).view(np.uint64)
+    y = np.asarray(ys, dtype=np.int64).view(np.uint64)
+    return _u64_mul_shift(x, y).view(np.int64)
+
+
+def divide_fixed_point64_batch(dividends: Sequence[int], divisors: Sequence[int]):
+    """DivideFixedPoint64 over pairs of fx64 values"""
+    if np is None:
+        return [divide_fixed_point64(x, y) for x, y in zip(dividends, divisors)]
+    x = np.asarray(dividends, dtype=np.int64)
+    y = np.asarray(divisors, dtype=np.int64)
+    ux = np.abs(x).view(np.uint64)
+    uy = np.abs(y).view(np.uint64)
+    out = np.full(x.shape, FX64_MAX, dtype=np.int64)
+    nonzero = uy != 0
+    # Shifting the dividend only fits in 64 bits for magnitudes below 2^48
+    fast = nonzero & (ux < np.uint64(1 << 48))
+    q = (ux[fast] << np.uint64(FX64_FRACTION_BITS)) // uy[fast]
+    q = q.view(np.int64)
+    out[fast] = np.where((x[fast] < 0) != (y[fast] < 0), -q, q)
+    for i in np.flatnonzero(nonzero & ~fast):
+        out[i] = divide_fixed_point64(int(x[i]), int(y[i]))
+    return out
+
+
+def add_fixed_point64_batch(xs: Sequence[int], ys: Sequence[int]):
+    """AddFixedPoint64 over pairs of fx64 values"""
+    if np is None:
+        return [add_fixed_point64(x, y) for x, y in zip(xs, ys)]
+    return np.asarray(xs, dtype=np.int64) + np.asarray(ys, dtype=np.int64)
+
+
+def multiply_by_fixed_point_batch(xs: Sequence[int], mult_fp: int):
+    """MultiplyByFixedPoint over many values with the same multiplier"""
+    if np is None:
+        return [multiply_by_fixed_point(x, mult_fp) for x in xs]
+    # Wrap the inputs through int64 like the scalar version does, since numpy
+    # refuses to convert out-of-range Python ints to int32 directly
+    x = np.asarray(xs, dtype=np.int64).astype(np.int32).astype(np.int64)
+    prod = x * np.int64(wrap32(mult_fp))
+    return (prod >> np.int64(FX32_FRACTION_BITS)).astype(np.int32)
+
+
+def umultiply_by_fixed_point_batch(xs: Sequence[int], mult_fp: int):
+    """UMultiplyByFixedPoint over many values with the same multiplier"""
+    if np is None:
+        return [umultiply_by_fixed_point(x, mult_fp) for x in xs]
+    x = np.asarray(xs, dtype=np.int64).astype(np.uint32).astype(np.uint64)
+    prod = x * np.uint64(mult_fp & MASK32)
+    return (prod >> np.uint64(FX32_FRACTION_BITS)).astype(np.uint32)
+
+
+def clamped_ln_batch(xs: Sequence[int], table: Sequence[int]):
+    """ClampedLn over many values"""
+    if np is None:
+        return [clamped_ln(x, table) for x in xs]
+    x = np.asarray(xs, dtype=np.int64).astype(np.int32)
+    idx = np.clip(x, 1, LN_TABLE_SIZE - 1)
+    return np.asarray(table, dtype=np.int64)[idx] << np.int64(
+        FX64_FRACTION_BITS - LN_TABLE_FRACTION_BITS
+    )
+
+
+if __name__ == "__main__":
+
+    def fx64_literal(s: str) -> int:
+        if s.lower().lstrip("-").startswith("0x"):
+            return wrap64(int(s, 16))
+        return fx64_from_float(float(s))
+
+    parser = argparse.ArgumentParser(
+        description="Evaluate the game's 64-bit fixed-point arithmetic routines"
+    )
+    subparsers = parser.add_subparsers(dest="op", required=True)
+    for op, help_text in (
+        ("mul", "MultiplyFixedPoint64"),
+        ("umul", "UMultiplyFixedPoint64"),
+        ("div", "DivideFixedPoint64"),
+        ("udiv", "UDivideFixedPoint64"),
+        ("add", "AddFixedPoint64"),
+    ):
+        p = subparsers.add_parser(op, help=help_text)
+        p.add_argument("x", type=fx64_literal, help="first operand")
+        p.add_argument("y", type=fx64_literal, help="second operand")
+    p = subparsers.add_parser("ln", help="ClampedLn")
+    p.add_argument("x", type=lambda s: int(s, 0), help="integer argument")
+    p.add_argument(
+        "--arm9",
+        help="arm9 binary to read NATURAL_LOG_VALUE_TABLE from (default: approximate)",
+    )
+    p.add_argument(
+        "-v",
+        "--version",
+        choices=["NA", "EU", "JP"],
+        default="NA",
+        help="game version of the arm9 binary",
+    )
+    args = parser.parse_args()
+
+    result: Optional[int] = None
+    if args.op == "ln":
+        table = (
+            load_ln_table(args.arm9, args.version)
+            if args.arm9
+            else approximate_ln_table()
+        )
+        result = clamped_ln(args.x, table)
+    else:
+        fn = {
+            "mul": multiply_fixed_point64,
+            "umul": umultiply_fixed_point64,
+            "div": divide_fixed_point64,
+            "udiv": udivide_fixed_point64,
+            "add": add_fixed_point64,
+        }[args.op]
+        result = fn(args.x, args.y)
+    upper, lower = fx64_to_parts(result)
+    print(
+        f"{fx64_to_float(result)} (raw 0x{result & MASK64:016X}, "
+        + f"upper 0x{upper & MASK32:08X}, lower 0x{lower:08X})"
+    )
@@ -0,0 +1,334 @@
+#!/usr/bin/env python3
+
+"""
+`floor_stats.py` is a command line utility for computing layout statistics
+over large numbers of generated dungeon floors, and for finding the floors
+that match a set of predicates (e.g., a Monster House with the stairs at
+least 20 steps away from the team spawn).
+
+The input is a set of RAM dumps (0x2000000-0x2400000) captured right after
+floor generation, for example one dump per seed from a scripted emulator run.
+Each dump is memory-mapped and read through the header layouts resolved by
+`layouts.py`, using `DUNGEON_STRUCT` (the generated tiles, stairs and team
+spawn positions, and floor properties) and `FLOOR_GENERATION_STATUS` (Monster
+House, Kecleon Shop, maze, etc.). Dumps are processed in parallel across all
+CPU cores.
+
+Note that the floor generation algorithm itself is not reimplemented here,
+since `GenerateFloor` and friends are not yet documented in enough detail to
+be reproduced exactly. Capturing floors from the game guarantees that the
+statistics reflect the real generator.
+
+The stairs distance is the number of steps on the shortest path from the team
+spawn to the stairs, moving in 8 directions over open (TERRAIN_NORMAL) tiles,
+without cutting wall corners diagonally. This approximates the movement of a
+monster with normal mobility; it is -1 if the stairs are unreachable.
+
+Example usage:
+python3 floor_stats.py dumps/*.bin
+python3 floor_stats.py -r dumps --summary
+python3 floor_stats.py -r dumps --monster-house --min-stairs-distance 20
+python3 floor_stats.py -v EU -j 4 --max-rooms 2 --no-kecleon-shop dumps/*.bin
+"""
+
+import argparse
+from collections import Counter, deque
+from multiprocessing import Pool
+import os
+import sys
+from typing import Iterable, List, NamedTuple, Optional
+
+import layouts
+
+FLOOR_WIDTH = 56
+FLOOR_HEIGHT = 32
+
+# Step offsets for the 8 directions of movement
+DIRECTIONS = [(dx, dy) for dy in (-1, 0, 1) for dx in (-1, 0, 1) if dx or dy]
+
+
+class FloorStats(NamedTuple):
+    path: str
+    floor_number: int
+    layout: str
+    n_rooms: int
+    has_monster_house: bool
+    has_kecleon_shop: bool
+    has_maze: bool
+    is_invalid: bool
+    n_open_tiles: int
+    team_spawn: tuple
+    stairs: tuple
+    stairs_distance: int
+
+    def format(self) -> str:
+        flags = [
+            name
+            for name, flag in (
+                ("monster_house", self.has_monster_house),
+                ("kecleon_shop", self.has_kecleon_shop),
+                ("maze", self.has_maze),
+                ("invalid", self.is_invalid),
+            )
+            if flag
+        ]
+        return (
+            f"{self.path}: floor {self.floor_number}, {self.layout}, "
+            + f"{self.n_rooms} rooms, {self.n_open_tiles} open tiles, "
+            + f"spawn {self.team_spawn}, stairs {self.stairs}, "
+            + f"stairs distance {self.stairs_distance}"
+            + (f" [{', '.join(flags)}]" if flags else "")
+        )
+
+
+class Predicates(NamedTuple):
+    monster_house: Optional[bool] = None
+    kecleon_shop: Optional[bool] = None
+    maze: Optional[bool] = None
+    min_rooms: Optional[int] = None
+    max_rooms: Optional[int] = None
+    min_stairs_distance: Optional[int] = None
+    max_stairs_distance: Optional[int] = None
+
+    def match(self, stats: FloorStats) -> bool:
+        if stats.is_invalid:
+            return False
+        for flag, value in (
+            (self.monster_house, stats.has_monster_house),
+            (self.kecleon_shop, stats.has_kecleon_shop),
+            (self.maze, stats.has_maze),
+        ):
+            if flag is not None and flag != value:
+                return False
+        if self.min_rooms is not None and stats.n_rooms < self.min_rooms:
+            return False
+        if self.max_rooms is not None and stats.n_rooms > self.max_rooms:
+            return False
+        if self.min_stairs_distance is not None and not (
+            0 <= self.min_stairs_distance <= stats.stairs_distance
+        ):
+            return False
+        if self.max_stairs_distance is not None and not (
+            0 <= stats.stairs_distance <= self.max_stairs_distance
+        ):
+            return False
+        return True
+
+
+def read_terrain(
+    lts: layouts.Layouts, contents: layouts.Buffer, tiles: layouts.ArrayView
+) -> List[bytes]:
+    """
+    Reads the terrain type of every tile into a [y][x] grid, directly from the
+    packed tile array rather than through per-tile views.
+    """
+    terrain = lts.aggregates["struct tile"].fields_by_name["terrain_type"]
+    byte, shift = divmod(terrain.bit_offset, 8)
+    mask = (1 << terrain.bit_width) - 1
+    tile_size = tiles.stride // FLOOR_WIDTH
+    grid = []
+    for y in range(FLOOR_HEIGHT):
+        start = tiles.offset + y * tiles.stride + byte
+        row = contents[start : start + tiles.stride : tile_size]
+        grid.append(bytes((b >> shift) & mask for b in row))
+    return grid
+
+
+def stairs_distance(
+    grid: List[bytes], open_terrain: int, start: tuple, goal: tuple
+) -> int:
+    """BFS distance in steps between two tiles, or -1 if unreachable"""
+
+    def is_open(x: int, y: int) -> bool:
+        return (
+            0 <= x < FLOOR_WIDTH
+            and 0 <= y < FLOOR_HEIGHT
+            and grid[y][x] == open_terrain
+        )
+
+    if not is_open(*start) or not is_open(*goal):
+        return -1
+    dist = {start: 0}
+    queue = deque([start])
+    while queue:
+        x, y = queue.popleft()
+        if (x, y) == goal:
+            return dist[(x, y)]
+        for dx, dy in DIRECTIONS:
+            nx, ny = x + dx, y + dy
+            if (nx, ny) in dist or not is_open(nx, ny):
+                continue
+            if dx and dy and (not is_open(x + dx, y) or not is_open(x, y + dy)):
+                # Can't cut corners diagonally
+                continue
+            dist[(nx, ny)] = dist[(x, y)] + 1
+            queue.append((nx, ny))
+    return -1
+
+
+# Per-worker state, set up by init_worker()
+_layouts: Optional[layouts.Layouts] = None
+_version: str = "NA"
+
+
+def init_worker(lts: layouts.Layouts, version: str):
+    global _layouts, _version
+    _layouts = lts
+    _version = version
+
+
+def analyze_dump(path: str) -> FloorStats:
+    """Computes the layout statistics of the floor in a RAM dump"""
+    open_terrain = _layouts.enums["enum terrain_type"]["TERRAIN_NORMAL"]
+    with layouts.RamDump(path, _layouts, _version) as dump:
+        dungeon = dump.global_view("DUNGEON_STRUCT")
+        status = dump.global_view("FLOOR_GENERATION_STATUS")
+        gen_info = dungeon.gen_info
+        props = dungeon.floor_properties
+        grid = read_terrain(_layouts, dump.contents, gen_info.tiles)
+        team_spawn = (gen_info.team_spawn_pos.x, gen_info.team_spawn_pos.y)
+        stairs = (gen_info.stairs_pos.x, gen_info.stairs_pos.y)
+        layout = props.layout.val
+        return FloorStats(
+            path=path,
+            floor_number=props.floor_number,
+            layout=_layouts.enum_name("enum floor_layout", layout) or str(layout),
+            n_rooms=dungeon.n_rooms,
+            has_monster_house=bool(status.has_monster_house),
+            has_kecleon_shop=bool(status.has_kecleon_shop),
+            has_maze=bool(status.has_maze),
+            is_invalid=bool(status.is_invalid),
+            n_open_tiles=sum(row.count(open_terrain) for row in grid),
+            team_spawn=team_spawn,
+            stairs=stairs,
+            stairs_distance=stairs_distance(grid, open_terrain, team_spawn, stairs),
+        )
+
+
+def expand_paths(paths: Iterable[str], recursive: bool) -> List[str]:
+    expanded = []
+    for path in paths:
+        if recursive and os.path.isdir(path):
+            for root, _, files in os.walk(path):
+                expanded += sorted(os.path.join(root, f) for f in files)
+        else:
+            expanded.append(path)
+    return expanded
+
+
+def print_summary(all_stats: List[FloorStats], n_matched: int):
+    valid = [s for s in all_stats if not s.is_invalid]
+    print(f"Floors: {len(all_stats)} ({len(all_stats) - len(valid)} invalid)")
+    print(f"Matched: {n_matched}")
+    if not valid:
+        return
+
+    def pct(n: int) -> str:
+        return f"{n} ({100 * n / len(valid):.2f}%)"
+
+    print(f"Monster House: {pct(sum(s.has_monster_house for s in valid))}")
+    print(f"Kecleon Shop: {pct(sum(s.has_kecleon_shop for s in valid))}")
+    print(f"Maze: {pct(sum(s.has_maze for s in valid))}")
+    reachable = [s.stairs_distance for s in valid if s.stairs_distance >= 0]
+    print(f"Stairs unreachable: {pct(len(valid) - len(reachable))}")
+    if reachable:
+        reachable.sort()
+        print(
+            "Stairs distance: "
+            + f"min {reachable[0]}, median {reachable[len(reachable) // 2]}, "
+            + f"mean {sum(reachable) / len(reachable):.2f}, max {reachable[-1]}"
+        )
+    for title, counts in (
+        ("Layouts", Counter(s.layout for s in valid)),
+        ("Rooms", Counter(s.n_rooms for s in valid)),
+    ):
+        print(f"{title}:")
+        for key, n in sorted(counts.items()):
+            print(f"  {key}: {pct(n)}")
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(
+        description="Compute layout statistics over RAM dumps of generated floors"
+    )
+    parser.add_argument("dumps", nargs="+", help="RAM dump files")
+    parser.add_argument(
+        "-r",
+        "--recursive",
+        action="store_true",
+        help="recursively process all files in directory arguments",
+    )
+    parser.add_argument(
+        "-v",
+        "--version",
+        choices=["NA", "EU", "JP"],
+        default="NA",
+        help="game version of the RAM dumps",
+    )
+    parser.add_argument(
+        "-j",
+        "--jobs",
+        type=int,
+        default=os.cpu_count(),
+        help="number of worker processes (default: number of CPUs)",
+    )
+    parser.add_argument(
+        "-s",
+        "--summary",
+        action="store_true",
+        help="print aggregate statistics instead of the matching floors",
+    )
+    for name in ("monster-house", "kecleon-shop", "maze"):
+        group = parser.add_mutually_exclusive_group()
+        dest = name.replace("-", "_")
+        group.add_argument(
+            f"--{name}",
+            dest=dest,
+            action="store_const",
+            const=True,
+            help=f"only match floors with a {name.replace('-', ' ')}",
+        )
+        group.add_argument(
+            f"--no-{name}",
+            dest=dest,
+            action="store_const",
+            const=False,
+            help=f"only match floors without a {name.replace('-', ' ')}",
+        )
+    parser.add_argument("--min-rooms", type=int, help="minimum number of rooms")
+    parser.add_argument("--max-rooms", type=int, help="maximum number of rooms")
+    parser.add_argument(
+        "--min-stairs-distance", type=int, help="minimum stairs distance in steps"
+    )
+    parser.add_argument(
+        "--max-stairs-distance", type=int, help="maximum stairs distance in steps"
+    )
+    args = parser.parse_args()
+
+    predicates = Predicates(
+        monster_house=args.monster_house,
+        kecleon_shop=args.kecleon_shop,
+        maze=args.maze,
+        min_rooms=args.min_rooms,
+        max_rooms=args.max_rooms,
+        min_stairs_distance=args.min_stairs_distance,
+        max_stairs_distance=args.max_stairs_distance,
+    )
+    paths = expand_paths(args.dumps, args.recursive)
+    lts = layouts.Layouts.from_headers()
+
+    all_stats = []
+    n_matched = 0
+    with Pool(
+        max(1, args.jobs), initializer=init_worker, initargs=(lts, args.version)
+    ) as pool:
+        for stats in pool.imap(analyze_dump, paths, chunksize=16):
+            all_stats.append(stats)
+            if predicates.match(stats):
+                n_matched += 1
+                if not args.summary:
+                    print(stats.format())
+    if args.summary:
+        print_summary(all_stats, n_matched)
+    elif n_matched == 0:
+        print("No matching floors found", file=sys.stderr)
@@ -6,48 +6,117 @@ import json
 import ghidra.program.model.symbol.SourceType as SourceType
 
 COMMENT_TAG = "=== imported description ===\n"
+# Set to True to print every change made to the program
+VERBOSE = False
+
 functionManager = currentProgram.getFunctionManager()
+symbolTable = currentProgram.getSymbolTable()
+
+
+def log(msg):
+    if VERBOSE:
+        print(msg)
+
+
+def mergeComment(comment, description):
+    if not comment:
+        return COMMENT_TAG + description
+    commentParts = comment.split(COMMENT_TAG)
+    if len(commentParts) == 1:
+        commentParts[0] += "\n\n"
+        commentParts.append("")
+    commentParts[1] = description
+    return COMMENT_TAG.join(commentParts)
+
 
 jythonFile = askFile("Select symbol JSON file", "Import")
 with open(jythonFile.absolutePath, "r") as f:
     symbols = json.load(f)
 
 for s in symbols:
-    stype = s["type"]
+    if type(s["address"]) != int:
+        s["address"] = int(s["address"], 0)
+# Process symbols in address order so that program lookups are sequential
+symbols.sort(key=lambda s: s["address"])
+
+# First pass: diff against the existing program symbols, and only keep the
+# changes that actually need to be made
+newFunctions = []  # (address, name)
+renamedFunctions = []  # (function, old name, new name)
+newLabels = []  # (address, name)
+newComments = []  # (address, comment)
+unchanged = 0
+monitor.initialize(len(symbols))
+monitor.setMessage("Comparing symbols")
+for s in symbols:
+    monitor.checkCanceled()
+    monitor.incrementProgress(1)
     name = s["name"]
-    address = s["address"]
-    if type(address) != int:
-        address = int(address, 0)
-    address = toAddr(address)
+    address = toAddr(s["address"])
     description = s.get("description")
+    changed = False
 
-    if stype == "function":
+    if s["type"] == "function":
         func = functionManager.getFunctionAt(address)
-
         if func is None:
-            func = createFunction(address, name)
-            print("Created function {} at address {}".format(name, address))
-        else:
-            old_name = func.getName()
-            func.setName(name, SourceType.USER_DEFINED)
-            print(
-                "Renamed function {} to {} at address {}".format(
-                    old_name, name, address
-                )
-            )
-    else:
-        print("Created label {} at address {}".format(name, address))
-        createLabel(address, name, False)
+            newFunctions.append((address, name))
+            changed = True
+        elif func.getName() != name:
+            renamedFunctions.append((func, func.getName(), name))
+            changed = True
+    elif not any(sym.getName() == name for sym in symbolTable.getSymbols(address)):
+        newLabels.append((address, name))
+        changed = True
 
     if description:
-        comment = getPlateComment(address)
-        if not comment:
-            comment = COMMENT_TAG + description
-        else:
-            commentParts = comment.split(COMMENT_TAG)
-            if len(commentParts) == 1:
-                commentParts[0] += "\n\n"
-                commentParts.append("")
-            commentParts[1] = description
-            comment = COMMENT_TAG.join(commentParts)
+        oldComment = getPlateComment(address)
+        comment = mergeComment(oldComment, description)
+        if comment != oldComment:
+            newComments.append((address, comment))
+            changed = True
+
+    if not changed:
+        unchanged += 1
+
+# Second pass: apply all the changes in a single transaction
+monitor.initialize(
+    len(newFunctions) + len(renamedFunctions) + len(newLabels) + len(newComments)
+)
+monitor.setMessage("Applying symbol changes")
+transaction = currentProgram.startTransaction("Import symbols from JSON")
+success = False
+try:
+    for address, name in newFunctions:
+        monitor.checkCanceled()
+        monitor.incrementProgress(1)
+        createFunction(address, name)
+        log("Created function {} at address {}".format(name, address))
+    for func, oldName, name in renamedFunctions:
+        monitor.checkCanceled()
+        monitor.incrementProgress(1)
+        func.setName(name, SourceType.USER_DEFINED)
+        log(
+            "Renamed function {} to {} at address {}".format(
+                oldName, name, func.getEntryPoint()
+            )
+        )
+    for address, name in newLabels:
+        monitor.checkCanceled()
+        monitor.incrementProgress(1)
+        createLabel(address, name, False)
+        log("Created label {} at address {}".format(name, address))
+    for address, comment in newComments:
+        monitor.checkCanceled()
+        monitor.incrementProgress(1)
         setPlateComment(address, comment)
+        log("Updated description at address {}".format(address))
+    success = True
+finally:
+    currentProgram.endTransaction(transaction, success)
+
+print("Imported {} symbols from {}".format(len(symbols), jythonFile.getName()))
+print("  {} function(s) created".format(len(newFunctions)))
+print("  {} function(s) renamed".format(len(renamedFunctions)))
+print("  {} label(s) created".format(len(newLabels)))
+print("  {} description(s) updated".format(len(newComments)))
+print("  {} symbol(s) unchanged".format(unchanged))
@@ -0,0 +1,621 @@
+#!/usr/bin/env python3
+
+"""
+`item_spawns.py` is a command line utility and Python module for computing
+item spawn distributions on a dungeon floor, simulating item generation over
+many dungeon PRNG seeds (see `dungeon_rng.py`), and searching for seeds that
+produce a given item.
+
+The input is a RAM dump taken on a floor. Items are generated from the
+floor's unrolled item spawn lists in DUNGEON_STRUCT: `regular_item_weights`,
+`kecleon_item_weights` (Kecleon Shops), `monster_house_item_weights`,
+`buried_item_weights`, `grab_bag_item_weights` and
+`secret_room_item_weights`. Each list has one slot per item category
+(`enum item_category`), followed by one slot per item ID. Floor-level
+chances (the Kecleon Shop chance used by GenerateKecleonShop, the sticky item
+chance used by GenerateItem with GEN_ITEM_STICKY_RANDOM, and the maximum
+amount passed to GenerateMoneyQuantity) come from `floor_properties`.
+
+Item generation is modeled as a two-stage draw: a category is picked by its
+weight, then an item within the category by its weight. Like monster spawn
+lists (see `monster_spawns.py`), weights are taken to be incremental: the
+category slots hold a running total, and the item slots hold a running total
+over the items of each category, in ID order. Each draw uses DungeonRandInt.
+None of this is documented in the symbol tables yet, so it is unverified, and
+simulated results are only as exact as the model.
+
+The symbol tables only document the output ranges of DungeonRandInt,
+DungeonRandRange and DungeonRandOutcome, not how they reduce the output of
+DungeonRand16Bit, so the reduction is part of the model too:
+DungeonRandInt(high) is modeled as (DungeonRand16Bit() * high) >> 16,
+DungeonRandRange(x, y) as min(x, y) + DungeonRandInt(|x - y|), and
+DungeonRandOutcome(p) as DungeonRandInt(100) < p.
+
+Kecleon Shops can be generated as a whole (`--shop`), following
+GenerateKecleonShop and GenerateItem: the shop spawns if
+DungeonRandOutcome(kecleon_shop_spawn_chance) succeeds, and the shop
+occupies the interior of its room, leaving a one tile margin from the room
+walls. Every shop tile is modeled as holding one item, so a W x H room has
+(W - 2) x (H - 2) slots (the room is picked during floor generation, so its
+size is an input; the minimum is 5x4). Each slot is filled by drawing from
+`kecleon_item_weights`. For Poké, GenerateMoneyQuantity picks the amount: it
+is modeled as DungeonRandRange(1, n + 1) over the n quantity codes whose
+amount in MONEY_QUANTITY_TABLE doesn't exceed the floor's maximum (8 times
+higher with dungeon::boost_max_money_amount). Other items are made sticky
+with DungeonRandOutcome(sticky_item_chance), like GEN_ITEM_STICKY_RANDOM.
+The order of these draws, whether every tile gets an item, and the size of
+the boost from dungeon::boost_kecleon_shop_spawn_chance (which is reported
+but not applied) are not documented. In the game, the room selection and
+the rest of floor generation also draw from the PRNG between the shop roll
+and the item draws, so simulated seeds don't reproduce actual floors; the
+simulation gives the distribution of shop contents under the model.
+
+Item categories (GetItemCategory) are read from the item data file in an
+extracted ROM (BALANCE/item_p.bin), a SIR0 file (see `sir0.py`) with a
+16-byte entry per item ID holding the category at offset 0x4 (per the
+community documentation; unverified). Without it, only the category
+distribution can be computed.
+
+Example usage:
+python3 item_spawns.py ram.bin
+python3 item_spawns.py -i BALANCE/item_p.bin -t kecleon ram.bin
+python3 item_spawns.py -i BALANCE/item_p.bin -m 1000000 ram.bin
+python3 item_spawns.py -i BALANCE/item_p.bin --find ITEM_REVIVER_SEED ram.bin
+python3 item_spawns.py -i BALANCE/item_p.bin --shop --shop-room 7x6 -m 100000 ram.bin
+"""
+
+import argparse
+from bisect import bisect_right
+from fractions import Fraction
+from multiprocessing import Pool
+import struct
+import sys
+from typing import Dict, List, NamedTuple, Optional, Sequence, Tuple
+
+import dungeon_rng
+from dungeon_rng import DungeonRng
+from layouts import Layouts, RamDump, load_data_symbols, symbol_address
+from sir0 import Sir0File
+
+try:
+    import numpy as np
+except ImportError:
+    np = None
+
+N_CATEGORIES = 16
+ITEM_P_ENTRY_LEN = 16
+ITEM_P_CATEGORY_OFFSET = 4
+# Spawn list name -> field of struct dungeon
+WEIGHT_TABLES = {
+    "regular": "regular_item_weights",
+    "kecleon": "kecleon_item_weights",
+    "monster_house": "monster_house_item_weights",
+    "buried": "buried_item_weights",
+    "grab_bag": "grab_bag_item_weights",
+    "secret_room": "secret_room_item_weights",
+}
+SEED_CHUNK = 1 << 16
+MONEY_QUANTITY_TABLE = "MONEY_QUANTITY_TABLE"
+# dungeon::boost_max_money_amount multiplies the maximum by this
+MONEY_AMOUNT_BOOST = 8
+# Minimum dimensions of a room that can hold a Kecleon Shop
+MIN_SHOP_ROOM = (5, 4)
+
+
+def modeled_rand_ints(values16: Sequence[int], high: int) -> Sequence[int]:
+    """
+    Modeled DungeonRandInt(high) for each 16-bit output of DungeonRand16Bit.
+    Returns an int64 array if numpy is available, or a list otherwise.
+    """
+    if np is not None:
+        return (np.asarray(values16, dtype=np.int64) * high) >> 16
+    return [(int(v) * high) >> 16 for v in values16]
+
+
+def modeled_rand_int(rng: DungeonRng, high: int) -> int:
+    """Modeled DungeonRandInt(high)"""
+    return (rng.rand16() * high) >> 16
+
+
+def modeled_rand_range(rng: DungeonRng, x: int, y: int) -> int:
+    """Modeled DungeonRandRange(x, y)"""
+    return min(x, y) + modeled_rand_int(rng, abs(x - y))
+
+
+def modeled_rand_outcome(rng: DungeonRng, percentage: int) -> bool:
+    """Modeled DungeonRandOutcome(percentage)"""
+    return modeled_rand_int(rng, 100) < percentage
+
+
+class FloorItemInfo(NamedTuple):
+    """Item-related floor properties"""
+
+    kecleon_shop_spawn_chance: int
+    sticky_item_chance: int
+    # Including the boost from dungeon::boost_max_money_amount
+    max_money_amount: int
+    boost_kecleon_shop_spawn_chance: bool
+    # MONEY_QUANTITY_TABLE: amount by money quantity code
+    money_amounts: Tuple[int, ...]
+
+
+class ShopItem(NamedTuple):
+    item_id: int
+    money: int  # Amount of Poké, 0 for other items
+    sticky: bool
+
+
+def incremental_to_cumulative(values: Sequence[int]) -> List[int]:
+    """Makes incremental weights nondecreasing; entries that don't raise the
+    running total can't be picked"""
+    cum: List[int] = []
+    for v in values:
+        cum.append(max(v, cum[-1]) if cum else v)
+    return cum
+
+
+class ItemSpawnList:
+    """An unrolled item spawn list, split into categories"""
+
+    def __init__(self, weights: Sequence[int], categories: Optional[Sequence[int]]):
+        self.category_cum = incremental_to_cumulative(weights[:N_CATEGORIES])
+        self.item_weights = list(weights[N_CATEGORIES:])
+        # Category -> (item IDs, cumulative weights), if categories are known
+        self.items: Optional[Dict[int, Tuple[List[int], List[int]]]] = None
+        if categories is not None:
+            self.items = {}
+            for item_id, w in enumerate(self.item_weights):
+                if item_id >= len(categories):
+                    break
+                ids, cum = self.items.setdefault(categories[item_id], ([], []))
+                ids.append(item_id)
+                cum.append(max(w, cum[-1]) if cum else w)
+
+    def category_distribution(self) -> List[Fraction]:
+        total = self.category_cum[-1]
+        if total == 0:
+            return [Fraction(0)] * N_CATEGORIES
+        prev = 0
+        dist = []
+        for c in self.category_cum:
+            dist.append(Fraction(c - prev, total))
+            prev = c
+        return dist
+
+    def item_distribution(self) -> Dict[int, Fraction]:
+        """The exact probability of each item being generated"""
+        if self.items is None:
+            raise ValueError("item categories are needed for item distributions")
+        dist = {}
+        for category, p_category in enumerate(self.category_distribution()):
+            ids, cum = self.items.get(category, ([], []))
+            if p_category == 0 or not cum or cum[-1] == 0:
+                continue
+            prev = 0
+            for item_id, c in zip(ids, cum):
+                if c > prev:
+                    dist[item_id] = p_category * Fraction(c - prev, cum[-1])
+                prev = c
+        return dist
+
+    def draw(self, values16: Sequence[Sequence[int]]) -> Sequence[int]:
+        """
+        Modeled item generation: the item ID picked for each pair of 16-bit
+        PRNG outputs (category draw, item draw), or -1 if nothing can be picked
+        """
+        if self.items is None:
+            raise ValueError("item categories are needed to draw items")
+        if np is not None:
+            values16 = np.asarray(values16)
+            r_cat = modeled_rand_ints(values16[:, 0], self.category_cum[-1])
+            cats = np.searchsorted(np.asarray(self.category_cum), r_cat, side="right")
+            out = np.full(len(values16), -1, dtype=np.int64)
+            for category, (ids, cum) in self.items.items():
+                mask = cats == category
+                if not cum or cum[-1] == 0 or not mask.any():
+                    continue
+                r = modeled_rand_ints(values16[mask, 1], cum[-1])
+                out[mask] = np.asarray(ids)[np.searchsorted(cum, r, side="right")]
+            return out
+        out_list = []
+        for v_cat, v_item in values16:
+            (r_cat,) = modeled_rand_ints([v_cat], self.category_cum[-1])
+            ids, cum = self.items.get(bisect_right(self.category_cum, r_cat), ([], []))
+            if not cum or cum[-1] == 0:
+                out_list.append(-1)
+                continue
+            (r,) = modeled_rand_ints([v_item], cum[-1])
+            out_list.append(ids[bisect_right(cum, r)])
+        return out_list
+
+    def pick(self, rng: DungeonRng) -> int:
+        """
+        Modeled item generation with a PRNG: draws a category, then an item
+        within it. Returns -1 if nothing can be picked.
+        """
+        if self.items is None:
+            raise ValueError("item categories are needed to draw items")
+        if self.category_cum[-1] == 0:
+            return -1
+        category = bisect_right(
+            self.category_cum, modeled_rand_int(rng, self.category_cum[-1])
+        )
+        ids, cum = self.items.get(category, ([], []))
+        if not cum or cum[-1] == 0:
+            return -1
+        return ids[bisect_right(cum, modeled_rand_int(rng, cum[-1]))]
+
+
+def money_codes(info: FloorItemInfo) -> int:
+    """
+    The number of money quantity codes (from 1) whose amount doesn't exceed the
+    floor's maximum
+    """
+    n = 0
+    for amount in info.money_amounts[1:]:
+        if amount > info.max_money_amount:
+            break
+        n += 1
+    return n
+
+
+def generate_money_quantity(rng: DungeonRng, info: FloorItemInfo) -> int:
+    """Modeled GenerateMoneyQuantity: an amount of Poké"""
+    n = money_codes(info)
+    if n == 0:
+        return info.money_amounts[1]
+    return info.money_amounts[modeled_rand_range(rng, 1, n + 1)]
+
+
+def generate_kecleon_shop(
+    rng: DungeonRng,
+    spawn_list: ItemSpawnList,
+    info: FloorItemInfo,
+    n_slots: int,
+    poke_id: int,
+) -> Optional[List[ShopItem]]:
+    """
+    Modeled Kecleon Shop generation: the items on the shop tiles, or None if no
+    shop spawns
+    """
+    if not modeled_rand_outcome(rng, info.kecleon_shop_spawn_chance):
+        return None
+    items = []
+    for _ in range(n_slots):
+        item_id = spawn_list.pick(rng)
+        if item_id < 0:
+            continue
+        if item_id == poke_id:
+            items.append(ShopItem(item_id, generate_money_quantity(rng, info), False))
+        else:
+            items.append(
+                ShopItem(item_id, 0, modeled_rand_outcome(rng, info.sticky_item_chance))
+            )
+    return items
+
+
+def shop_slots(room: Tuple[int, int]) -> int:
+    """The number of Kecleon Shop tiles in a room of the given dimensions"""
+    width, height = room
+    if width < MIN_SHOP_ROOM[0] or height < MIN_SHOP_ROOM[1]:
+        raise ValueError(
+            f"a {width}x{height} room is too small for a Kecleon Shop "
+            + f"(minimum {MIN_SHOP_ROOM[0]}x{MIN_SHOP_ROOM[1]})"
+        )
+    return (width - 2) * (height - 2)
+
+
+class ShopStats(NamedTuple):
+    """Totals over simulated Kecleon Shops"""
+
+    shops: int
+    items: Dict[int, int]
+    sticky: int
+    money: int
+
+
+def _shop_chunk(args: Tuple[ItemSpawnList, FloorItemInfo, int, int, int, int]):
+    spawn_list, info, n_slots, poke_id, first_seed, n_seeds = args
+    shops = sticky = money = 0
+    items: Dict[int, int] = {}
+    for seed in range(first_seed, first_seed + n_seeds):
+        shop = generate_kecleon_shop(
+            DungeonRng(seed), spawn_list, info, n_slots, poke_id
+        )
+        if shop is None:
+            continue
+        shops += 1
+        for item in shop:
+            items[item.item_id] = items.get(item.item_id, 0) + 1
+            sticky += item.sticky
+            money += item.money
+    return ShopStats(shops, items, sticky, money)
+
+
+def simulate_shops(
+    spawn_list: ItemSpawnList,
+    info: FloorItemInfo,
+    n_slots: int,
+    poke_id: int,
+    n_seeds: int,
+    first_seed: int = 1,
+    jobs: Optional[int] = None,
+) -> ShopStats:
+    """
+    Generates a Kecleon Shop for each of n_seeds consecutive dungeon PRNG
+    seeds, in parallel, and totals the results
+    """
+    total = ShopStats(0, {}, 0, 0)
+    chunks = [
+        (spawn_list, info, n_slots, poke_id, s, n)
+        for s, n in _seed_chunks(n_seeds, first_seed)
+    ]
+    with Pool(jobs) as pool:
+        for stats in pool.imap_unordered(_shop_chunk, chunks):
+            items = dict(total.items)
+            for item_id, n in stats.items.items():
+                items[item_id] = items.get(item_id, 0) + n
+            total = ShopStats(
+                total.shops + stats.shops,
+                items,
+                total.sticky + stats.sticky,
+                total.money + stats.money,
+            )
+    return total
+
+
+def load_item_categories(path: str) -> List[int]:
+    """Reads the category of each item ID from item_p.bin"""
+    with Sir0File(path) as item_p:
+        data = item_p.contents
+        end = item_p.header.content
+        return [
+            data[offset + ITEM_P_CATEGORY_OFFSET]
+            for offset in range(16, end - ITEM_P_ENTRY_LEN + 1, ITEM_P_ENTRY_LEN)
+        ]
+
+
+def read_floor(
+    path: str, layouts: Layouts, version: str = "NA"
+) -> Tuple[Dict[str, List[int]], FloorItemInfo]:
+    """Reads the item spawn lists and item-related floor properties from a dump"""
+    with RamDump(path, layouts, version) as dump:
+        dungeon = dump.global_view("DUNGEON_STRUCT")
+        tables = {
+            name: list(getattr(dungeon, field)) for name, field in WEIGHT_TABLES.items()
+        }
+        props = dungeon.floor_properties
+        max_money = props.max_money_amount_div_5 * 5
+        if dungeon.boost_max_money_amount:
+            max_money *= MONEY_AMOUNT_BOOST
+        sym = load_data_symbols("arm9")[MONEY_QUANTITY_TABLE]
+        start = dump.mapped.relative(symbol_address(sym, version))
+        length = sym["length"][version]
+        info = FloorItemInfo(
+            props.kecleon_shop_spawn_chance,
+            props.sticky_item_chance,
+            max_money,
+            bool(dungeon.boost_kecleon_shop_spawn_chance),
+            struct.unpack_from(f"<{length // 4}i", dump.contents, start),
+        )
+    return tables, info
+
+
+def _draw_chunk(args: Tuple[ItemSpawnList, int, int]) -> Sequence[int]:
+    spawn_list, first_seed, n_seeds = args
+    values = dungeon_rng.sequences(range(first_seed, first_seed + n_seeds), 2)
+    return spawn_list.draw(values)
+
+
+def _seed_chunks(n_seeds: int, first_seed: int) -> List[Tuple[int, int]]:
+    return [
+        (s, min(SEED_CHUNK, first_seed + n_seeds - s))
+        for s in range(first_seed, first_seed + n_seeds, SEED_CHUNK)
+    ]
+
+
+def simulate(
+    spawn_list: ItemSpawnList,
+    n_seeds: int,
+    first_seed: int = 1,
+    jobs: Optional[int] = None,
+) -> Dict[int, int]:
+    """
+    Generates one item for each of n_seeds consecutive dungeon PRNG seeds, in
+    parallel. Returns the number of times each item ID was generated.
+    """
+    counts: Dict[int, int] = {}
+    chunks = [(spawn_list, s, n) for s, n in _seed_chunks(n_seeds, first_seed)]
+    with Pool(jobs) as pool:
+        for items in pool.imap_unordered(_draw_chunk, chunks):
+            if np is not None:
+                ids, n = np.unique(items, return_counts=True)
+                pairs = zip(ids.tolist(), n.tolist())
+            else:
+                pairs = ((i, items.count(i)) for i in set(items))
+            for item_id, n in pairs:
+                counts[item_id] = counts.get(item_id, 0) + n
+    return counts
+
+
+def find_seeds(
+    spawn_list: ItemSpawnList,
+    item_id: int,
+    n_seeds: int,
+    first_seed: int = 1,
+    jobs: Optional[int] = None,
+) -> List[int]:
+    """Finds the seeds (out of n_seeds consecutive ones) that generate an item"""
+    seeds: List[int] = []
+    chunks = _seed_chunks(n_seeds, first_seed)
+    with Pool(jobs) as pool:
+        results = pool.map(_draw_chunk, [(spawn_list, s, n) for s, n in chunks])
+    for (s, _), items in zip(chunks, results):
+        seeds.extend(s + i for i, x in enumerate(items) if x == item_id)
+    return seeds
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(
+        description="Compute and simulate item spawns on a dungeon floor"
+    )
+    parser.add_argument("dump", help="RAM dump taken on a dungeon floor")
+    parser.add_argument(
+        "-t",
+        "--table",
+        choices=list(WEIGHT_TABLES),
+        default="regular",
+        help="item spawn list to use (default: regular)",
+    )
+    parser.add_argument(
+        "-i", "--item-p", help="item_p.bin from an extracted ROM, for item categories"
+    )
+    parser.add_argument(
+        "-m",
+        "--monte-carlo",
+        type=int,
+        metavar="N_SEEDS",
+        help="also simulate item generation with N_SEEDS dungeon PRNG seeds",
+    )
+    parser.add_argument(
+        "--find",
+        metavar="ITEM",
+        help="print the seeds that generate an item (ID or enum item_id name)",
+    )
+    parser.add_argument(
+        "--shop",
+        action="store_true",
+        help="generate whole Kecleon Shops (uses the kecleon spawn list)",
+    )
+    parser.add_argument(
+        "--shop-room",
+        default=f"{MIN_SHOP_ROOM[0]}x{MIN_SHOP_ROOM[1]}",
+        help="dimensions of the Kecleon Shop room, as WxH (default: %(default)s)",
+    )
+    parser.add_argument(
+        "-n",
+        "--seeds",
+        type=int,
+        default=1 << 20,
+        help="number of seeds to search with --find (default: 2^20)",
+    )
+    parser.add_argument(
+        "--first-seed",
+        type=lambda x: int(x, 0),
+        default=1,
+        help="first seed to simulate or search",
+    )
+    parser.add_argument(
+        "-j", "--jobs", type=int, help="number of processes (default: all cores)"
+    )
+    parser.add_argument(
+        "-v",
+        "--version",
+        choices=["NA", "EU", "JP"],
+        default="NA",
+        help="game version of the RAM dump",
+    )
+    parser.add_argument(
+        "-l",
+        "--layouts",
+        help="load previously emitted layout tables instead of the headers",
+    )
+    args = parser.parse_args()
+
+    if (args.monte_carlo or args.find or args.shop) and not args.item_p:
+        parser.error("--monte-carlo, --find and --shop require -i/--item-p")
+    if args.shop and args.find:
+        parser.error("--shop and --find are mutually exclusive")
+    if args.shop:
+        args.table = "kecleon"
+
+    layouts = Layouts.load(args.layouts) if args.layouts else Layouts.from_headers()
+    item_ids = layouts.enums["enum item_id"]
+    item_names = {v: k for k, v in reversed(item_ids.items())}
+    category_names = {
+        v: k for k, v in reversed(layouts.enums["enum item_category"].items())
+    }
+
+    tables, info = read_floor(args.dump, layouts, args.version)
+    categories = load_item_categories(args.item_p) if args.item_p else None
+    spawn_list = ItemSpawnList(tables[args.table], categories)
+
+    if args.find:
+        if args.find in item_ids:
+            target = item_ids[args.find]
+        else:
+            try:
+                target = int(args.find, 0)
+            except ValueError:
+                sys.exit(f"Unknown item '{args.find}'")
+        for seed in find_seeds(
+            spawn_list, target, args.seeds, args.first_seed, args.jobs
+        ):
+            print(f"{seed:#010x}")
+        sys.exit(0)
+
+    print(
+        f"{args.dump}: Kecleon Shop chance {info.kecleon_shop_spawn_chance}%"
+        + (" (boosted)" if info.boost_kecleon_shop_spawn_chance else "")
+        + f", sticky item chance {info.sticky_item_chance}%, "
+        + f"max money amount {info.max_money_amount}"
+    )
+    if args.shop:
+        try:
+            room = tuple(int(x) for x in args.shop_room.lower().split("x"))
+            n_slots = shop_slots(room)
+        except ValueError as e:
+            sys.exit(f"Invalid shop room '{args.shop_room}': {e}")
+        n_codes = money_codes(info)
+        print(
+            f"Kecleon Shop in a {room[0]}x{room[1]} room: {n_slots} items, "
+            + f"Poké amounts from {n_codes} quantity codes "
+            + f"(up to {info.money_amounts[max(n_codes, 1)]})"
+        )
+        if args.monte_carlo:
+            stats = simulate_shops(
+                spawn_list,
+                info,
+                n_slots,
+                item_ids["ITEM_POKE"],
+                args.monte_carlo,
+                args.first_seed,
+                args.jobs,
+            )
+            print(
+                f"Simulated {args.monte_carlo} seeds: {stats.shops} shops "
+                + f"({stats.shops / args.monte_carlo:.4%})"
+            )
+            if stats.shops:
+                n_items = sum(stats.items.values())
+                print(
+                    f"  {n_items / stats.shops:.2f} items per shop, "
+                    + f"{stats.sticky / stats.shops:.2f} sticky, "
+                    + f"{stats.money / stats.shops:.1f} Poké"
+                )
+                print(f"  {'item':<32} {'per shop':>9}")
+                for item_id, n in sorted(stats.items.items()):
+                    print(
+                        f"  {item_names.get(item_id, item_id):<32} "
+                        + f"{n / stats.shops:>9.4f}"
+                    )
+    print(f"Categories ({args.table}):")
+    for category, p in enumerate(spawn_list.category_distribution()):
+        if p:
+            print(f"  {category_names.get(category, category):<32} {float(p):>9.4%}")
+    if categories is None:
+        sys.exit(0)
+
+    counts = None
+    if args.monte_carlo and not args.shop:
+        counts = simulate(spawn_list, args.monte_carlo, args.first_seed, args.jobs)
+    print(f"Items ({args.table}):")
+    header = f"  {'item':<32} {'probability':>11}"
+    if counts is not None:
+        header += f" {'simulated':>10}"
+    print(header)
+    for item_id, p in sorted(spawn_list.item_distribution().items()):
+        line = f"  {item_names.get(item_id, item_id):<32} {float(p):>11.4%}"
+        if counts is not None:
+            line += f" {counts.get(item_id, 0) / args.monte_carlo:>10.4%}"
+        print(line)
@@ -0,0 +1,1336 @@
+#!/usr/bin/env python3
+
+"""
+`layouts.py` is a library and command line utility for resolving the memory
+layouts of the types defined in the C headers, and for reading typed values
+out of binary data (like emulator RAM dumps) using those layouts.
+
+Rather than reimplementing C layout rules, the tool asks a C compiler (the
+same one used to build the headers: clang or gcc, or $CC if set) to evaluate
+`offsetof` and `sizeof` for every struct/union member, and the values of every
+enumerator. Bitfield positions are resolved by having the compiler emit a
+static initializer with only that bitfield set, and reading back which bits
+it occupies. This means the resolved layouts are always consistent with the
+headers, including the `ASSERT_SIZE` checks.
+
+Global variables are read from the declarations in `headers/data/` and
+located using the symbol tables in `symbols/`. A `RamDump` memory-maps a dump
+of main memory (0x2000000-0x2400000) and returns zero-copy views of globals
+like `DUNGEON_STRUCT`.
+
+The resolved layouts can be emitted as machine-readable tables, either as
+JSON or in a compact binary form (see `Layouts.to_binary()`), and loaded back
+with `Layouts.load()`, so that scripts reading dumps don't need a compiler
+or the headers at runtime.
+
+Example usage:
+python3 layouts.py "struct tile"
+python3 layouts.py "struct dungeon" -p gen_info.stairs_pos
+python3 layouts.py -d ram.bin DUNGEON_STRUCT -p gen_info.stairs_pos
+python3 layouts.py -v EU -d ram.bin FLOOR_GENERATION_STATUS
+python3 layouts.py -e layouts.json -e layouts.bin
+python3 layouts.py -l layouts.bin -d ram.bin DUNGEON_STRUCT -p n_rooms
+
+Library usage:
+    layouts = Layouts.from_headers()  # or Layouts.load("layouts.bin")
+    with RamDump("ram.bin", layouts) as dump:
+        dungeon = dump.global_view("DUNGEON_STRUCT")
+        print(dungeon.gen_info.stairs_pos.x, dungeon.gen_info.tiles[0][0].room)
+"""
+
+import argparse
+from bisect import bisect_right
+import json
+import mmap
+import os
+from pathlib import Path
+import re
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+from typing import (
+    Any,
+    Dict,
+    Iterator,
+    List,
+    NamedTuple,
+    Optional,
+    Sequence,
+    Tuple,
+    Union,
+)
+
+import yaml
+
+import offsets
+
+HEADER_DIR: Path = Path(__file__).resolve().parent.parent / "headers"
+SYMBOL_DIR: Path = Path(__file__).resolve().parent.parent / "symbols"
+YamlLoader = getattr(yaml, "CSafeLoader", yaml.SafeLoader)
+
+# Main memory, as defined in ram.yml (the same for all versions)
+RAM = offsets.Binary(0x2000000, 0x400000)
+
+# Signedness of the builtin scalar types, after resolving typedefs. Note that
+# plain char is treated as signed, since int8_t is defined as char.
+PRIMITIVE_SIGNEDNESS = {
+    "char": True,
+    "signed char": True,
+    "unsigned char": False,
+    "short": True,
+    "unsigned short": False,
+    "int": True,
+    "unsigned int": False,
+    "long": True,
+    "unsigned long": False,
+    "long long": True,
+    "unsigned long long": False,
+    "_Bool": False,
+}
+
+# Magic and version of the serialized layout tables
+TABLE_MAGIC = b"PMDL"
+TABLE_FORMAT_VERSION = 1
+
+# Binary data as accepted by views
+Buffer = Union[bytes, bytearray, memoryview, mmap.mmap]
+
+
+class Field(NamedTuple):
+    """A member of a struct or union, with its resolved layout"""
+
+    name: str
+    # The declared type, without pointer indirection (e.g., "uint16_t",
+    # "struct tile", "enum terrain_type")
+    type: str
+    # Levels of pointer indirection
+    pointer: int
+    # Array dimensions, outermost first (empty for non-arrays)
+    dims: Tuple[int, ...]
+    # Offset within the parent type in bytes
+    offset: int
+    # Total size of the member in bytes (for bitfields, the size of the
+    # declared type)
+    size: int
+    # For bitfields: position relative to the start of the parent type, and
+    # width, in bits
+    bit_offset: Optional[int] = None
+    bit_width: Optional[int] = None
+
+    def is_bitfield(self) -> bool:
+        return self.bit_width is not None
+
+    def element_size(self) -> int:
+        """Size of a single array element (or the whole member for non-arrays)"""
+        n = 1
+        for d in self.dims:
+            n *= d
+        return self.size // n if n else 0
+
+
+class Aggregate:
+    """A struct or union type"""
+
+    def __init__(self, kind: str, name: str, size: int, fields: List[Field]):
+        self.kind = kind
+        self.name = name
+        self.size = size
+        self.fields = fields
+        self.fields_by_name = {f.name: f for f in fields}
+
+    def __repr__(self) -> str:
+        return f"Aggregate({self.name!r}, size={self.size}, fields={len(self.fields)})"
+
+
+class Global(NamedTuple):
+    """A global variable declared in the data headers"""
+
+    name: str
+    type: str
+    pointer: int
+    # Array dimensions; None for an unspecified dimension (e.g., `foo[]`)
+    dims: Tuple[Optional[int], ...]
+    # The binary the declaration belongs to, e.g., "ram" or "overlay29"
+    binary: str
+
+
+class Leaf(NamedTuple):
+    """A scalar or bitfield within a type, as enumerated by `Layouts.leaves()`"""
+
+    # Field path relative to the enclosing type, e.g., `gen_info.tiles[3][4].room`
+    path: str
+    # Offset from the start of the enclosing type in bytes
+    offset: int
+    # Size in bytes (for bitfields, the number of bytes the bits span)
+    size: int
+    type: str
+    pointer: int
+    # For bitfields: position relative to the start of the enclosing type,
+    # and width, in bits
+    bit_offset: Optional[int] = None
+    bit_width: Optional[int] = None
+
+
+class Declarator(NamedTuple):
+    type: str
+    pointer: int
+    name: str
+    dims: Tuple[str, ...]
+    bit_width: Optional[int]
+
+
+DECLARATOR_RE = re.compile(
+    r"^(?P<type>.*?)\s*(?P<ptr>[\s\*]*)\b(?P<name>\w+)\s*"
+    + r"(?P<dims>(?:\[[^\]]*\]\s*)*)(?::\s*(?P<bits>\d+))?$",
+    re.DOTALL,
+)
+
+
+def parse_declarator(decl: str) -> Declarator:
+    """Parses a simple declaration like `struct foo* bar[2][3]` or `int x : 4`"""
+    m = DECLARATOR_RE.match(" ".join(decl.split()))
+    if m is None or not m.group("type"):
+        raise ValueError(f"could not parse declaration '{decl}'")
+    base = m.group("type")
+    pointer = m.group("ptr").count("*") + base.count("*")
+    base = " ".join(base.replace("*", " ").split())
+    dims = tuple(d.strip() for d in re.findall(r"\[([^\]]*)\]", m.group("dims")))
+    bits = m.group("bits")
+    return Declarator(
+        base, pointer, m.group("name"), dims, int(bits) if bits is not None else None
+    )
+
+
+def parse_type_name(type_name: str) -> Tuple[str, int, Tuple[int, ...]]:
+    """
+    Parses a type name like "struct foo", "uint8_t*" or "int16_t[2]" into
+    (base type, pointer level, array dims).
+    """
+    base, dims = re.match(r"^(.*?)\s*((?:\[[^\]]*\]\s*)*)$", type_name).groups()
+    d = parse_declarator(f"{base} _{dims}")
+    return d.type, d.pointer, tuple(int(x, 0) for x in d.dims)
+
+
+def split_statements(text: str) -> List[str]:
+    """Splits C source into top-level statements terminated by semicolons"""
+    statements = []
+    depth = 0
+    start = 0
+    for m in re.finditer(r"[{};]", text):
+        c = m.group()
+        if c == "{":
+            depth += 1
+        elif c == "}":
+            depth -= 1
+        elif depth == 0:
+            statements.append(text[start : m.start()].strip())
+            start = m.end()
+    return statements
+
+
+def find_compiler() -> str:
+    """Finds a C compiler the same way as the headers Makefile"""
+    cc = os.environ.get("CC")
+    if cc:
+        return cc
+    for cc in ("clang", "gcc"):
+        if shutil.which(cc):
+            return cc
+    raise RuntimeError("C compiler not found")
+
+
+def parse_asm_data(asm: str, labels: Sequence[str]) -> Dict[str, bytes]:
+    """
+    Extracts the initialized contents of the given data labels from assembly
+    generated by gcc or clang for a little-endian target.
+    """
+    wanted = set(labels)
+    data: Dict[str, bytearray] = {}
+    current: Optional[bytearray] = None
+    widths = {
+        ".byte": 1,
+        ".short": 2,
+        ".value": 2,
+        ".2byte": 2,
+        ".hword": 2,
+        ".long": 4,
+        ".int": 4,
+        ".4byte": 4,
+        ".quad": 8,
+        ".8byte": 8,
+    }
+    for line in asm.splitlines():
+        line = line.split("#", 1)[0].strip()
+        if not line:
+            continue
+        m = re.match(r"^([\w.$]+):$", line)
+        if m:
+            label = m.group(1)
+            current = data.setdefault(label, bytearray()) if label in wanted else None
+            continue
+        if current is None:
+            continue
+        parts = line.split(None, 1)
+        directive = parts[0]
+        if directive in widths:
+            width = widths[directive]
+            for v in parts[1].split(","):
+                current += (int(v.strip(), 0) & ((1 << (8 * width)) - 1)).to_bytes(
+                    width, "little"
+                )
+        elif directive in (".zero", ".space", ".skip"):
+            current += bytes(int(parts[1].split(",")[0], 0))
+        else:
+            # Any other directive (.size, .align, .section, ...) ends the data
+            current = None
+    return {label: bytes(v) for label, v in data.items()}
+
+
+class Layouts:
+    """Resolved layouts of all the types and globals defined in the headers"""
+
+    def __init__(
+        self,
+        aggregates: Dict[str, Aggregate],
+        enums: Dict[str, Dict[str, int]],
+        typedefs: Dict[str, Tuple[str, int]],
+        sizes: Dict[str, int],
+        globals: Dict[str, Global],
+    ):
+        self.aggregates = aggregates
+        self.enums = enums
+        self.typedefs = typedefs
+        self.sizes = sizes
+        self.globals = globals
+        self._enum_names = {
+            name: {v: k for k, v in reversed(list(values.items()))}
+            for name, values in enums.items()
+        }
+        # Struct name -> running maximum of the field end offsets, for leaves()
+        self._field_ends: Dict[str, List[int]] = {}
+
+    @classmethod
+    def from_headers(
+        cls, header_dir: Path = HEADER_DIR, compiler: Optional[str] = None
+    ) -> "Layouts":
+        """
+        Parses the headers and resolves all layouts with the C compiler.
+        """
+        cc = compiler or find_compiler()
+        pmdsky_h = Path(header_dir) / "pmdsky.h"
+        flags = ["-m32", "-mno-ms-bitfields", "-w"]
+        preprocessed = subprocess.run(
+            [cc, *flags, "-E", str(pmdsky_h)],
+            check=True,
+            capture_output=True,
+            text=True,
+        ).stdout
+
+        # Strip preprocessor line markers and pragmas, remembering which file
+        # each chunk of declarations came from
+        chunks: List[Tuple[str, str]] = []
+        lines: List[str] = []
+        current_file = str(pmdsky_h)
+        for line in preprocessed.splitlines():
+            if line.startswith("#"):
+                m = re.match(r'^#\s*\d+\s+"([^"]*)"', line)
+                if m and m.group(1) != current_file:
+                    chunks.append((current_file, "\n".join(lines)))
+                    lines = []
+                    current_file = m.group(1)
+                continue
+            lines.append(line)
+        chunks.append((current_file, "\n".join(lines)))
+
+        aggregate_decls: Dict[str, Tuple[str, List[Declarator]]] = {}
+        enum_decls: Dict[str, List[str]] = {}
+        typedefs: Dict[str, Tuple[str, int]] = {}
+        global_decls: List[Tuple[Declarator, str]] = []
+        for filename, chunk in chunks:
+            file_path = Path(filename)
+            binary = file_path.stem if file_path.parent.name == "data" else None
+            for stmt in split_statements(chunk):
+                m = re.match(r"^(struct|union)\s+(\w+)\s*\{(.*)\}$", stmt, re.DOTALL)
+                if m:
+                    members = [
+                        parse_declarator(d) for d in split_statements(m.group(3)) if d
+                    ]
+                    aggregate_decls[f"{m.group(1)} {m.group(2)}"] = (
+                        m.group(1),
+                        members,
+                    )
+                    continue
+                m = re.match(r"^enum\s+(\w+)\s*\{(.*)\}$", stmt, re.DOTALL)
+                if m:
+                    enum_decls[f"enum {m.group(1)}"] = [
+                        e.split("=", 1)[0].strip()
+                        for e in m.group(2).split(",")
+                        if e.strip()
+                    ]
+                    continue
+                m = re.match(r"^typedef\s+(.*)$", stmt, re.DOTALL)
+                if m:
+                    fp = re.search(r"\(\s*\*\s*(\w+)\s*\)", m.group(1))
+                    if fp:
+                        # Function pointer typedef
+                        typedefs[fp.group(1)] = ("void", 1)
+                    else:
+                        d = parse_declarator(m.group(1))
+                        typedefs[d.name] = (d.type, d.pointer)
+                    continue
+                m = re.match(r"^extern\s+([^(]*)$", stmt, re.DOTALL)
+                if m and binary is not None:
+                    global_decls.append((parse_declarator(m.group(1)), binary))
+
+        # Build a translation unit that makes the compiler evaluate all the
+        # layout information we need as static initializers
+        queries: List[str] = []
+        bitfields: List[Tuple[str, str, str]] = []
+        for tag, (_, members) in aggregate_decls.items():
+            queries.append(f"sizeof({tag})")
+            for d in members:
+                if d.bit_width is not None:
+                    queries.append(f"sizeof({d.type})")
+                    bitfields.append((f"pmdsky_bitfield_{len(bitfields)}", tag, d.name))
+                    continue
+                queries.append(f"__builtin_offsetof({tag}, {d.name})")
+                expr = f"((({tag}*)0)->{d.name})"
+                for _ in range(len(d.dims) + 1):
+                    queries.append(f"sizeof({expr})")
+                    expr += "[0]"
+        scalar_types = list(PRIMITIVE_SIGNEDNESS) + list(typedefs) + list(enum_decls)
+        queries += [f"sizeof({t})" for t in scalar_types]
+        enumerators = [e for values in enum_decls.values() for e in values]
+        queries += [f"(int)({e})" for e in enumerators]
+
+        source = [f'#include "{pmdsky_h.resolve()}"']
+        source.append(
+            "__attribute__((used)) static const int pmdsky_layout_data[] = {"
+            + ",\n".join(queries)
+            + "};"
+        )
+        for label, tag, member in bitfields:
+            source.append(
+                f"__attribute__((used)) static const union {{ {tag} s; "
+                + f"unsigned char b[sizeof({tag})]; }} {label} = "
+                + f"{{ .s = {{ .{member} = ~0 }} }};"
+            )
+        with tempfile.TemporaryDirectory() as tmpdir:
+            src_path = Path(tmpdir) / "layouts.c"
+            src_path.write_text("\n".join(source) + "\n")
+            asm = subprocess.run(
+                [cc, *flags, "-S", "-o", "-", str(src_path)],
+                check=True,
+                capture_output=True,
+                text=True,
+            ).stdout
+        data = parse_asm_data(
+            asm, ["pmdsky_layout_data"] + [label for label, _, _ in bitfields]
+        )
+        raw = data["pmdsky_layout_data"]
+        values = iter(struct.unpack(f"<{len(raw) // 4}i", raw))
+
+        # Unpack the results in the same order as the queries
+        bitfield_images = iter(data[label] for label, _, _ in bitfields)
+        aggregates: Dict[str, Aggregate] = {}
+        for tag, (kind, members) in aggregate_decls.items():
+            size = next(values)
+            fields = []
+            for d in members:
+                if d.bit_width is not None:
+                    image = int.from_bytes(next(bitfield_images), "little")
+                    bit_offset = (image & -image).bit_length() - 1
+                    fields.append(
+                        Field(
+                            d.name,
+                            d.type,
+                            d.pointer,
+                            (),
+                            bit_offset // 8,
+                            next(values),
+                            bit_offset,
+                            d.bit_width,
+                        )
+                    )
+                    continue
+                offset = next(values)
+                level_sizes = [next(values) for _ in range(len(d.dims) + 1)]
+                dims = tuple(
+                    level_sizes[i] // level_sizes[i + 1] for i in range(len(d.dims))
+                )
+                fields.append(
+                    Field(d.name, d.type, d.pointer, dims, offset, level_sizes[0])
+                )
+            aggregates[tag] = Aggregate(kind, tag, size, fields)
+        sizes = {t: next(values) for t in scalar_types}
+        sizes.update({tag: agg.size for tag, agg in aggregates.items()})
+        enum_values = {e: next(values) for e in enumerators}
+        enums = {
+            tag: {e: enum_values[e] for e in values}
+            for tag, values in enum_decls.items()
+        }
+
+        globals_ = {}
+        for d, binary in global_decls:
+            dims = tuple(int(x, 0) if x.isdigit() else None for x in d.dims)
+            globals_[d.name] = Global(d.name, d.type, d.pointer, dims, binary)
+
+        return cls(aggregates, enums, typedefs, sizes, globals_)
+
+    def to_dict(self) -> Dict[str, Any]:
+        """The layout tables as JSON-serializable data"""
+        return {
+            "format": TABLE_FORMAT_VERSION,
+            "aggregates": {
+                name: {
+                    "kind": agg.kind,
+                    "size": agg.size,
+                    "fields": [f._asdict() for f in agg.fields],
+                }
+                for name, agg in self.aggregates.items()
+            },
+            "enums": self.enums,
+            "typedefs": {k: list(v) for k, v in self.typedefs.items()},
+            "sizes": self.sizes,
+            "globals": {name: g._asdict() for name, g in self.globals.items()},
+        }
+
+    @classmethod
+    def from_dict(cls, data: Dict[str, Any]) -> "Layouts":
+        if data.get("format") != TABLE_FORMAT_VERSION:
+            raise ValueError(f"unsupported layout table format {data.get('format')}")
+        aggregates = {
+            name: Aggregate(
+                agg["kind"],
+                name,
+                agg["size"],
+                [Field(**{**f, "dims": tuple(f["dims"])}) for f in agg["fields"]],
+            )
+            for name, agg in data["aggregates"].items()
+        }
+        typedefs = {k: (v[0], v[1]) for k, v in data["typedefs"].items()}
+        globals_ = {
+            name: Global(**{**g, "dims": tuple(g["dims"])})
+            for name, g in data["globals"].items()
+        }
+        return cls(aggregates, data["enums"], typedefs, data["sizes"], globals_)
+
+    def to_binary(self) -> bytes:
+        """
+        The layout tables in a compact binary form: a string table, followed
+        by the aggregates, enums, typedefs, sizes and globals. All integers
+        are little-endian, and -1 stands for "none".
+        """
+        strings: Dict[str, int] = {}
+
+        def sid(s: str) -> int:
+            return strings.setdefault(s, len(strings))
+
+        body = bytearray()
+
+        def pack(fmt: str, *values: int):
+            body.extend(struct.pack("<" + fmt, *values))
+
+        def pack_dims(dims: Sequence[Optional[int]]):
+            pack("B", len(dims))
+            for d in dims:
+                pack("i", -1 if d is None else d)
+
+        pack("I", len(self.aggregates))
+        for name, agg in self.aggregates.items():
+            pack("IBII", sid(name), agg.kind == "union", agg.size, len(agg.fields))
+            for f in agg.fields:
+                pack("IIB", sid(f.name), sid(f.type), f.pointer)
+                pack_dims(f.dims)
+                pack(
+                    "IIib",
+                    f.offset,
+                    f.size,
+                    -1 if f.bit_offset is None else f.bit_offset,
+                    -1 if f.bit_width is None else f.bit_width,
+                )
+        pack("I", len(self.enums))
+        for name, values in self.enums.items():
+            pack("II", sid(name), len(values))
+            for e, v in values.items():
+                pack("Iq", sid(e), v)
+        pack("I", len(self.typedefs))
+        for name, (target, pointer) in self.typedefs.items():
+            pack("IIB", sid(name), sid(target), pointer)
+        pack("I", len(self.sizes))
+        for name, size in self.sizes.items():
+            pack("II", sid(name), size)
+        pack("I", len(self.globals))
+        for name, g in self.globals.items():
+            pack("IIB", sid(name), sid(g.type), g.pointer)
+            pack_dims(g.dims)
+            pack("I", sid(g.binary))
+
+        table = bytearray(struct.pack("<I", len(strings)))
+        for s in strings:
+            encoded = s.encode("utf-8")
+            table += struct.pack("<H", len(encoded)) + encoded
+        header = TABLE_MAGIC + struct.pack("<I", TABLE_FORMAT_VERSION)
+        return bytes(header + table + body)
+
+    @classmethod
+    def from_binary(cls, data: Buffer) -> "Layouts":
+        if bytes(data[:4]) != TABLE_MAGIC:
+            raise ValueError("not a binary layout table")
+        (version,) = struct.unpack_from("<I", data, 4)
+        if version != TABLE_FORMAT_VERSION:
+            raise ValueError(f"unsupported layout table format {version}")
+        pos = 8
+
+        def unpack(fmt: str) -> Tuple:
+            nonlocal pos
+            values = struct.unpack_from("<" + fmt, data, pos)
+            pos += struct.calcsize("<" + fmt)
+            return values
+
+        def unpack_dims() -> Tuple[int, ...]:
+            (n,) = unpack("B")
+            return tuple(None if d < 0 else d for d in unpack(f"{n}i"))
+
+        (n_strings,) = unpack("I")
+        strings = []
+        for _ in range(n_strings):
+            (n,) = unpack("H")
+            strings.append(bytes(data[pos : pos + n]).decode("utf-8"))
+            pos += n
+
+        aggregates = {}
+        for _ in range(unpack("I")[0]):
+            name, is_union, size, n_fields = unpack("IBII")
+            fields = []
+            for _ in range(n_fields):
+                fname, ftype, pointer = unpack("IIB")
+                dims = unpack_dims()
+                offset, fsize, bit_offset, bit_width = unpack("IIib")
+                fields.append(
+                    Field(
+                        strings[fname],
+                        strings[ftype],
+                        pointer,
+                        dims,
+                        offset,
+                        fsize,
+                        None if bit_offset < 0 else bit_offset,
+                        None if bit_width < 0 else bit_width,
+                    )
+                )
+            kind = "union" if is_union else "struct"
+            aggregates[strings[name]] = Aggregate(kind, strings[name], size, fields)
+        enums = {}
+        for _ in range(unpack("I")[0]):
+            name, n_values = unpack("II")
+            values = {}
+            for _ in range(n_values):
+                e, v = unpack("Iq")
+                values[strings[e]] = v
+            enums[strings[name]] = values
+        typedefs = {}
+        for _ in range(unpack("I")[0]):
+            name, target, pointer = unpack("IIB")
+            typedefs[strings[name]] = (strings[target], pointer)
+        sizes = {}
+        for _ in range(unpack("I")[0]):
+            name, size = unpack("II")
+            sizes[strings[name]] = size
+        globals_ = {}
+        for _ in range(unpack("I")[0]):
+            name, gtype, pointer = unpack("IIB")
+            dims = unpack_dims()
+            (binary,) = unpack("I")
+            globals_[strings[name]] = Global(
+                strings[name], strings[gtype], pointer, dims, strings[binary]
+            )
+        return cls(aggregates, enums, typedefs, sizes, globals_)
+
+    def save(self, path: Union[str, os.PathLike]):
+        """Saves the layout tables as JSON (.json files) or in binary form"""
+        if str(path).endswith(".json"):
+            with open(path, "w") as f:
+                json.dump(self.to_dict(), f, indent=1)
+        else:
+            with open(path, "wb") as f:
+                f.write(self.to_binary())
+
+    @classmethod
+    def load(cls, path: Union[str, os.PathLike]) -> "Layouts":
+        """Loads layout tables saved as JSON or in binary form"""
+        with open(path, "rb") as f:
+            data = f.read()
+        if data[:4] == TABLE_MAGIC:
+            return cls.from_binary(data)
+        return cls.from_dict(json.loads(data))
+
+    def resolve_typedef(self, type_name: str, pointer: int = 0) -> Tuple[str, int]:
+        """Resolves a type name through typedefs, accumulating pointer levels"""
+        while type_name in self.typedefs:
+            type_name, extra = self.typedefs[type_name]
+            pointer += extra
+        return type_name, pointer
+
+    def sizeof(self, type_name: str, pointer: int = 0) -> int:
+        if pointer:
+            return 4
+        return self.sizes[type_name]
+
+    def is_signed(self, type_name: str) -> bool:
+        """Whether a (non-pointer) scalar type is signed"""
+        type_name, _ = self.resolve_typedef(type_name)
+        if type_name in self.enums:
+            return any(v < 0 for v in self.enums[type_name].values())
+        return PRIMITIVE_SIGNEDNESS.get(type_name, False)
+
+    def enum_name(self, enum_type: str, value: int) -> Optional[str]:
+        """Gets the enumerator name for a value of the given enum type"""
+        return self._enum_names.get(enum_type, {}).get(value)
+
+    def read(
+        self,
+        type_name: str,
+        pointer: int,
+        dims: Sequence[int],
+        buffer: Buffer,
+        offset: int,
+        size: Optional[int] = None,
+    ) -> Any:
+        """
+        Reads a value of the given type from a buffer. Structs, unions and
+        arrays are returned as zero-copy views; scalars are returned as ints
+        (pointers as unsigned addresses).
+        """
+        if dims:
+            return ArrayView(self, type_name, pointer, tuple(dims), buffer, offset)
+        resolved, pointer = self.resolve_typedef(type_name, pointer)
+        if not pointer and resolved in self.aggregates:
+            return View(self, self.aggregates[resolved], buffer, offset)
+        if size is None:
+            size = self.sizeof(resolved, pointer)
+        return int.from_bytes(
+            buffer[offset : offset + size],
+            "little",
+            signed=not pointer and self.is_signed(resolved),
+        )
+
+    def read_field(self, field: Field, buffer: Buffer, offset: int) -> Any:
+        """
+        Reads a field from a buffer, given the offset of the parent type.
+        """
+        if field.bit_width is None:
+            return self.read(
+                field.type,
+                field.pointer,
+                field.dims,
+                buffer,
+                offset + field.offset,
+                field.element_size(),
+            )
+        return self._read_bits(
+            field.type, field.bit_offset, field.bit_width, buffer, offset
+        )
+
+    def _read_bits(
+        self,
+        type_name: str,
+        bit_offset: int,
+        bit_width: int,
+        buffer: Buffer,
+        offset: int,
+    ) -> int:
+        start = offset + bit_offset // 8
+        shift = bit_offset % 8
+        n_bytes = (shift + bit_width + 7) // 8
+        value = (int.from_bytes(buffer[start : start + n_bytes], "little") >> shift) & (
+            (1 << bit_width) - 1
+        )
+        if self.is_signed(type_name) and value >> (bit_width - 1):
+            value -= 1 << bit_width
+        return value
+
+    def leaves(
+        self, type_name: str, start: int = 0, end: Optional[int] = None
+    ) -> Iterator[Leaf]:
+        """
+        Enumerates the scalars and bitfields of a type that overlap the byte
+        range [start, end) (by default, the whole type), in declaration order.
+        Structs and arrays are descended into; union members are all
+        enumerated.
+        """
+        base, pointer, dims = parse_type_name(type_name)
+        if end is None:
+            end = self.sizeof(base, pointer)
+            for d in dims:
+                end *= d
+        return self._leaves(base, pointer, dims, 0, start, end, "")
+
+    def _leaves(
+        self,
+        type_name: str,
+        pointer: int,
+        dims: Sequence[int],
+        base: int,
+        start: int,
+        end: int,
+        path: str,
+    ) -> Iterator[Leaf]:
+        resolved, pointer = self.resolve_typedef(type_name, pointer)
+        if dims:
+            stride = self.sizeof(resolved, pointer)
+            for d in dims[1:]:
+                stride *= d
+            if stride == 0:
+                return
+            lo = max(0, (start - base) // stride)
+            hi = min(dims[0], -(-(end - base) // stride))
+            for i in range(lo, hi):
+                yield from self._leaves(
+                    resolved,
+                    pointer,
+                    dims[1:],
+                    base + i * stride,
+                    start,
+                    end,
+                    f"{path}[{i}]",
+                )
+            return
+        agg = self.aggregates.get(resolved) if not pointer else None
+        if agg is None:
+            yield Leaf(path, base, self.sizeof(resolved, pointer), resolved, pointer)
+            return
+        fields = agg.fields
+        first = 0
+        if agg.kind == "struct":
+            ends = self._field_ends.get(resolved)
+            if ends is None:
+                ends = []
+                for f in fields:
+                    f_end = (
+                        (f.bit_offset + f.bit_width + 7) // 8
+                        if f.is_bitfield()
+                        else f.offset + f.size
+                    )
+                    ends.append(max(f_end, ends[-1]) if ends else f_end)
+                self._field_ends[resolved] = ends
+            first = bisect_right(ends, start - base)
+        for f in fields[first:]:
+            f_start = base + f.offset
+            if f_start >= end:
+                if agg.kind == "struct":
+                    break
+                continue
+            f_path = f"{path}.{f.name}" if path else f.name
+            if f.is_bitfield():
+                bit = base * 8 + f.bit_offset
+                byte_end = (bit + f.bit_width + 7) // 8
+                if byte_end > start and bit // 8 < end:
+                    yield Leaf(
+                        f_path,
+                        bit // 8,
+                        byte_end - bit // 8,
+                        f.type,
+                        0,
+                        bit,
+                        f.bit_width,
+                    )
+            elif f_start + f.size > start:
+                yield from self._leaves(
+                    f.type, f.pointer, f.dims, f_start, start, end, f_path
+                )
+
+    def read_leaf(self, leaf: Leaf, buffer: Buffer, offset: int = 0) -> int:
+        """Reads a leaf from a buffer, given the offset of the enclosing type"""
+        if leaf.bit_width is None:
+            return self.read(
+                leaf.type, leaf.pointer, (), buffer, offset + leaf.offset, leaf.size
+            )
+        return self._read_bits(
+            leaf.type, leaf.bit_offset, leaf.bit_width, buffer, offset
+        )
+
+    def leaf(self, type_name: str, path: str) -> Leaf:
+        """
+        Resolves a field path to a single scalar or bitfield, relative to the
+        given type.
+        """
+        try:
+            offset, t, pointer, dims = self.resolve_path(type_name, path)
+        except ValueError:
+            # Maybe a bitfield: find it among the leaves of its parent
+            m = re.fullmatch(r"(.*?)\.?(\w+)", path)
+            parent, name = m.groups() if m else ("", path)
+            offset, t, pointer, dims = (
+                self.resolve_path(type_name, parent)
+                if parent
+                else (0, type_name, 0, ())
+            )
+            if not pointer and not dims:
+                for leaf in self.leaves(t):
+                    if leaf.path == name and leaf.bit_width is not None:
+                        return leaf._replace(
+                            path=path,
+                            offset=offset + leaf.offset,
+                            bit_offset=offset * 8 + leaf.bit_offset,
+                        )
+            raise
+        if dims or (not pointer and self.resolve_typedef(t)[0] in self.aggregates):
+            raise ValueError(f"'{path}' is not a scalar field")
+        return Leaf(path, offset, self.sizeof(t, pointer), t, pointer)
+
+    def view(self, type_name: str, buffer: Buffer, offset: int = 0) -> "View":
+        """Creates a view of a struct or union over a buffer"""
+        type_name, _ = self.resolve_typedef(type_name)
+        return View(self, self.aggregates[type_name], buffer, offset)
+
+    def resolve_path(self, type_name: str, path: str) -> Tuple[int, str, int, Tuple]:
+        """
+        Resolves a field path like `gen_info.tiles[3][4].room` relative to the
+        given type. Returns (offset, type, pointer, remaining array dims).
+        Bitfields are not supported as path targets.
+        """
+        offset = 0
+        pointer = 0
+        dims: Tuple[int, ...] = ()
+        for part in re.findall(r"\.?(\w+)|\[(\d+)\]", path):
+            name, index = part
+            if name:
+                if dims or pointer:
+                    raise ValueError(f"cannot access member '{name}' of {type_name}")
+                agg = self.aggregates.get(self.resolve_typedef(type_name)[0])
+                field = agg.fields_by_name.get(name) if agg is not None else None
+                if field is None:
+                    raise ValueError(f"{type_name} has no member '{name}'")
+                if field.is_bitfield():
+                    raise ValueError(f"cannot resolve path to bitfield '{name}'")
+                offset += field.offset
+                type_name, pointer, dims = field.type, field.pointer, field.dims
+            else:
+                if not dims:
+                    raise ValueError(f"cannot index non-array type {type_name}")
+                stride = self.sizeof(type_name, pointer)
+                for d in dims[1:]:
+                    stride *= d
+                if int(index) >= dims[0]:
+                    raise IndexError(f"index {index} out of range for {dims[0]}")
+                offset += int(index) * stride
+                dims = dims[1:]
+        return offset, type_name, pointer, dims
+
+
+class View:
+    """
+    A zero-copy view of a struct or union within a buffer. Members are
+    accessible as attributes or by name with [].
+    """
+
+    __slots__ = ("_layouts", "_aggregate", "_buffer", "_offset")
+
+    def __init__(
+        self, layouts: Layouts, aggregate: Aggregate, buffer: Buffer, offset: int = 0
+    ):
+        if offset < 0 or offset + aggregate.size > len(buffer):
+            raise ValueError(
+                f"{aggregate.name} at offset {offset:#x} does not fit in buffer"
+            )
+        self._layouts = layouts
+        self._aggregate = aggregate
+        self._buffer = buffer
+        self._offset = offset
+
+    @property
+    def type(self) -> Aggregate:
+        return self._aggregate
+
+    @property
+    def offset(self) -> int:
+        return self._offset
+
+    def raw(self) -> memoryview:
+        """The raw bytes of the struct, without copying"""
+        return memoryview(self._buffer)[self._offset : self._offset + len(self)]
+
+    def __len__(self) -> int:
+        return self._aggregate.size
+
+    def __getattr__(self, name: str) -> Any:
+        field = self._aggregate.fields_by_name.get(name)
+        if field is None:
+            raise AttributeError(f"{self._aggregate.name} has no member '{name}'")
+        return self._layouts.read_field(field, self._buffer, self._offset)
+
+    def __getitem__(self, name: str) -> Any:
+        try:
+            return self.__getattr__(name)
+        except AttributeError as e:
+            raise KeyError(name) from e
+
+    def __dir__(self) -> List[str]:
+        return [f.name for f in self._aggregate.fields]
+
+    def to_dict(self) -> Dict[str, Any]:
+        """Recursively decodes the struct into plain Python objects"""
+        return {
+            f.name: _to_python(getattr(self, f.name)) for f in self._aggregate.fields
+        }
+
+    def __repr__(self) -> str:
+        return f"<{self._aggregate.name} at {self._offset:#x}>"
+
+
+class ArrayView(Sequence):
+    """A zero-copy view of an array within a buffer"""
+
+    def __init__(
+        self,
+        layouts: Layouts,
+        type_name: str,
+        pointer: int,
+        dims: Tuple[int, ...],
+        buffer: Buffer,
+        offset: int,
+    ):
+        self._layouts = layouts
+        self._type = type_name
+        self._pointer = pointer
+        self._dims = dims
+        self._buffer = buffer
+        self._offset = offset
+        self._element_size = layouts.sizeof(
+            layouts.resolve_typedef(type_name)[0], pointer
+        )
+        self._stride = self._element_size
+        for d in dims[1:]:
+            self._stride *= d
+
+    @property
+    def offset(self) -> int:
+        return self._offset
+
+    @property
+    def stride(self) -> int:
+        return self._stride
+
+    def __len__(self) -> int:
+        return self._dims[0]
+
+    def __getitem__(self, index):
+        if isinstance(index, slice):
+            return [self[i] for i in range(*index.indices(len(self)))]
+        if index < 0:
+            index += len(self)
+        if not 0 <= index < len(self):
+            raise IndexError("array index out of range")
+        return self._layouts.read(
+            self._type,
+            self._pointer,
+            self._dims[1:],
+            self._buffer,
+            self._offset + index * self._stride,
+            self._element_size,
+        )
+
+    def __repr__(self) -> str:
+        dims = "".join(f"[{d}]" for d in self._dims)
+        return f"<{self._type}{'*' * self._pointer}{dims} at {self._offset:#x}>"
+
+
+def _to_python(value: Any) -> Any:
+    if isinstance(value, View):
+        return value.to_dict()
+    if isinstance(value, ArrayView):
+        return [_to_python(v) for v in value]
+    return value
+
+
+class RamDump:
+    """
+    A memory-mapped dump of main memory, for reading globals with views.
+    """
+
+    def __init__(self, path: str, layouts: Layouts, version: str = "NA"):
+        self.layouts = layouts
+        self.version = version
+        self.mapped = offsets.MappedBinary(path)
+        self.mapped.binary = RAM
+        self._addresses: Optional[Dict[str, int]] = None
+
+    def __enter__(self) -> "RamDump":
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    def close(self):
+        self.mapped.close()
+
+    @property
+    def contents(self):
+        return self.mapped.contents
+
+    def address_of(self, name: str) -> int:
+        """Looks up the address of a RAM global in the symbol table"""
+        if self._addresses is None:
+            self._addresses = load_ram_addresses(self.version)
+        if name not in self._addresses:
+            raise KeyError(f"no {self.version} address for '{name}' in ram.yml")
+        return self._addresses[name]
+
+    def view_at(self, type_name: str, address: int) -> View:
+        """Creates a view of a struct or union at an absolute address"""
+        return self.layouts.view(
+            type_name, self.mapped.contents, self.mapped.relative(address)
+        )
+
+    def global_view(self, name: str) -> Any:
+        """
+        Reads a global declared in `headers/data/ram.h` (e.g., DUNGEON_STRUCT).
+        """
+        g = self.layouts.globals.get(name)
+        if g is None or g.binary != "ram":
+            raise KeyError(f"'{name}' is not declared in data/ram.h")
+        if None in g.dims:
+            raise ValueError(f"'{name}' has an unspecified array length")
+        return self.layouts.read(
+            g.type,
+            g.pointer,
+            g.dims,
+            self.mapped.contents,
+            self.mapped.relative(self.address_of(name)),
+        )
+
+
+def load_data_symbols(binary: str) -> Dict[str, Dict[str, Any]]:
+    """Loads all the data symbols of a binary from its symbol table"""
+    with open(SYMBOL_DIR / f"{binary}.yml", "r") as f:
+        symbols = yaml.load(f, Loader=YamlLoader)
+    return {
+        sym["name"]: sym for block in symbols.values() for sym in block.get("data", [])
+    }
+
+
+def symbol_address(sym: Dict[str, Any], version: str) -> Optional[int]:
+    """Gets the (first) address of a symbol for a given version, if known"""
+    addr = sym.get("address", {}).get(version)
+    if isinstance(addr, list):
+        addr = addr[0]
+    return addr
+
+
+def symbol_type(sym: Dict[str, Any]) -> Optional[str]:
+    """Gets the type of a data symbol from its description, if specified"""
+    m = re.search(r"^type: (.+)$", sym.get("description") or "", re.MULTILINE)
+    return m.group(1).strip() if m else None
+
+
+def load_ram_addresses(version: str) -> Dict[str, int]:
+    """Loads the addresses of all RAM data symbols for a given version"""
+    addresses = {}
+    for name, sym in load_data_symbols("ram").items():
+        addr = symbol_address(sym, version)
+        if addr is not None:
+            addresses[name] = addr
+    return addresses
+
+
+class BinaryData:
+    """
+    Typed access to the data symbols in binaries extracted from a ROM (e.g.,
+    arm9.bin and the overlays), located using the symbol tables.
+    """
+
+    def __init__(
+        self, data_dir: str, layouts: Optional[Layouts] = None, version: str = "NA"
+    ):
+        self.layouts = layouts
+        self.version = version
+        self.files = offsets.find_binary_files(data_dir, offsets.BINARY_NAMES)
+        self._mapped: Dict[str, offsets.MappedBinary] = {}
+        self._symbols: Dict[str, Dict[str, Dict[str, Any]]] = {}
+
+    def __enter__(self) -> "BinaryData":
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    def close(self):
+        for mapped in self._mapped.values():
+            mapped.close()
+        self._mapped.clear()
+
+    def symbol(self, binary: str, name: str) -> Dict[str, Any]:
+        if binary not in self._symbols:
+            self._symbols[binary] = load_data_symbols(binary)
+        if name not in self._symbols[binary]:
+            raise KeyError(f"no data symbol '{name}' in {binary}")
+        return self._symbols[binary][name]
+
+    def has(self, binary: str, name: str) -> bool:
+        """Whether a symbol can be read for this version and data directory"""
+        return (
+            binary in self.files
+            and symbol_address(self.symbol(binary, name), self.version) is not None
+        )
+
+    def _locate(self, binary: str, name: str) -> Tuple[offsets.MappedBinary, int, int]:
+        sym = self.symbol(binary, name)
+        addr = symbol_address(sym, self.version)
+        if addr is None:
+            raise KeyError(f"no {self.version} address for '{name}' in {binary}")
+        if binary not in self.files:
+            raise FileNotFoundError(f"{binary} binary not found in data directory")
+        if binary not in self._mapped:
+            self._mapped[binary] = offsets.MappedBinary(
+                self.files[binary], self.version, binary
+            )
+        mapped = self._mapped[binary]
+        length = sym.get("length", {}).get(self.version)
+        return mapped, mapped.relative(addr), length
+
+    def raw(self, binary: str, name: str) -> bytes:
+        """Reads the raw bytes of a data symbol"""
+        mapped, offset, length = self._locate(binary, name)
+        if length is None:
+            raise ValueError(f"no {self.version} length for '{name}' in {binary}")
+        return mapped.contents[offset : offset + length]
+
+    def read_int(self, binary: str, name: str, signed: bool = True) -> int:
+        """Reads a data symbol as a little-endian integer of the symbol length"""
+        return int.from_bytes(self.raw(binary, name), "little", signed=signed)
+
+    def read(self, binary: str, name: str, type_name: Optional[str] = None) -> Any:
+        """
+        Reads a data symbol as the given type, or the type specified in its
+        description. Structs and arrays are returned as zero-copy views.
+        """
+        if self.layouts is None:
+            raise ValueError("layouts are required for typed reads")
+        type_name = type_name or symbol_type(self.symbol(binary, name))
+        if type_name is None:
+            raise ValueError(f"no type specified for '{name}' in {binary}")
+        base, pointer, dims = parse_type_name(type_name)
+        mapped, offset, _ = self._locate(binary, name)
+        return self.layouts.read(base, pointer, dims, mapped.contents, offset)
+
+
+def format_value(layouts: Layouts, value: Any, type_name: str, indent: int = 0) -> str:
+    pad = "  " * indent
+    if isinstance(value, View):
+        lines = []
+        for f in value.type.fields:
+            v = getattr(value, f.name)
+            if isinstance(v, (View, ArrayView)):
+                lines.append(f"{pad}{f.name}:")
+                lines.append(format_value(layouts, v, f.type, indent + 1))
+            else:
+                lines.append(f"{pad}{f.name}: {format_value(layouts, v, f.type)}")
+        return "\n".join(lines)
+    if isinstance(value, ArrayView):
+        lines = []
+        for i, v in enumerate(value):
+            if isinstance(v, (View, ArrayView)):
+                lines.append(f"{pad}[{i}]:")
+                lines.append(format_value(layouts, v, type_name, indent + 1))
+            else:
+                lines.append(f"{pad}[{i}]: {format_value(layouts, v, type_name)}")
+        return "\n".join(lines)
+    name = layouts.enum_name(layouts.resolve_typedef(type_name)[0], value)
+    return f"{value} ({name})" if name is not None else str(value)
+
+
+def print_layout(layouts: Layouts, type_name: str, path: Optional[str]):
+    if path:
+        offset, t, pointer, dims = layouts.resolve_path(type_name, path)
+        dims_str = "".join(f"[{d}]" for d in dims)
+        size = layouts.sizeof(layouts.resolve_typedef(t)[0], pointer)
+        for d in dims:
+            size *= d
+        print(f"{path}: {t}{'*' * pointer}{dims_str} @ {offset:#x} (size {size:#x})")
+        if pointer or dims:
+            return
+        type_name = t
+    agg = layouts.aggregates.get(layouts.resolve_typedef(type_name)[0])
+    if agg is None:
+        return
+    print(f"{agg.name} (size {agg.size:#x})")
+    for f in agg.fields:
+        dims_str = "".join(f"[{d}]" for d in f.dims)
+        decl = f"{f.type}{'*' * f.pointer} {f.name}{dims_str}"
+        if f.is_bitfield():
+            bit = f.bit_offset % 8
+            print(f"  {f.offset:#06x}.{bit}  {decl} : {f.bit_width}")
+        else:
+            print(f"  {f.offset:#06x}    {decl} (size {f.size:#x})")
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(
+        description="Resolve struct layouts from the C headers and read typed values"
+    )
+    parser.add_argument(
+        "target",
+        nargs="?",
+        help="type name (e.g., 'struct tile'), or with -d, the name of a RAM global",
+    )
+    parser.add_argument(
+        "-p", "--path", help="field path within the target, e.g., gen_info.tiles[0][1]"
+    )
+    parser.add_argument("-d", "--dump", help="RAM dump file to read values from")
+    parser.add_argument(
+        "-v",
+        "--version",
+        choices=["NA", "EU", "JP"],
+        default="NA",
+        help="game version of the RAM dump",
+    )
+    parser.add_argument(
+        "-l",
+        "--layouts",
+        help="load previously emitted layout tables instead of the headers",
+    )
+    parser.add_argument(
+        "-e",
+        "--emit",
+        action="append",
+        default=[],
+        help="write the layout tables to a file (.json for JSON, otherwise binary)",
+    )
+    args = parser.parse_args()
+
+    if args.target is None and not args.emit:
+        parser.error("a target is required unless emitting layout tables")
+
+    layouts = Layouts.load(args.layouts) if args.layouts else Layouts.from_headers()
+    for path in args.emit:
+        layouts.save(path)
+    if args.target is None:
+        sys.exit(0)
+    if args.dump is None:
+        if layouts.resolve_typedef(args.target)[0] not in layouts.aggregates:
+            sys.exit(f"Unknown struct or union: '{args.target}'")
+        print_layout(layouts, args.target, args.path)
+    else:
+        with RamDump(args.dump, layouts, args.version) as dump:
+            g = layouts.globals.get(args.target)
+            if g is None or g.binary != "ram":
+                sys.exit(f"Unknown RAM global: '{args.target}'")
+            value = dump.global_view(args.target)
+            type_name = g.type
+            if args.path:
+                if not isinstance(value, View):
+                    sys.exit("Field paths are only supported for struct globals")
+                offset, type_name, pointer, dims = layouts.resolve_path(
+                    g.type, args.path
+                )
+                value = layouts.read(
+                    type_name,
+                    pointer,
+                    dims,
+                    dump.contents,
+                    value.offset + offset,
+                )
+            print(format_value(layouts, value, type_name))
@@ -0,0 +1,706 @@
+#!/usr/bin/env python3
+
+"""
+`mem_arena.py` is a command line utility and Python module that replays heap
+allocation traces against a host reimplementation of the memory allocator in
+arm9 (`MemAlloc`, `MemFree`, `MemArenaAlloc`, `FindAvailableMemBlock`,
+`SplitMemBlock`), to check offline whether a sequence of allocations (like
+entering a dungeon with extra assets loaded) will exhaust a memory arena.
+
+The allocator model follows the symbol tables and `struct mem_arena`,
+`struct mem_block` and `enum memory_alloc_flag` in the C headers:
+- An arena starts with one vacant block spanning its whole length.
+- To allocate, blocks that aren't reserved (MEM_IN_USE) are searched in
+  reverse order. For object allocations, the block with the smallest amount
+  of free space that still suffices is chosen (on ties, the last one); for
+  arena allocations, the first suitable block found is chosen.
+- A new block of the requested size (rounded up to a multiple of 4) is split
+  off from the end of the chosen block's free space and inserted after it.
+  This fails if the arena already holds `max_blocks` blocks.
+- To free, the block is emptied, merged with the following block if that one
+  is vacant, then merged into the preceding block if that one isn't reserved.
+- MemArenaAlloc reserves a block large enough for the new arena, its
+  `struct mem_arena` metadata and its block array.
+
+The search order and split behavior are documented; the exact tie-breaking,
+merging rules, and arena metadata overhead are inferred from the
+descriptions and may differ from the game in edge cases. Traces that include
+the pointers returned by the game can be replayed with `--check` to detect
+the first point where the model diverges from the game.
+
+A trace is a text file with one allocator call per line (numbers can be
+decimal or 0x-prefixed hex; `#` starts a comment):
+    alloc LEN FLAGS [@ARENA] [=PTR]                 MemAlloc / MemLocateSet
+    arena LEN MAX_BLOCKS FLAGS [@PARENT] [=PTR]     MemArenaAlloc
+    free PTR [@ARENA]                               MemFree / MemLocateUnset
+FLAGS are the user flags passed to MemAlloc (see struct mem_block). @ARENA
+selects an arena by the pointer returned by an earlier `arena` call (by
+default, the default arena is used). =PTR is the pointer returned by the
+game, which is used to resolve later `free` calls and `@ARENA` references.
+
+The initial heap is either read from a RAM dump (the arenas in
+MEMORY_ALLOCATION_TABLE, including all existing blocks), or a fresh default
+arena with the given size and block limit.
+
+Free blocks can be looked up either with a linear search like the game
+(`linear`), or with an index of free blocks sorted by size (`indexed`),
+which returns the same blocks. `--compare` replays the trace in both modes
+and reports the timings. `test_mem_arena.py` checks that both modes build the
+same heaps.
+
+Example usage:
+python3 mem_arena.py trace.txt
+python3 mem_arena.py -d ram.bin --check trace.txt
+python3 mem_arena.py -m indexed --size 0x1E6400 --max-blocks 256 trace.txt
+python3 mem_arena.py --compare -d ram.bin trace.txt
+"""
+
+import argparse
+from bisect import bisect_left, bisect_right, insort
+import struct
+import sys
+import time
+from typing import Dict, Iterable, List, NamedTuple, Optional, Tuple
+
+# enum memory_alloc_flag, as bitflags
+MEM_IN_USE = 1 << 0
+MEM_OBJECT = 1 << 1
+MEM_ARENA = 1 << 2
+MEM_SUBARENA = 1 << 3
+
+SIZEOF_MEM_ARENA = 28
+SIZEOF_MEM_BLOCK = 24
+
+# DEFAULT_MEMORY_ARENA_SIZE and the length of DEFAULT_MEMORY_ARENA_BLOCKS
+DEFAULT_ARENA_SIZE = 1991680
+DEFAULT_MAX_BLOCKS = 256
+
+
+def round_up4(n: int) -> int:
+    return (n + 3) & ~3
+
+
+def alloc_flags_to_block_type(alloc_flags: int) -> int:
+    """
+    MemAllocFlagsToBlockType: converts internal alloc flags to block content
+    flags. Arena allocations are reserved, while subarenas are not (so that
+    blocks can be carved out of them).
+    """
+    block_type = alloc_flags & MEM_OBJECT
+    if alloc_flags & (MEM_ARENA | MEM_SUBARENA):
+        block_type |= MEM_ARENA
+    if alloc_flags & MEM_IN_USE and not alloc_flags & MEM_SUBARENA:
+        block_type |= MEM_IN_USE
+    return block_type
+
+
+class Block:
+    """A memory block (struct mem_block)"""
+
+    __slots__ = (
+        "content_flags",
+        "alloc_flags",
+        "user_flags",
+        "data",
+        "available",
+        "used",
+    )
+
+    def __init__(
+        self,
+        content_flags: int,
+        alloc_flags: int,
+        user_flags: int,
+        data: int,
+        available: int,
+        used: int,
+    ):
+        self.content_flags = content_flags
+        self.alloc_flags = alloc_flags
+        self.user_flags = user_flags
+        self.data = data
+        self.available = available
+        self.used = used
+
+    @property
+    def in_use(self) -> bool:
+        return bool(self.content_flags & MEM_IN_USE)
+
+    @property
+    def vacant(self) -> bool:
+        return not self.in_use and self.used == 0
+
+    def __repr__(self) -> str:
+        return (
+            f"Block(data={self.data:#x}, used={self.used:#x}, "
+            + f"available={self.available:#x}, flags={self.content_flags:#x})"
+        )
+
+
+class AllocError(Exception):
+    """An allocation that would hang the game"""
+
+
+class Arena:
+    """
+    A memory arena (struct mem_arena). Blocks are kept sorted by address,
+    which is also their order in the game's block array.
+    """
+
+    def __init__(
+        self,
+        address: int,
+        data: int,
+        length: int,
+        max_blocks: int,
+        parent: Optional["Arena"] = None,
+        indexed: bool = False,
+        blocks: Optional[List[Block]] = None,
+    ):
+        self.address = address
+        self.data = data
+        self.len = length
+        self.max_blocks = max_blocks
+        self.parent = parent
+        self.indexed = indexed
+        if blocks is None:
+            blocks = [Block(0, 0, 0, data, length, 0)]
+        self.blocks = blocks
+        self._addrs = [b.data for b in blocks]
+        # Non-reserved blocks as (available, -data), for the indexed search
+        self._free_index: List[Tuple[int, int]] = []
+        if indexed:
+            self._free_index = sorted(
+                (b.available, -b.data) for b in blocks if not b.in_use
+            )
+        # Total free space in non-reserved blocks
+        self.free_bytes = sum(b.available for b in blocks if not b.in_use)
+        self.peak_used = self.used
+        self.peak_blocks = len(blocks)
+
+    @property
+    def n_blocks(self) -> int:
+        return len(self.blocks)
+
+    @property
+    def used(self) -> int:
+        return self.len - self.free_bytes
+
+    def free_blocks(self) -> List[int]:
+        """Sizes of the free space available in each non-reserved block"""
+        return [b.available for b in self.blocks if not b.in_use and b.available]
+
+    def fragmentation(self) -> float:
+        """1 - (largest free block / total free space)"""
+        free = self.free_blocks()
+        return 1 - max(free) / sum(free) if free else 0.0
+
+    def _unindex(self, block: Block):
+        if self.indexed and not block.in_use:
+            del self._free_index[
+                bisect_left(self._free_index, (block.available, -block.data))
+            ]
+
+    def _index(self, block: Block):
+        if self.indexed and not block.in_use:
+            insort(self._free_index, (block.available, -block.data))
+
+    def _indices_at(self, ptr: int) -> range:
+        """
+        Indices of the blocks with the given data address. There can be more
+        than one: splitting off all the free space of a vacant block leaves
+        it empty, with the same address as the new block after it.
+        """
+        start = bisect_left(self._addrs, ptr)
+        return range(start, bisect_right(self._addrs, ptr, lo=start))
+
+    def index_of(self, ptr: int) -> int:
+        """The index of the block allocated at ptr, or -1"""
+        indices = self._indices_at(ptr)
+        if not indices:
+            return -1
+        # Empty vacant blocks always precede the block split off from them
+        for i in reversed(indices):
+            if not self.blocks[i].vacant:
+                return i
+        return indices[-1]
+
+    def find_available(self, alloc_flags: int, size: int) -> int:
+        """FindAvailableMemBlock: the index of a suitable block, or -1"""
+        if self.indexed:
+            return self._find_indexed(alloc_flags, size)
+        return self._find_linear(alloc_flags, size)
+
+    def _find_linear(self, alloc_flags: int, size: int) -> int:
+        best = -1
+        best_available = 0
+        for i in range(len(self.blocks) - 1, -1, -1):
+            b = self.blocks[i]
+            if b.in_use or b.available < size:
+                continue
+            if alloc_flags & MEM_ARENA:
+                return i
+            if best < 0 or b.available < best_available:
+                best = i
+                best_available = b.available
+        return best
+
+    def _find_indexed(self, alloc_flags: int, size: int) -> int:
+        start = bisect_left(self._free_index, (size, -(1 << 32)))
+        if start == len(self._free_index):
+            return -1
+        if alloc_flags & MEM_ARENA:
+            # First fit in reverse order is the highest suitable address
+            neg = min(neg for _, neg in self._free_index[start:])
+            fits = lambda b: b.available >= size
+        else:
+            available, neg = self._free_index[start]
+            fits = lambda b: b.available == available
+        # Resolve the entry to its block rather than just its address, since
+        # an empty vacant block can share the address. Like the linear search,
+        # prefer the last block.
+        for i in reversed(self._indices_at(-neg)):
+            if not self.blocks[i].in_use and fits(self.blocks[i]):
+                return i
+        return -1
+
+    def split(self, index: int, alloc_flags: int, size: int, user_flags: int) -> Block:
+        """SplitMemBlock: splits a new block off the end of a block's free space"""
+        if len(self.blocks) >= self.max_blocks:
+            raise AllocError(
+                f"arena {self.address:#x} is out of blocks ({self.max_blocks})"
+            )
+        parent = self.blocks[index]
+        self._unindex(parent)
+        parent.available -= size
+        self._index(parent)
+        self.free_bytes -= size
+        block = Block(
+            alloc_flags_to_block_type(alloc_flags),
+            alloc_flags,
+            user_flags,
+            parent.data + parent.used + parent.available,
+            0,
+            size,
+        )
+        if alloc_flags & MEM_SUBARENA:
+            # Subarenas stay available for carving out blocks
+            block.available, block.used = size, 0
+            self.free_bytes += size
+        self.blocks.insert(index + 1, block)
+        self._addrs.insert(index + 1, block.data)
+        self._index(block)
+        self.peak_blocks = max(self.peak_blocks, len(self.blocks))
+        return block
+
+    def alloc(self, length: int, user_flags: int) -> Block:
+        """MemLocateSet within this arena"""
+        alloc_flags = (user_flags >> 8) & 0xF
+        size = round_up4(length)
+        index = self.find_available(alloc_flags, size)
+        if index < 0:
+            raise AllocError(
+                f"arena {self.address:#x} has no free block of {size:#x} bytes "
+                + f"(largest: {max(self.free_blocks(), default=0):#x})"
+            )
+        block = self.split(index, alloc_flags, size, user_flags & 0xFFF)
+        self.peak_used = max(self.peak_used, self.used)
+        return block
+
+    def free(self, ptr: int) -> bool:
+        """MemLocateUnset within this arena. Returns whether ptr was found."""
+        i = self.index_of(ptr)
+        if i < 0:
+            return False
+        block = self.blocks[i]
+        self._unindex(block)
+        self.free_bytes += block.used + (block.available if block.in_use else 0)
+        block.available += block.used
+        block.used = 0
+        block.content_flags = block.alloc_flags = block.user_flags = 0
+        if i + 1 < len(self.blocks) and self.blocks[i + 1].vacant:
+            nxt = self.blocks[i + 1]
+            self._unindex(nxt)
+            block.available += nxt.available
+            del self.blocks[i + 1]
+            del self._addrs[i + 1]
+        if i > 0 and not self.blocks[i - 1].in_use:
+            prev = self.blocks[i - 1]
+            self._unindex(prev)
+            prev.available += block.available
+            del self.blocks[i]
+            del self._addrs[i]
+            self._index(prev)
+        else:
+            self._index(block)
+        return True
+
+
+class Event(NamedTuple):
+    line: int
+    op: str  # "alloc", "arena" or "free"
+    args: Tuple[int, ...]
+    arena: Optional[int]  # trace pointer of the arena, or None for the default
+    ptr: Optional[int]  # pointer returned (or freed) by the game
+
+
+def parse_trace(path: str) -> List[Event]:
+    with open(path, "r") as f:
+        return parse_trace_lines(f, path)
+
+
+def parse_trace_lines(lines: Iterable[str], path: str = "<trace>") -> List[Event]:
+    n_args = {"alloc": 2, "arena": 3, "free": 1}
+    events = []
+    for lineno, line in enumerate(lines, 1):
+        tokens = line.split("#", 1)[0].split()
+        if not tokens:
+            continue
+        op = tokens[0]
+        if op not in n_args:
+            raise ValueError(f"{path}:{lineno}: unknown operation '{op}'")
+        args = []
+        arena = ptr = None
+        try:
+            for tok in tokens[1:]:
+                if tok.startswith("@"):
+                    arena = int(tok[1:], 0)
+                elif tok.startswith("="):
+                    ptr = int(tok[1:], 0)
+                else:
+                    args.append(int(tok, 0))
+        except ValueError:
+            raise ValueError(f"{path}:{lineno}: invalid number in '{line.strip()}'")
+        if op == "free":
+            if ptr is not None or len(args) != 1:
+                raise ValueError(f"{path}:{lineno}: expected 'free PTR [@ARENA]'")
+            ptr = args.pop()
+        elif len(args) != n_args[op]:
+            raise ValueError(
+                f"{path}:{lineno}: expected {n_args[op]} arguments to '{op}'"
+            )
+        events.append(Event(lineno, op, tuple(args), arena, ptr))
+    return events
+
+
+class ReplayError(Exception):
+    def __init__(self, event: Event, message: str):
+        super().__init__(f"line {event.line}: {message}")
+        self.event = event
+
+
+class Heap:
+    """All global memory arenas, plus the allocations made during a replay"""
+
+    def __init__(self, arenas: List[Arena], default: Arena):
+        self.arenas = arenas
+        self.default = default
+        # Trace pointer -> (arena, simulated pointer)
+        self._allocs: Dict[int, Tuple[Arena, int]] = {}
+        # Trace arena pointer -> simulated arena
+        self._arena_refs: Dict[int, Arena] = {a.address: a for a in arenas}
+
+    @classmethod
+    def fresh(
+        cls,
+        data: int = 0,
+        length: int = DEFAULT_ARENA_SIZE,
+        max_blocks: int = DEFAULT_MAX_BLOCKS,
+        indexed: bool = False,
+    ) -> "Heap":
+        arena = Arena(0, data, length, max_blocks, indexed=indexed)
+        return cls([arena], arena)
+
+    def copy(self, indexed: bool) -> "Heap":
+        """A deep copy of the heap's arenas, with the given search mode"""
+        copies: Dict[int, Arena] = {}
+        for a in self.arenas:
+            copies[id(a)] = Arena(
+                a.address,
+                a.data,
+                a.len,
+                a.max_blocks,
+                indexed=indexed,
+                blocks=[
+                    Block(
+                        b.content_flags,
+                        b.alloc_flags,
+                        b.user_flags,
+                        b.data,
+                        b.available,
+                        b.used,
+                    )
+                    for b in a.blocks
+                ],
+            )
+        for a in self.arenas:
+            if a.parent is not None:
+                copies[id(a)].parent = copies.get(id(a.parent))
+        return Heap([copies[id(a)] for a in self.arenas], copies[id(self.default)])
+
+    def _arena(self, event: Event) -> Arena:
+        if event.arena is None:
+            return self.default
+        arena = self._arena_refs.get(event.arena)
+        if arena is None:
+            raise ReplayError(event, f"unknown arena {event.arena:#x}")
+        return arena
+
+    def _check(self, event: Event, sim_ptr: int):
+        if event.ptr is not None and event.ptr != sim_ptr:
+            raise ReplayError(
+                event,
+                f"model returned {sim_ptr:#x}, but the game returned {event.ptr:#x}",
+            )
+
+    def replay_event(self, event: Event, check: bool = False):
+        if event.op == "alloc":
+            arena = self._arena(event)
+            try:
+                block = arena.alloc(*event.args)
+            except AllocError as e:
+                raise ReplayError(event, str(e))
+            if check:
+                self._check(event, block.data)
+            self._allocs[block.data if event.ptr is None else event.ptr] = (
+                arena,
+                block.data,
+            )
+        elif event.op == "arena":
+            length, max_blocks, user_flags = event.args
+            parent = self._arena(event)
+            # The new arena's metadata and block array are stored in front of
+            # its data, within the same allocation
+            overhead = round_up4(SIZEOF_MEM_ARENA + SIZEOF_MEM_BLOCK * max_blocks)
+            size = overhead + round_up4(length)
+            try:
+                block = parent.alloc(size, user_flags | ((MEM_IN_USE | MEM_ARENA) << 8))
+            except AllocError as e:
+                raise ReplayError(event, str(e))
+            if check:
+                self._check(event, block.data)
+            arena = Arena(
+                block.data,
+                block.data + overhead,
+                round_up4(length),
+                max_blocks,
+                parent=parent,
+                indexed=parent.indexed,
+            )
+            self.arenas.append(arena)
+            ref = block.data if event.ptr is None else event.ptr
+            self._allocs[ref] = (parent, block.data)
+            self._arena_refs[ref] = arena
+        else:
+            alloc = self._allocs.pop(event.ptr, None)
+            if alloc is None:
+                # A block that already existed in the initial heap
+                candidates = (
+                    [self._arena(event)] if event.arena is not None else self.arenas
+                )
+                for arena in candidates:
+                    if arena.index_of(event.ptr) >= 0:
+                        alloc = (arena, event.ptr)
+                        break
+                else:
+                    raise ReplayError(event, f"free of unknown pointer {event.ptr:#x}")
+            arena, sim_ptr = alloc
+            if event.arena is not None and self._arena(event) is not arena:
+                raise ReplayError(event, f"{event.ptr:#x} is not in the given arena")
+            sub = self._arena_refs.pop(event.ptr, None)
+            if sub is not None:
+                self.arenas.remove(sub)
+            if not arena.free(sim_ptr):
+                raise ReplayError(event, f"no block at {sim_ptr:#x}")
+
+    def replay(
+        self, events: List[Event], check: bool = False, keep_going: bool = False
+    ) -> List[ReplayError]:
+        """
+        Replays a trace. Stops at the first error unless keep_going is set, in
+        which case failed calls are skipped. Returns the errors encountered.
+        """
+        errors = []
+        for event in events:
+            try:
+                self.replay_event(event, check)
+            except ReplayError as e:
+                errors.append(e)
+                if not keep_going:
+                    break
+        return errors
+
+
+def load_heap(dump_path: str, version: str, indexed: bool = False) -> Heap:
+    """
+    Reads the global memory arenas (MEMORY_ALLOCATION_TABLE) and all their
+    blocks from a RAM dump.
+    """
+    import layouts
+
+    lts = layouts.Layouts.from_headers()
+    assert lts.sizeof("struct mem_arena") == SIZEOF_MEM_ARENA
+    assert lts.sizeof("struct mem_block") == SIZEOF_MEM_BLOCK
+    sym = layouts.load_data_symbols("arm9/itcm")["MEMORY_ALLOCATION_TABLE"]
+    table_addr = layouts.symbol_address(sym, version)
+    if table_addr is None:
+        raise KeyError(f"no {version} address for MEMORY_ALLOCATION_TABLE")
+    default_addr = (
+        table_addr
+        + lts.aggregates["struct mem_alloc_table"]
+        .fields_by_name["default_arena"]
+        .offset
+    )
+
+    with layouts.RamDump(dump_path, lts, version) as dump:
+        table = dump.view_at("struct mem_alloc_table", table_addr)
+        addrs = [default_addr] + [
+            p for p in list(table.arenas)[: table.n_arenas] if p and p != default_addr
+        ]
+        raw: Dict[int, Tuple] = {}
+        for addr in addrs:
+            a = dump.view_at("struct mem_arena", addr)
+            start = dump.mapped.relative(a.blocks)
+            blocks = []
+            for i in range(a.n_blocks):
+                content, alloc_flags, user_flags, data, available, used = (
+                    struct.unpack_from(
+                        "<6I", dump.contents, start + i * SIZEOF_MEM_BLOCK
+                    )
+                )
+                blocks.append(
+                    Block(
+                        content & 0xF,
+                        alloc_flags & 0xF,
+                        user_flags & 0xFFF,
+                        data,
+                        available,
+                        used,
+                    )
+                )
+            blocks.sort(key=lambda b: b.data)
+            raw[addr] = (a.parent, a.data, a.len, a.max_blocks, blocks)
+
+    arenas = {
+        addr: Arena(addr, data, length, max_blocks, indexed=indexed, blocks=blocks)
+        for addr, (_, data, length, max_blocks, blocks) in raw.items()
+    }
+    for addr, (parent, *_) in raw.items():
+        arenas[addr].parent = arenas.get(parent)
+    return Heap(list(arenas.values()), arenas[default_addr])
+
+
+def print_report(heap: Heap):
+    for arena in heap.arenas:
+        free = arena.free_blocks()
+        name = "default arena" if arena is heap.default else "arena"
+        print(f"{name} {arena.address:#x}: data {arena.data:#x}, length {arena.len:#x}")
+        print(
+            f"  used: {arena.used:#x} ({100 * arena.used / arena.len:.2f}%), "
+            + f"peak {arena.peak_used:#x} ({100 * arena.peak_used / arena.len:.2f}%)"
+        )
+        print(
+            f"  blocks: {arena.n_blocks}/{arena.max_blocks}, "
+            + f"peak {arena.peak_blocks}/{arena.max_blocks}"
+        )
+        print(
+            f"  free: {sum(free):#x} in {len(free)} blocks, "
+            + f"largest {max(free, default=0):#x}, "
+            + f"fragmentation {100 * arena.fragmentation():.2f}%"
+        )
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(
+        description="Replay heap allocation traces against the memory allocator"
+    )
+    parser.add_argument("trace", help="allocation trace file")
+    parser.add_argument(
+        "-d", "--dump", help="RAM dump to read the initial memory arenas from"
+    )
+    parser.add_argument(
+        "-v",
+        "--version",
+        choices=["NA", "EU", "JP"],
+        default="NA",
+        help="game version of the RAM dump",
+    )
+    parser.add_argument(
+        "--size",
+        type=lambda x: int(x, 0),
+        default=DEFAULT_ARENA_SIZE,
+        help="length of a fresh default arena (without --dump)",
+    )
+    parser.add_argument(
+        "--max-blocks",
+        type=lambda x: int(x, 0),
+        default=DEFAULT_MAX_BLOCKS,
+        help="maximum blocks in a fresh default arena (without --dump)",
+    )
+    parser.add_argument(
+        "--base",
+        type=lambda x: int(x, 0),
+        default=0,
+        help="data address of a fresh default arena (without --dump)",
+    )
+    parser.add_argument(
+        "-m",
+        "--mode",
+        choices=["linear", "indexed"],
+        default="linear",
+        help="free block lookup mode",
+    )
+    parser.add_argument(
+        "--compare",
+        action="store_true",
+        help="replay in both lookup modes and compare the results and timings",
+    )
+    parser.add_argument(
+        "--check",
+        action="store_true",
+        help="check that the model returns the same pointers as the trace",
+    )
+    parser.add_argument(
+        "-k",
+        "--keep-going",
+        action="store_true",
+        help="skip failed allocations instead of stopping",
+    )
+    args = parser.parse_args()
+
+    events = parse_trace(args.trace)
+    if args.dump:
+        initial = load_heap(args.dump, args.version)
+    else:
+        initial = Heap.fresh(args.base, args.size, args.max_blocks)
+
+    modes = ["linear", "indexed"] if args.compare else [args.mode]
+    results = {}
+    for mode in modes:
+        heap = initial.copy(indexed=mode == "indexed")
+        start = time.perf_counter()
+        errors = heap.replay(events, args.check, args.keep_going)
+        elapsed = time.perf_counter() - start
+        results[mode] = (heap, errors)
+        if args.compare:
+            print(f"{mode}: {len(events)} calls in {elapsed:.3f} s")
+
+    heap, errors = results[modes[0]]
+    if args.compare:
+        other, other_errors = results[modes[1]]
+        layout = [
+            [(b.data, b.used, b.available) for b in a.blocks] for a in heap.arenas
+        ]
+        other_layout = [
+            [(b.data, b.used, b.available) for b in a.blocks] for a in other.arenas
+        ]
+        if layout != other_layout or [str(e) for e in errors] != [
+            str(e) for e in other_errors
+        ]:
+            print("Lookup modes produced different heaps", file=sys.stderr)
+            sys.exit(2)
+    print_report(heap)
+    for e in errors:
+        print(f"Error: {e}", file=sys.stderr)
+    if errors:
+        sys.exit(1)
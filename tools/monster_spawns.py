@@ -0,0 +1,424 @@
+#!/usr/bin/env python3
+
+"""
+`monster_spawns.py` is a command line utility and Python module for computing
+the probability of each monster spawning on a dungeon floor from the floor's
+spawn list.
+
+Spawn lists are arrays of `struct monster_spawn_entry`, in which the spawn
+weights are incremental: each entry's weight is the running total of the
+weights of all entries up to and including it, for normal spawns and for
+Monster House spawns separately. An entry whose incremental weight is the
+same as the previous entry's can't spawn.
+
+Spawn lists can be read from:
+    - A RAM dump taken on a floor, from DUNGEON_STRUCT (`spawn_entries` and
+      `monster_spawn_entries_length`). This is the list the game actually
+      picks from (see IsOnMonsterSpawnList): at most 14 species, plus
+      Kecleon and the dummy monster.
+    - The mappa_s.bin file in an extracted ROM (BALANCE/mappa_s.bin), for
+      any dungeon and floor. These are the raw lists, before the game chooses
+      species for the floor: if a raw list holds more than 14 species, not
+      all of them will appear together on one floor. The report flags these
+      lists.
+
+mappa_s.bin is indexed by dungeon group (`enum dungeon_group_id`) and floor
+within the group, not by dungeon ID. With `--rom`, dungeon IDs and floors
+are converted like GetDungeonGroup, GetNbPrecedingFloors and
+DungeonFloorToGroupFloor: the group is
+dungeon_data_list_entry::dungeon_data_index_mappa_s and the group floor is
+the floor plus dungeon_data_list_entry::n_preceding_floors_group, read from
+DUNGEON_DATA_LIST in arm9.bin. Dungeons from DUNGEON_NORMAL_FLY_MAZE on map
+to DGROUP_MAROWAK_DOJO with no preceding floors. (DungeonFloorToGroupFloor
+also hardcodes the result for some dungeons, such as the dojo mazes; these
+special cases aren't documented and aren't modeled.) With `--mappa` alone,
+`-d` and `-f` are a dungeon group and group floors.
+
+Spawn thresholds (GetSpawnThreshold, checked against SCENARIO_BALANCE_FLAG
+by CheckSpawnThreshold) and NeedsItemToSpawn are not applied to lists read
+from mappa_s.bin: both depend on per-monster data that isn't covered by the
+headers, and on the story progress of a save. Lists from a RAM dump have
+already been filtered by the game.
+
+The mappa_s.bin layout (a SIR0 file, see `sir0.py`) follows the community
+documentation and is unverified: the content is a header of 5 pointers (the
+dungeon group table, the floor layout table, and the item, monster and trap
+spawn list tables). The group table holds a pointer to each group's list of
+floors, each floor being 9 uint16_t indexes into the other tables (layout,
+monster list, trap list, then the item lists); each group's floor list
+starts with an unused entry, so floor N is at index N. Monster spawn lists
+are terminated by an entry with a monster ID of 0.
+
+The probability of an entry is its own weight (the difference between its
+incremental weight and the previous entry's) over the highest incremental
+weight in the list. This assumes that spawn selection (GetMonsterIdToSpawn)
+draws uniformly below the total weight and picks the first entry whose
+incremental weight exceeds the draw, which isn't documented in the symbol
+tables yet.
+
+Example usage:
+python3 monster_spawns.py -l layouts.bin --dump ram.bin
+python3 monster_spawns.py --rom rom -d DUNGEON_MT_BRISTLE -f 1-5
+python3 monster_spawns.py --mappa BALANCE/mappa_s.bin -d DGROUP_MT_BRISTLE -f 1-5
+python3 monster_spawns.py --dump ram.bin --monster-house
+"""
+
+import argparse
+from fractions import Fraction
+from pathlib import Path
+import struct
+import sys
+from typing import Dict, List, NamedTuple, Optional, Sequence, Tuple
+
+from layouts import BinaryData, Layouts, RamDump
+from sir0 import Sir0File
+
+ENTRY_LEN = 8  # sizeof(struct monster_spawn_entry)
+FLOOR_ENTRY_LEN = 18
+# The game picks at most this many species for a floor, then adds Kecleon and
+# the dummy monster
+MAX_FLOOR_SPECIES = 14
+MAPPA_PATH = "BALANCE/mappa_s.bin"
+
+
+class SpawnEntry(NamedTuple):
+    """A struct monster_spawn_entry"""
+
+    level_mult_512: int
+    incremental_spawn_weight: int
+    incremental_spawn_weight_monster_house: int
+    id: int
+
+    @property
+    def level(self) -> int:
+        return self.level_mult_512 >> 9
+
+    def incremental_weight(self, monster_house: bool) -> int:
+        if monster_house:
+            return self.incremental_spawn_weight_monster_house
+        return self.incremental_spawn_weight
+
+
+def parse_entries(data: bytes, count: Optional[int] = None) -> List[SpawnEntry]:
+    """
+    Parses a spawn list, either count entries long or terminated by an entry
+    with a monster ID of 0
+    """
+    entries = []
+    for fields in struct.iter_unpack("<4H", data[: len(data) // 8 * 8]):
+        if count is None and fields[3] == 0:
+            break
+        entries.append(SpawnEntry(*fields))
+        if count is not None and len(entries) == count:
+            break
+    return entries
+
+
+def cumulative_weights(entries: Sequence[SpawnEntry], monster_house: bool) -> List[int]:
+    """
+    The incremental weights of a list, made nondecreasing: GetMonsterIdToSpawn
+    is modeled as skipping entries that don't raise the running total.
+    """
+    cum = []
+    for e in entries:
+        w = e.incremental_weight(monster_house)
+        cum.append(max(w, cum[-1]) if cum else w)
+    return cum
+
+
+def spawn_distribution(
+    entries: Sequence[SpawnEntry], monster_house: bool = False
+) -> List[Tuple[SpawnEntry, Fraction]]:
+    """The exact spawn probability of each entry in a list"""
+    cum = cumulative_weights(entries, monster_house)
+    total = cum[-1] if cum else 0
+    if total == 0:
+        return [(e, Fraction(0)) for e in entries]
+    dist = []
+    prev = 0
+    for e, c in zip(entries, cum):
+        dist.append((e, Fraction(c - prev, total)))
+        prev = c
+    return dist
+
+
+class MappaFloor(NamedTuple):
+    layout: int
+    monster_list: int
+    trap_list: int
+    item_lists: Tuple[int, ...]
+
+
+class Mappa:
+    """The floor and spawn tables in mappa_s.bin, indexed by dungeon group"""
+
+    def __init__(self, path: str):
+        self._sir0 = Sir0File(path)
+        data = self._sir0.contents
+        (
+            self.group_table,
+            self.layout_table,
+            self.item_table,
+            self.monster_table,
+            self.trap_table,
+        ) = struct.unpack_from("<5I", data, self._sir0.header.content)
+        # Section starts, to find where each variable-length list ends
+        known = {
+            self._sir0.header.content,
+            self._sir0.header.pointer_list,
+            self.group_table,
+            self.layout_table,
+            self.item_table,
+            self.monster_table,
+            self.trap_table,
+        }
+        table_end = min(p for p in known if p > self.group_table)
+        self._groups = list(
+            struct.unpack_from(
+                f"<{(table_end - self.group_table) // 4}I", data, self.group_table
+            )
+        )
+        self._bounds = sorted(known | set(self._groups))
+
+    def __enter__(self) -> "Mappa":
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    def close(self):
+        self._sir0.close()
+
+    def __len__(self) -> int:
+        return len(self._groups)
+
+    def n_floors(self, group: int) -> int:
+        start = self._groups[group]
+        end = next(p for p in self._bounds if p > start)
+        return (end - start) // FLOOR_ENTRY_LEN - 1
+
+    def floor(self, group: int, floor: int) -> MappaFloor:
+        """A floor of a dungeon group, by floor number within the group"""
+        if not 1 <= floor <= self.n_floors(group):
+            raise IndexError(f"dungeon group {group} has no floor {floor}")
+        fields = struct.unpack_from(
+            "<9H",
+            self._sir0.contents,
+            self._groups[group] + floor * FLOOR_ENTRY_LEN,
+        )
+        return MappaFloor(fields[0], fields[1], fields[2], fields[3:])
+
+    def monster_list(self, index: int) -> List[SpawnEntry]:
+        offset = self._sir0.read_pointer(self.monster_table + 4 * index)
+        if offset is None:
+            return []
+        return parse_entries(self._sir0.contents[offset:])
+
+
+class GroupFloor(NamedTuple):
+    """A struct dungeon_group_and_group_floor"""
+
+    group: int
+    floor: int
+
+
+class DungeonGroups:
+    """
+    Converts dungeon IDs and floors to dungeon groups and group floors, from
+    DUNGEON_DATA_LIST
+    """
+
+    def __init__(self, data: BinaryData):
+        lts = data.layouts
+        self.first_maze = lts.enums["enum dungeon_id"]["DUNGEON_NORMAL_FLY_MAZE"]
+        self.maze_group = lts.enums["enum dungeon_group_id"]["DGROUP_MAROWAK_DOJO"]
+        self.entries = [
+            (e.n_floors, e.dungeon_data_index_mappa_s, e.n_preceding_floors_group)
+            for e in data.read("arm9", "DUNGEON_DATA_LIST")
+        ]
+
+    def n_floors(self, dungeon: int) -> Optional[int]:
+        if dungeon >= self.first_maze:
+            return None
+        return self.entries[dungeon][0]
+
+    def group(self, dungeon: int) -> int:
+        """GetDungeonGroup"""
+        if dungeon >= self.first_maze:
+            return self.maze_group
+        return self.entries[dungeon][1]
+
+    def preceding_floors(self, dungeon: int) -> int:
+        """GetNbPrecedingFloors"""
+        if dungeon >= self.first_maze:
+            return 0
+        return self.entries[dungeon][2]
+
+    def group_floor(self, dungeon: int, floor: int) -> GroupFloor:
+        """DungeonFloorToGroupFloor, without its hardcoded special cases"""
+        return GroupFloor(self.group(dungeon), floor + self.preceding_floors(dungeon))
+
+
+def find_mappa(data_dir: str) -> str:
+    """Finds mappa_s.bin in an extracted ROM"""
+    for root in (Path(data_dir), Path(data_dir) / "data"):
+        if (root / MAPPA_PATH).is_file():
+            return str(root / MAPPA_PATH)
+    raise FileNotFoundError(f"{MAPPA_PATH} not found in {data_dir}")
+
+
+def entries_from_dump(
+    path: str, layouts: Layouts, version: str = "NA"
+) -> List[SpawnEntry]:
+    """Reads the current floor's spawn list from DUNGEON_STRUCT in a RAM dump"""
+    with RamDump(path, layouts, version) as dump:
+        base = dump.mapped.relative(dump.address_of("DUNGEON_STRUCT"))
+        dungeon = dump.view_at("struct dungeon", dump.address_of("DUNGEON_STRUCT"))
+        count = dungeon.monster_spawn_entries_length
+        if not 0 <= count <= len(dungeon.spawn_entries):
+            raise ValueError(f"{path}: invalid spawn list length {count}")
+        offset = base + layouts.resolve_path("struct dungeon", "spawn_entries")[0]
+        return parse_entries(dump.contents[offset : offset + count * ENTRY_LEN], count)
+
+
+def print_report(
+    entries: Sequence[SpawnEntry],
+    names: Dict[int, str],
+    monster_house: bool,
+):
+    print(f"  {'monster':<32} {'level':>5} {'probability':>11}")
+    for e, p in spawn_distribution(entries, monster_house):
+        name = names.get(e.id, str(e.id))
+        print(f"  {name:<32} {e.level:>5} {float(p):>11.4%}")
+
+
+def parse_range(spec: str) -> List[int]:
+    lo, _, hi = spec.partition("-")
+    return list(range(int(lo, 0), int(hi or lo, 0) + 1))
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(
+        description="Compute monster spawn probabilities for dungeon floors"
+    )
+    source = parser.add_mutually_exclusive_group(required=True)
+    source.add_argument("--dump", help="RAM dump taken on a dungeon floor")
+    source.add_argument(
+        "--rom", help="extracted ROM directory, for mappa_s.bin and arm9.bin"
+    )
+    source.add_argument("--mappa", help="mappa_s.bin file from an extracted ROM")
+    parser.add_argument(
+        "-d",
+        "--dungeon",
+        help="with --rom, dungeon ID (number or enum dungeon_id name); "
+        + "with --mappa, dungeon group (number or enum dungeon_group_id name)",
+    )
+    parser.add_argument(
+        "-f",
+        "--floors",
+        help="floor or inclusive floor range (default: all); "
+        + "with --mappa, floors within the dungeon group",
+    )
+    parser.add_argument(
+        "--monster-house",
+        action="store_true",
+        help="use the Monster House spawn weights",
+    )
+    parser.add_argument(
+        "-v",
+        "--version",
+        choices=["NA", "EU", "JP"],
+        default="NA",
+        help="game version of the RAM dump or ROM",
+    )
+    parser.add_argument(
+        "-l",
+        "--layouts",
+        help="load previously emitted layout tables instead of the headers",
+    )
+    args = parser.parse_args()
+
+    if args.dungeon is None and not args.dump:
+        parser.error("--rom and --mappa require -d/--dungeon")
+
+    layouts = Layouts.load(args.layouts) if args.layouts else Layouts.from_headers()
+    names = {v: k for k, v in reversed(layouts.enums["enum monster_id"].items())}
+
+    def report(title: str, entries: List[SpawnEntry]):
+        print(title)
+        species = {e.id for e in entries}
+        if not args.dump and len(species) > MAX_FLOOR_SPECIES:
+            print(
+                f"  Note: {len(species)} species; the game only picks "
+                + f"{MAX_FLOOR_SPECIES} for a floor"
+            )
+        print_report(entries, names, args.monster_house)
+
+    if args.dump:
+        report(f"{args.dump}:", entries_from_dump(args.dump, layouts, args.version))
+        sys.exit(0)
+
+    def parse_id(spec: str, enum: str) -> int:
+        values = layouts.enums[enum]
+        if spec in values:
+            return values[spec]
+        try:
+            return int(spec, 0)
+        except ValueError:
+            sys.exit(f"Unknown {enum} '{spec}'")
+
+    group_names = {
+        v: k for k, v in reversed(layouts.enums["enum dungeon_group_id"].items())
+    }
+    if args.rom:
+        dungeon = parse_id(args.dungeon, "enum dungeon_id")
+        dungeon_names = {
+            v: k for k, v in reversed(layouts.enums["enum dungeon_id"].items())
+        }
+        with BinaryData(args.rom, layouts, args.version) as data:
+            groups = DungeonGroups(data)
+        if dungeon < 0:
+            sys.exit(f"Invalid dungeon {dungeon}")
+        n_floors = groups.n_floors(dungeon)
+        if args.floors:
+            floors = parse_range(args.floors)
+        elif n_floors is not None:
+            floors = list(range(1, n_floors + 1))
+        else:
+            sys.exit(f"The floor count of dungeon {dungeon} is unknown; use -f")
+        targets = [
+            (
+                f"{dungeon_names.get(dungeon, dungeon)} floor {floor}",
+                groups.group_floor(dungeon, floor),
+            )
+            for floor in floors
+        ]
+        mappa_path = find_mappa(args.rom)
+    else:
+        if args.dungeon in layouts.enums["enum dungeon_id"]:
+            sys.exit("--mappa takes a dungeon group; use --rom for dungeon IDs")
+        group = parse_id(args.dungeon, "enum dungeon_group_id")
+        targets = None
+        mappa_path = args.mappa
+
+    with Mappa(mappa_path) as mappa:
+        if targets is None:
+            if not 0 <= group < len(mappa):
+                sys.exit(f"Dungeon group {group} is not in {mappa_path}")
+            floors = (
+                parse_range(args.floors)
+                if args.floors
+                else range(1, mappa.n_floors(group) + 1)
+            )
+            targets = [(None, GroupFloor(group, floor)) for floor in floors]
+        for title, (group, floor) in targets:
+            if not 0 <= group < len(mappa):
+                sys.exit(f"Dungeon group {group} is not in {mappa_path}")
+            info = mappa.floor(group, floor)
+            label = f"{group_names.get(group, group)} floor {floor}"
+            if title:
+                label = f"{title} ({label})"
+            report(
+                f"{label}, monster list {info.monster_list}:",
+                mappa.monster_list(info.monster_list),
+            )
@@ -19,10 +19,33 @@ python3 offsets.py 0x2010000 0x22DC260
 python3 offsets.py -b arm9 -b overlay29 0x2010000 0x22DC260
 python3 offsets.py -v EU -b overlay29 0x22DCBA0
 python3 offsets.py -b arm9 0x100 0x200 0x2010000
+python3 offsets.py -b arm9 -b overlay29 --stdin < trace.txt
+
+For converting large numbers of offsets (e.g., from an emulator trace), use
+the `--stdin` mode, which reads whitespace-separated offsets from stdin and
+prints one conversion per line. Batch conversions use `AddressTable`, which
+does the lookups with a binary search over sorted load addresses. If numpy is
+installed, the lookups are vectorized. In batch mode, the selected binaries
+must not overlap in memory, so that every conversion is unambiguous.
+
+This module also provides `MappedBinary`, a shared loader that memory-maps a
+binary file read-only and pairs it with the corresponding `Binary` for address
+mapping. It's used by other tools (like `arm5find.py`) so that large binaries
+can be scanned directly without reading them into memory.
 """
 
 import argparse
-from typing import List, Optional, Union
+from bisect import bisect_right
+import mmap
+import os
+from pathlib import Path
+import sys
+from typing import Dict, Iterable, List, Optional, Sequence, Tuple, Union
+
+try:
+    import numpy as np
+except ImportError:
+    np = None
 
 
 class Binary:
@@ -173,6 +196,95 @@ BINARY_NAMES = sorted(
 )
 
 
+def find_binary_files(dirname: str, binaries: Iterable[str]) -> Dict[str, str]:
+    """Locate the files corresponding to the given binaries within a directory.
+
+    Args:
+        dirname (str): path of the directory to search
+        binaries (Iterable[str]): collection of binaries to search for
+
+    Returns:
+        Dict[str, str]: mapping from binaries to located file paths
+    """
+    binary_files: Dict[str, str] = {}
+    binary_set = set(binaries)
+    for fpath in Path(dirname).glob("**/*.bin"):
+        name = fpath.name.rstrip(".bin")
+        if name.startswith("overlay"):
+            # overlay_0000 or overlay0000 -> overlay0, etc.
+            name = f"overlay{int(name.lstrip('overlay').lstrip('_'))}"
+        if name in binary_set:
+            binary_files[name] = str(fpath)
+    return binary_files
+
+
+class MappedBinary:
+    """A binary file that's memory-mapped read-only.
+
+    The mapped contents support the buffer protocol, so they can be sliced,
+    searched with `re`, or read like a file (via `seek()`/`read()`) without
+    copying the whole file into memory. If the binary's version and name are
+    known, the corresponding `Binary` is also attached for address mapping.
+    """
+
+    def __init__(
+        self,
+        path: Union[str, os.PathLike],
+        version: Optional[str] = None,
+        bin_name: Optional[str] = None,
+    ):
+        self.path = path
+        self.binary: Optional[Binary] = None
+        if version is not None and bin_name is not None:
+            self.binary = BINARIES[version][bin_name]
+        with open(path, "rb") as f:
+            try:
+                self.contents: Union[mmap.mmap, bytes] = mmap.mmap(
+                    f.fileno(), 0, access=mmap.ACCESS_READ
+                )
+            except ValueError:
+                # Empty files can't be mapped
+                self.contents = b""
+
+    def __repr__(self) -> str:
+        s = f"{self.path}"
+        if self.binary is not None:
+            s += f" ({self.binary})"
+        return s
+
+    def __len__(self) -> int:
+        return len(self.contents)
+
+    def __enter__(self) -> "MappedBinary":
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def close(self):
+        if isinstance(self.contents, mmap.mmap):
+            self.contents.close()
+
+    def _require_binary(self) -> Binary:
+        if self.binary is None:
+            raise ValueError(f"no address mapping for {self.path}")
+        return self.binary
+
+    def absolute(self, offset: int) -> int:
+        """Convert a file offset to an absolute address"""
+        b = self._require_binary()
+        if offset < 0 or offset >= b.length:
+            raise ValueError(f"offset 0x{offset:X} is out of bounds for {b}")
+        return b.address + offset
+
+    def relative(self, address: int) -> int:
+        """Convert an absolute address to a file offset"""
+        b = self._require_binary()
+        if address not in b:
+            raise ValueError(f"address 0x{address:X} is out of bounds for {b}")
+        return address - b.address
+
+
 class OffsetMapping:
     """A mapping from some relative/absolute offset to a list of complementary offsets"""
 
@@ -270,6 +382,148 @@ def convert_offsets(
     return offset_mappings
 
 
+class AddressTable:
+    """Sorted load-address table for converting offsets in bulk.
+
+    Offsets are classified as relative or absolute in the same way as with
+    `convert_offsets()`. Absolute offsets are resolved to a binary with a
+    binary search over the sorted load addresses, so the selected binaries must
+    not overlap. Relative offsets can only be resolved if exactly one binary is
+    selected.
+    """
+
+    def __init__(self, version: str, bin_names: Iterable[str]):
+        local_bin_map = BINARIES[version]
+        entries = sorted(
+            ((bname, local_bin_map[bname]) for bname in set(bin_names)),
+            key=lambda e: e[1].address,
+        )
+        if not entries:
+            raise ValueError("no binaries selected")
+        for (name1, b1), (name2, b2) in zip(entries, entries[1:]):
+            if b1.address + b1.length > b2.address:
+                raise ValueError(
+                    f"{name1} ({b1}) overlaps with {name2} ({b2}), cannot convert in bulk"
+                )
+
+        self.names: List[str] = [bname for bname, _ in entries]
+        self.starts: List[int] = [b.address for _, b in entries]
+        self.ends: List[int] = [b.address + b.length for _, b in entries]
+        # Bounds for relative/absolute inference, same as convert_offsets()
+        self.min_bin_addr = min([b.address for b in local_bin_map.values()])
+        self.max_bin_len = max([b.length for b in local_bin_map.values()])
+
+    def convert(self, offsets: Sequence[int]) -> Tuple[Sequence[int], Sequence[int]]:
+        """Convert a sequence of offsets from absolute to relative or vice versa.
+
+        If numpy is available, the inputs are converted to an int64 array and
+        the outputs are int64 arrays. Otherwise, the outputs are lists.
+
+        Args:
+            offsets (Sequence[int]): offsets to convert
+
+        Raises:
+            ValueError: invalid offsets
+
+        Returns:
+            Tuple[Sequence[int], Sequence[int]]: for each input offset, the
+                index of the matching binary in `names` and the converted
+                offset, or -1 for both if there's no match
+        """
+        if np is not None:
+            return self._convert_vectorized(np.asarray(offsets, dtype=np.int64))
+
+        indexes: List[int] = []
+        converted: List[int] = []
+        single_len = self.ends[0] - self.starts[0] if len(self.names) == 1 else None
+        for offset in offsets:
+            idx = -1
+            if offset < 0:
+                raise ValueError(f"negative offset -0x{abs(offset):X} is invalid")
+            elif offset < self.max_bin_len:
+                if single_len is None:
+                    raise ValueError(
+                        f"multiple binaries selected, cannot interpret relative offset 0x{offset:X}"
+                    )
+                if offset < single_len:
+                    idx = 0
+                    converted.append(self.starts[0] + offset)
+            elif offset >= self.min_bin_addr:
+                i = bisect_right(self.starts, offset) - 1
+                if i >= 0 and offset < self.ends[i]:
+                    idx = i
+                    converted.append(offset - self.starts[i])
+            if idx < 0:
+                converted.append(-1)
+            indexes.append(idx)
+        return indexes, converted
+
+    def _convert_vectorized(
+        self, offsets: "np.ndarray"
+    ) -> Tuple["np.ndarray", "np.ndarray"]:
+        if (offsets < 0).any():
+            offset = int(offsets[offsets < 0][0])
+            raise ValueError(f"negative offset -0x{abs(offset):X} is invalid")
+        starts = np.asarray(self.starts, dtype=np.int64)
+        ends = np.asarray(self.ends, dtype=np.int64)
+        indexes = np.full(offsets.shape, -1, dtype=np.int64)
+        converted = np.full(offsets.shape, -1, dtype=np.int64)
+
+        is_relative = offsets < self.max_bin_len
+        if is_relative.any():
+            if len(self.names) != 1:
+                offset = int(offsets[is_relative][0])
+                raise ValueError(
+                    f"multiple binaries selected, cannot interpret relative offset 0x{offset:X}"
+                )
+            mask = is_relative & (offsets < ends[0] - starts[0])
+            indexes[mask] = 0
+            converted[mask] = offsets[mask] + starts[0]
+
+        i = np.searchsorted(starts, offsets, side="right") - 1
+        mask = (
+            (offsets >= self.min_bin_addr)
+            & (i >= 0)
+            & (offsets < ends[np.maximum(i, 0)])
+        )
+        indexes[mask] = i[mask]
+        converted[mask] = offsets[mask] - starts[i[mask]]
+        return indexes, converted
+
+    def format(self, indexes: Sequence[int], converted: Sequence[int]) -> List[str]:
+        """Format the results of `convert()`, one string per offset"""
+        if len(self.names) == 1:
+            return [f"0x{c:X}" if i >= 0 else "???" for i, c in zip(indexes, converted)]
+        return [
+            f"0x{c:X} ({self.names[i]})" if i >= 0 else "???"
+            for i, c in zip(indexes, converted)
+        ]
+
+
+def convert_stdin(version: str, bin_names: List[str], chunk_size: int = 1 << 16):
+    """Convert offsets read from stdin in bulk, printing one conversion per line.
+
+    Args:
+        version (str): game version
+        bin_names (List[str]): list of (non-overlapping) binary file names
+        chunk_size (int, optional): number of offsets to convert at a time.
+            Defaults to 65536.
+    """
+    table = AddressTable(version, bin_names)
+    chunk: List[int] = []
+
+    def flush():
+        if chunk:
+            sys.stdout.write("\n".join(table.format(*table.convert(chunk))) + "\n")
+            chunk.clear()
+
+    for line in sys.stdin:
+        chunk.extend(int(x, 0) for x in line.split())
+        if len(chunk) >= chunk_size:
+            flush()
+    flush()
+
+
 if __name__ == "__main__":
     parser = argparse.ArgumentParser(
         description="Convert between absolute and relative offsets in the EoS binaries"
@@ -289,6 +543,11 @@ if __name__ == "__main__":
         action="append",
         help="EoS binary",
     )
+    parser.add_argument(
+        "--stdin",
+        action="store_true",
+        help="read offsets from stdin and convert them in bulk",
+    )
     parser.add_argument(
         "offset",
         nargs="*",
@@ -297,6 +556,17 @@ if __name__ == "__main__":
     )
     args = parser.parse_args()
 
+    if args.stdin:
+        if not args.binary:
+            parser.error("--stdin requires at least one binary")
+        if args.offset:
+            parser.error("offsets can't be given as arguments with --stdin")
+        try:
+            convert_stdin(args.version, args.binary)
+        except ValueError as e:
+            raise SystemExit(str(e))
+        sys.exit(0)
+
     offset_mappings = convert_offsets(args.version, args.binary, args.offset)
 
     print(f"Version: {args.version}")
@@ -0,0 +1,261 @@
+#!/usr/bin/env python3
+
+"""
+`pack_archive.py` is a command line utility and Python module for reading the
+game's .bin Pack archives (`enum pack_file_id`, opened in arm9 by
+`OpenPackFile` and read by `LoadFileInPack` and friends) with random access.
+
+A Pack archive starts with a header (see `struct pack_file_opened`):
+    0x0: always 0
+    0x4: number of files
+    0x8: table of contents, one `struct pack_file_table_of_content`
+         {offset, length} per file, with offsets relative to the start of the
+         archive
+See https://projectpokemon.org/docs/mystery-dungeon-nds/pmd2-pack-file-format-r42
+for more details. Files in the archive aren't named, only indexed.
+
+A `PackArchive` memory-maps the archive and reads the table of contents once.
+Files are then served as zero-copy memoryview slices of the mapping, so
+extracting one file doesn't read the rest of the archive, and slices can be
+shared across threads. (Slices must be released before the archive is
+closed.)
+
+The archive for a `pack_file_id` (e.g., PACK_ARCHIVE_MONSTER) is located
+within an extracted ROM through the path strings in PACK_FILE_PATHS_TABLE,
+which are read from arm9.bin.
+
+Example usage:
+python3 pack_archive.py info MONSTER/monster.bin
+python3 pack_archive.py extract -o out MONSTER/m_attack.bin
+python3 pack_archive.py extract -d rom -o out --decompress PACK_ARCHIVE_MONSTER
+python3 pack_archive.py info -d rom -l layouts.bin PACK_ARCHIVE_DUNGEON
+python3 pack_archive.py extract -o out -i 0-99,200 MONSTER/monster.bin
+
+Library usage:
+    with PackArchive("MONSTER/monster.bin") as pack:
+        sprite = pack[5]  # memoryview
+"""
+
+import argparse
+from concurrent.futures import ThreadPoolExecutor
+import os
+from pathlib import Path
+import struct
+import sys
+from typing import Iterator, List, Optional, Tuple
+
+import at_compression
+import layouts
+import offsets
+
+HEADER_LEN = 8
+TOC_ENTRY_LEN = 8
+
+PACK_FILE_ID_ENUM = "enum pack_file_id"
+
+
+class PackArchive:
+    """A memory-mapped Pack archive with random access to its files"""
+
+    def __init__(self, path: str):
+        self.path = path
+        self._mapped = offsets.MappedBinary(path)
+        self._view = memoryview(self._mapped.contents)
+        if len(self._view) < HEADER_LEN:
+            self.close()
+            raise ValueError(f"{path} is too short to be a Pack archive")
+        zero, n_files = struct.unpack_from("<II", self._view, 0)
+        toc_end = HEADER_LEN + n_files * TOC_ENTRY_LEN
+        if zero != 0 or toc_end > len(self._view):
+            self.close()
+            raise ValueError(f"{path} is not a Pack archive")
+        self.toc: List[Tuple[int, int]] = list(
+            struct.iter_unpack("<II", self._view[HEADER_LEN:toc_end])
+        )
+        for i, (offset, length) in enumerate(self.toc):
+            if offset + length > len(self._view):
+                self.close()
+                raise ValueError(
+                    f"{path}: file {i} ({offset:#x}+{length:#x}) is out of bounds"
+                )
+
+    def __enter__(self) -> "PackArchive":
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    def close(self):
+        self._view.release()
+        self._mapped.close()
+
+    def __len__(self) -> int:
+        return len(self.toc)
+
+    def length(self, index: int) -> int:
+        """GetFileLengthInPack: the length of a file in bytes"""
+        return self.toc[index][1]
+
+    def __getitem__(self, index: int) -> memoryview:
+        """LoadFileInPack, without copying: a slice of the mapped archive"""
+        offset, length = self.toc[index]
+        return self._view[offset : offset + length]
+
+    def __iter__(self) -> Iterator[memoryview]:
+        for i in range(len(self)):
+            yield self[i]
+
+
+def pack_file_ids(lts: Optional[layouts.Layouts] = None) -> List[str]:
+    """
+    The names of the Pack archives (enum pack_file_id) from the headers,
+    indexed by pack_file_id.
+    """
+    if lts is None:
+        lts = layouts.Layouts.from_headers()
+    values = lts.enums[PACK_FILE_ID_ENUM]
+    return sorted(values, key=values.__getitem__)
+
+
+def pack_paths(data_dir: str, version: str = "NA") -> List[str]:
+    """
+    Reads the paths of the Pack archives (PACK_FILE_PATHS_TABLE) from the
+    arm9 binary in an extracted ROM, indexed by pack_file_id.
+    """
+    with layouts.BinaryData(data_dir, version=version) as data:
+        raw = data.raw("arm9", "PACK_FILE_PATHS_TABLE")
+        arm9 = offsets.MappedBinary(data.files["arm9"], version, "arm9")
+        with arm9:
+            paths = []
+            for (pointer,) in struct.iter_unpack("<I", raw):
+                start = arm9.relative(pointer)
+                end = arm9.contents.find(b"\0", start)
+                path = arm9.contents[start:end].decode("ascii")
+                # Strip any device prefix, like "rom0:"
+                paths.append(path.split(":", 1)[-1].lstrip("/"))
+    return paths
+
+
+def locate_pack(
+    data_dir: str,
+    pack_id: str,
+    version: str = "NA",
+    lts: Optional[layouts.Layouts] = None,
+) -> str:
+    """Finds the file of a Pack archive by pack_file_id in an extracted ROM"""
+    ids = pack_file_ids(lts)
+    if pack_id not in ids:
+        raise KeyError(f"unknown pack_file_id '{pack_id}'")
+    path = pack_paths(data_dir, version)[ids.index(pack_id)]
+    for root in (Path(data_dir), Path(data_dir) / "data"):
+        if (root / path).is_file():
+            return str(root / path)
+    raise FileNotFoundError(f"{path} ({pack_id}) not found in {data_dir}")
+
+
+def parse_indices(spec: str, n: int) -> List[int]:
+    """Parses index lists like "0-99,200" """
+    indices = []
+    for part in spec.split(","):
+        start, _, stop = part.partition("-")
+        lo = int(start, 0)
+        hi = int(stop, 0) if stop else lo
+        if not 0 <= lo <= hi < n:
+            raise ValueError(f"index range '{part}' is out of bounds (0-{n - 1})")
+        indices.extend(range(lo, hi + 1))
+    return indices
+
+
+def extract(
+    pack: PackArchive,
+    out_dir: str,
+    indices: Optional[List[int]] = None,
+    decompress: bool = False,
+    jobs: Optional[int] = None,
+) -> int:
+    """
+    Writes files from an archive to out_dir as NNNN.bin, optionally
+    decompressing AT containers. Returns the number of files written.
+    """
+    os.makedirs(out_dir, exist_ok=True)
+    width = max(4, len(str(len(pack) - 1)))
+
+    def write(index: int):
+        with pack[index] as view:
+            data = view
+            if decompress and at_compression.is_at_container(view):
+                data = at_compression.decompress(view)
+            with open(os.path.join(out_dir, f"{index:0{width}}.bin"), "wb") as f:
+                f.write(data)
+
+    if indices is None:
+        indices = list(range(len(pack)))
+    with ThreadPoolExecutor(jobs) as pool:
+        for _ in pool.map(write, indices):
+            pass
+    return len(indices)
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Read Pack archives")
+    subparsers = parser.add_subparsers(dest="command", required=True)
+    for name, help_text in (
+        ("info", "print the table of contents"),
+        ("extract", "extract files"),
+    ):
+        sub = subparsers.add_parser(name, help=help_text)
+        sub.add_argument(
+            "archive",
+            help="Pack archive file, or with -d, a pack_file_id "
+            + "(e.g., PACK_ARCHIVE_MONSTER)",
+        )
+        sub.add_argument(
+            "-d", "--data-dir", help="extracted ROM directory, to look up archives"
+        )
+        sub.add_argument(
+            "-v",
+            "--version",
+            choices=["NA", "EU", "JP"],
+            default="NA",
+            help="game version of the ROM",
+        )
+        sub.add_argument(
+            "-l",
+            "--layouts",
+            help="load previously emitted layout tables instead of the headers",
+        )
+        if name == "extract":
+            sub.add_argument("-o", "--output", required=True, help="output directory")
+            sub.add_argument(
+                "-i", "--indices", help="file indices to extract, e.g. 0-99,200"
+            )
+            sub.add_argument(
+                "--decompress",
+                action="store_true",
+                help="decompress AT-compressed files",
+            )
+            sub.add_argument(
+                "-j", "--jobs", type=int, help="number of threads (default: auto)"
+            )
+    args = parser.parse_args()
+
+    path = args.archive
+    if args.data_dir is not None:
+        lts = (
+            layouts.Layouts.load(args.layouts)
+            if args.layouts
+            else layouts.Layouts.from_headers()
+        )
+        if path not in pack_file_ids(lts):
+            sys.exit(f"Unknown pack_file_id '{path}'")
+        path = locate_pack(args.data_dir, path, args.version, lts)
+
+    with PackArchive(path) as pack:
+        if args.command == "info":
+            print(f"{path}: {len(pack)} files")
+            for i, (offset, length) in enumerate(pack.toc):
+                print(f"  {i}: offset {offset:#x}, length {length:#x}")
+        else:
+            indices = parse_indices(args.indices, len(pack)) if args.indices else None
+            n = extract(pack, args.output, indices, args.decompress, args.jobs)
+            print(f"Extracted {n} files to {args.output}")
@@ -0,0 +1,515 @@
+#!/usr/bin/env python3
+
+"""
+`script_vars.py` is a command line utility and Python module for decoding
+the global script variable table (SCRIPT_VARS_VALUES, a
+struct script_var_value_table) from RAM dumps, save data or raw snapshots,
+and for diffing it across many inputs at once, with numpy.
+
+The meaning of each part of the value table is given by the variable
+metadata (SCRIPT_VARS, a struct script_var_table in arm9). The metadata is
+read from an extracted ROM (`-d`), from the arm9 region of a RAM dump
+(`--var-dump`), or by default, derived from the definition of
+struct script_var_value_table in the headers, where each field corresponds
+to a variable of the same name in enum script_var_id. The header-derived
+metadata doesn't know the exact number of values of bit variables, and uses
+every bit of the field instead.
+
+Variables are read like LoadScriptVariableValueAtIndex reads them:
+    - VARTYPE_BIT: value i is bit (bitshift + i) % 8 of byte
+      mem_offset + (bitshift + i) / 8;
+    - VARTYPE_UINT8/INT8/UINT16/INT16/UINT32/INT32: value i is the
+      little-endian integer at mem_offset + i * size;
+    - VARTYPE_STRING: read like VARTYPE_UINT8, and shown as text;
+    - VARTYPE_NONE and VARTYPE_SPECIAL are not stored in the table and are
+      skipped, as are the local variables (SCRIPT_VARS_LOCALS).
+
+Every value of every variable gets a column, and the metadata is compiled
+into one gather per value type, so a batch of N tables is decoded into an
+(N x columns) int64 matrix in a single pass. Diffs between inputs are then
+comparisons between rows of that matrix.
+
+Inputs are RAM dumps (the table is read from SCRIPT_VARS_VALUES), files
+holding the table at a given offset (`--offset`, e.g., 0 for the output of
+DumpScriptVariableValues, or the location of the table within save data),
+or a stream of concatenated tables (`--stream`).
+
+Example usage:
+python3 script_vars.py -l layouts.bin ram.bin
+python3 script_vars.py -l layouts.bin -d rom_data ram.bin --non-default
+python3 script_vars.py -l layouts.bin --offset 0x1234 --diff saves/*.sav
+python3 script_vars.py -l layouts.bin --baseline start.bin --offset 0 dumps/*.bin
+python3 script_vars.py -l layouts.bin --stream tables.bin --summary
+
+Library usage:
+    variables = ScriptVarTable.from_layouts(layouts)
+    values = variables.decode_batch(tables)  # tables: (n, 1024) uint8 array
+    typed = variables.decode(table_bytes)  # {"VAR_VERSION": 1, ...}
+"""
+
+import argparse
+import json
+import os
+import sys
+from typing import Any, Dict, Iterator, List, NamedTuple, Optional, Sequence, Tuple
+
+import numpy as np
+
+from layouts import (
+    BinaryData,
+    Layouts,
+    RamDump,
+    load_data_symbols,
+    load_ram_addresses,
+    symbol_address,
+)
+
+VALUE_TABLE_TYPE = "struct script_var_value_table"
+VALUE_TABLE_GLOBAL = "SCRIPT_VARS_VALUES"
+VAR_TABLE_TYPE = "struct script_var_table"
+VAR_TABLE_GLOBAL = "SCRIPT_VARS"
+VAR_ID_ENUM = "enum script_var_id"
+VAR_TYPE_ENUM = "enum script_var_type"
+VAR_PREFIX = "VAR_"
+# Fields of struct script_var_value_table that aren't variables
+UNUSED_FIELDS = {"unused"}
+# The only nonzero default value (see struct script_var::default_val)
+HEADER_DEFAULTS = {"VAR_VERSION": 1}
+# Value types stored as integers: (size, signed)
+INT_TYPES = {
+    "VARTYPE_STRING": (1, False),
+    "VARTYPE_UINT8": (1, False),
+    "VARTYPE_INT8": (1, True),
+    "VARTYPE_UINT16": (2, False),
+    "VARTYPE_INT16": (2, True),
+    "VARTYPE_UINT32": (4, False),
+    "VARTYPE_INT32": (4, True),
+}
+# C types of the value table fields, for header-derived metadata
+C_TYPES = {
+    "char": "VARTYPE_STRING",
+    "uint8_t": "VARTYPE_UINT8",
+    "int8_t": "VARTYPE_INT8",
+    "uint16_t": "VARTYPE_UINT16",
+    "int16_t": "VARTYPE_INT16",
+    "uint32_t": "VARTYPE_UINT32",
+    "int32_t": "VARTYPE_INT32",
+}
+
+
+class ScriptVar(NamedTuple):
+    """A global script variable, as described by struct script_var"""
+
+    id: int
+    name: str
+    type: str  # enum script_var_type name
+    mem_offset: int
+    bitshift: int
+    n_values: int
+    default: int
+
+
+class ScriptVarTable:
+    """Script variable metadata, compiled for decoding value tables in bulk"""
+
+    def __init__(self, layouts: Layouts, variables: Sequence[ScriptVar]):
+        self.table_size = layouts.sizeof(VALUE_TABLE_TYPE)
+        self.variables = [v for v in variables if v.type in INT_TYPES or self._bit(v)]
+        # Column names and the (variable, index) of each column
+        self.column_names: List[str] = []
+        self.column_vars: List[Tuple[int, int]] = []
+        # Columns of each variable
+        self.var_columns: Dict[str, slice] = {}
+        # (columns, byte offsets, bit shifts) for bits, and
+        # (columns, byte offsets, size, signed) for integers
+        bits: Tuple[List[int], List[int], List[int]] = ([], [], [])
+        ints: Dict[Tuple[int, bool], Tuple[List[int], List[int]]] = {}
+        for v_idx, var in enumerate(self.variables):
+            first = len(self.column_names)
+            for i in range(var.n_values):
+                col = len(self.column_names)
+                if self._bit(var):
+                    offset = var.mem_offset + (var.bitshift + i) // 8
+                    end = offset + 1
+                else:
+                    size, signed = INT_TYPES[var.type]
+                    offset = var.mem_offset + i * size
+                    end = offset + size
+                if end > self.table_size:
+                    raise ValueError(f"{var.name}[{i}] is outside the value table")
+                if self._bit(var):
+                    bits[0].append(col)
+                    bits[1].append(offset)
+                    bits[2].append((var.bitshift + i) % 8)
+                else:
+                    group = ints.setdefault((size, signed), ([], []))
+                    group[0].append(col)
+                    group[1].append(offset)
+                self.column_names.append(
+                    var.name if var.n_values == 1 else f"{var.name}[{i}]"
+                )
+                self.column_vars.append((v_idx, i))
+            self.var_columns[var.name] = slice(first, len(self.column_names))
+        self._bits = tuple(np.array(a, dtype=np.int64) for a in bits)
+        self._ints = [
+            (np.array(cols, dtype=np.int64), np.array(offs, dtype=np.int64), size, sign)
+            for (size, sign), (cols, offs) in ints.items()
+        ]
+        self.defaults = np.array(
+            [self.variables[v].default for v, _ in self.column_vars], dtype=np.int64
+        )
+
+    @staticmethod
+    def _bit(var: ScriptVar) -> bool:
+        return var.type == "VARTYPE_BIT"
+
+    def __len__(self) -> int:
+        return len(self.column_names)
+
+    @classmethod
+    def from_layouts(cls, layouts: Layouts) -> "ScriptVarTable":
+        """Derives the metadata from struct script_var_value_table"""
+        ids = layouts.enums[VAR_ID_ENUM]
+        variables = []
+        in_bits = False
+        for f in layouts.aggregates[VALUE_TABLE_TYPE].fields:
+            if f.name in UNUSED_FIELDS:
+                continue
+            name = VAR_PREFIX + f.name.upper()
+            n = 1
+            for d in f.dims:
+                n *= d
+            # Everything from the first bitfield onwards is of type VARTYPE_BIT
+            in_bits = in_bits or f.is_bitfield()
+            if f.is_bitfield():
+                var = ("VARTYPE_BIT", f.offset, f.bit_offset - 8 * f.offset)
+                n = f.bit_width
+            elif in_bits:
+                var = ("VARTYPE_BIT", f.offset, 0)
+                n *= 8 * f.element_size()
+            elif f.type in C_TYPES:
+                var = (C_TYPES[f.type], f.offset, 0)
+            else:
+                raise ValueError(f"unexpected type for {name}: {f.type}")
+            variables.append(
+                ScriptVar(
+                    ids.get(name, -1), name, *var, n, HEADER_DEFAULTS.get(name, 0)
+                )
+            )
+        return cls(layouts, variables)
+
+    @classmethod
+    def from_view(cls, layouts: Layouts, table: Any) -> "ScriptVarTable":
+        """Reads the metadata from a view of struct script_var_table"""
+        variables = []
+        for i, var in enumerate(table.vars):
+            variables.append(
+                ScriptVar(
+                    i,
+                    layouts.enum_name(VAR_ID_ENUM, i) or f"{VAR_PREFIX}{i}",
+                    layouts.enum_name(VAR_TYPE_ENUM, var["type"].val) or "VARTYPE_NONE",
+                    var.mem_offset,
+                    var.bitshift,
+                    var.n_values,
+                    var.default_val,
+                )
+            )
+        return cls(layouts, variables)
+
+    @classmethod
+    def load(cls, data: BinaryData) -> "ScriptVarTable":
+        """Reads SCRIPT_VARS from the arm9 binary extracted from a ROM"""
+        return cls.from_view(data.layouts, data.read("arm9", VAR_TABLE_GLOBAL))
+
+    @classmethod
+    def from_dump(cls, dump: RamDump) -> "ScriptVarTable":
+        """Reads SCRIPT_VARS from the arm9 region of a RAM dump"""
+        addr = symbol_address(load_data_symbols("arm9")[VAR_TABLE_GLOBAL], dump.version)
+        if addr is None:
+            raise KeyError(f"no {dump.version} address for '{VAR_TABLE_GLOBAL}'")
+        return cls.from_view(dump.layouts, dump.view_at(VAR_TABLE_TYPE, addr))
+
+    def decode_batch(self, tables: np.ndarray) -> np.ndarray:
+        """
+        Decodes an (n, sizeof(struct script_var_value_table)) uint8 array of
+        value tables into an (n, columns) int64 array of values
+        """
+        tables = np.asarray(tables, dtype=np.uint8)
+        if tables.ndim == 1:
+            tables = tables[None, :]
+        if tables.shape[1] < self.table_size:
+            raise ValueError(f"value tables must be {self.table_size:#x} bytes long")
+        values = np.empty((tables.shape[0], len(self)), dtype=np.int64)
+        cols, offsets, shifts = self._bits
+        if len(cols):
+            values[:, cols] = (tables[:, offsets] >> shifts.astype(np.uint8)) & 1
+        for cols, offsets, size, signed in self._ints:
+            v = np.zeros((tables.shape[0], len(cols)), dtype=np.int64)
+            for i in range(size):
+                v |= tables[:, offsets + i].astype(np.int64) << (8 * i)
+            if signed:
+                width = 8 * size
+                v = np.where(v >> (width - 1) & 1, v - (1 << width), v)
+            values[:, cols] = v
+        return values
+
+    def to_dict(self, row: np.ndarray) -> Dict[str, Any]:
+        """
+        A typed map of one row of decoded values: ints for single values,
+        lists for arrays, and str for VARTYPE_STRING
+        """
+        result: Dict[str, Any] = {}
+        for var in self.variables:
+            vals = [int(x) for x in row[self.var_columns[var.name]]]
+            if var.type == "VARTYPE_STRING":
+                text = bytes(vals).split(b"\0", 1)[0]
+                result[var.name] = text.decode("latin-1")
+            elif var.n_values == 1:
+                result[var.name] = vals[0]
+            else:
+                result[var.name] = vals
+        return result
+
+    def decode(self, table: bytes) -> Dict[str, Any]:
+        """Decodes a single value table into a typed map"""
+        return self.to_dict(
+            self.decode_batch(
+                np.frombuffer(table, dtype=np.uint8, count=self.table_size)
+            )[0]
+        )
+
+    def select(self, names: Sequence[str]) -> np.ndarray:
+        """The columns of the named variables (with or without the VAR_ prefix)"""
+        cols = []
+        for name in names:
+            key = name.upper()
+            key = key if key.startswith(VAR_PREFIX) else VAR_PREFIX + key
+            if key not in self.var_columns:
+                raise KeyError(f"unknown script variable: '{name}'")
+            s = self.var_columns[key]
+            cols.extend(range(s.start, s.stop))
+        return np.array(cols, dtype=np.int64)
+
+
+def changes(values: np.ndarray, baseline: Optional[np.ndarray] = None) -> np.ndarray:
+    """
+    The (row, column) pairs where values differ from the previous row, or
+    from a baseline row if one is given
+    """
+    if baseline is not None:
+        return np.argwhere(values != baseline)
+    return np.argwhere(values[1:] != values[:-1]) + [1, 0]
+
+
+def table_offset(path: str, layouts: Layouts, version: str) -> int:
+    """The file offset of SCRIPT_VARS_VALUES in a RAM dump"""
+    with RamDump(path, layouts, version) as dump:
+        return dump.mapped.relative(load_ram_addresses(version)[VALUE_TABLE_GLOBAL])
+
+
+def read_tables(paths: Sequence[str], offset: int, size: int) -> np.ndarray:
+    """Reads a value table at the same offset from every file"""
+    tables = np.zeros((len(paths), size), dtype=np.uint8)
+    for i, path in enumerate(paths):
+        with open(path, "rb") as f:
+            f.seek(offset)
+            data = f.read(size)
+        if len(data) != size:
+            raise ValueError(f"{path}: no value table at offset {offset:#x}")
+        tables[i] = np.frombuffer(data, dtype=np.uint8)
+    return tables
+
+
+def stream_tables(path: str, size: int) -> np.ndarray:
+    """Memory-maps a file of concatenated value tables"""
+    tables = np.memmap(path, dtype=np.uint8, mode="r")
+    return tables[: len(tables) // size * size].reshape(-1, size)
+
+
+def batches(
+    paths: Sequence[str], offset: int, size: int, batch: int
+) -> Iterator[Tuple[int, np.ndarray]]:
+    """Reads the value tables of a list of files, in batches of (first, tables)"""
+    for first in range(0, len(paths), batch):
+        yield first, read_tables(paths[first : first + batch], offset, size)
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(
+        description="Decode and diff script variable values"
+    )
+    parser.add_argument("inputs", nargs="*", help="RAM dumps, or files with --offset")
+    parser.add_argument(
+        "--offset",
+        type=lambda x: int(x, 0),
+        help="file offset of the value table in every input "
+        + "(default: SCRIPT_VARS_VALUES in a RAM dump)",
+    )
+    parser.add_argument("--stream", help="file of raw concatenated value tables")
+    source = parser.add_mutually_exclusive_group()
+    source.add_argument(
+        "-d",
+        "--data-dir",
+        help="data directory for unpacked EoS ROM, to read SCRIPT_VARS from",
+    )
+    source.add_argument("--var-dump", help="RAM dump to read SCRIPT_VARS from")
+    parser.add_argument(
+        "-s",
+        "--select",
+        help="comma-separated variable names to show (default: all)",
+    )
+    mode = parser.add_mutually_exclusive_group()
+    mode.add_argument(
+        "--diff",
+        action="store_true",
+        help="print the values that changed from each input to the next",
+    )
+    mode.add_argument(
+        "--baseline",
+        help="print the values that differ between each input and this one "
+        + "(read like the other inputs)",
+    )
+    mode.add_argument(
+        "--json",
+        action="store_true",
+        help="print each input as a JSON object mapping variables to values",
+    )
+    mode.add_argument(
+        "--summary",
+        action="store_true",
+        help="print, for every value, how many inputs differ from the default, "
+        + "and how many distinct values there are",
+    )
+    parser.add_argument(
+        "--non-default",
+        action="store_true",
+        help="only print values that differ from the variable's default",
+    )
+    parser.add_argument(
+        "-b",
+        "--batch",
+        type=int,
+        default=4096,
+        help="number of inputs to process at once",
+    )
+    parser.add_argument(
+        "-v",
+        "--version",
+        choices=["NA", "EU", "JP"],
+        default="NA",
+        help="game version of the inputs",
+    )
+    parser.add_argument(
+        "-l",
+        "--layouts",
+        help="load previously emitted layout tables instead of the headers",
+    )
+    args = parser.parse_args()
+
+    if bool(args.inputs) == (args.stream is not None):
+        parser.error("give either input files or --stream")
+
+    layouts = Layouts.load(args.layouts) if args.layouts else Layouts.from_headers()
+    if args.data_dir is not None:
+        with BinaryData(args.data_dir, layouts, args.version) as data:
+            variables = ScriptVarTable.load(data)
+    elif args.var_dump is not None:
+        with RamDump(args.var_dump, layouts, args.version) as dump:
+            variables = ScriptVarTable.from_dump(dump)
+    else:
+        variables = ScriptVarTable.from_layouts(layouts)
+    size = variables.table_size
+
+    try:
+        cols = (
+            variables.select(args.select.split(","))
+            if args.select
+            else np.arange(len(variables))
+        )
+    except KeyError as e:
+        sys.exit(str(e.args[0]))
+    names = [variables.column_names[c] for c in cols]
+    defaults = variables.defaults[cols]
+
+    if args.stream is not None:
+        tables = stream_tables(args.stream, size)
+        labels: Sequence[str] = [str(i) for i in range(len(tables))]
+        inputs = (
+            (first, tables[first : first + args.batch])
+            for first in range(0, len(tables), args.batch)
+        )
+    else:
+        offset = args.offset
+        if offset is None:
+            offset = table_offset(args.inputs[0], layouts, args.version)
+        labels = [os.path.basename(p) for p in args.inputs]
+        inputs = batches(args.inputs, offset, size, args.batch)
+
+    baseline = None
+    if args.baseline is not None:
+        offset = args.offset
+        if offset is None:
+            offset = table_offset(args.baseline, layouts, args.version)
+        baseline = variables.decode_batch(read_tables([args.baseline], offset, size))
+        baseline = baseline[0, cols]
+
+    if args.summary:
+        non_default = np.zeros(len(cols), dtype=np.int64)
+        seen: List[set] = [set() for _ in cols]
+        for _, tables in inputs:
+            values = variables.decode_batch(tables)[:, cols]
+            non_default += (values != defaults).sum(axis=0)
+            for j in range(len(cols)):
+                seen[j].update(np.unique(values[:, j]).tolist())
+        print("variable\tnon_default\tdistinct")
+        for j, name in enumerate(names):
+            print(f"{name}\t{non_default[j]}\t{len(seen[j])}")
+        sys.exit(0)
+
+    if args.json:
+        selected = {variables.variables[variables.column_vars[c][0]].name for c in cols}
+        for first, tables in inputs:
+            for r, row in enumerate(variables.decode_batch(tables)):
+                typed = variables.to_dict(row)
+                print(
+                    json.dumps(
+                        {
+                            "input": labels[first + r],
+                            "variables": {
+                                k: v for k, v in typed.items() if k in selected
+                            },
+                        }
+                    )
+                )
+        sys.exit(0)
+
+    if args.diff or baseline is not None:
+        print("input\tvariable\told\tnew")
+    else:
+        print("input\tvariable\tvalue")
+    previous = None
+    for first, tables in inputs:
+        values = variables.decode_batch(tables)[:, cols]
+        if args.diff:
+            # Carry the last row of the previous batch over the boundary
+            if previous is not None:
+                values = np.concatenate([previous, values])
+                first -= 1
+            for r, c in changes(values):
+                print(
+                    f"{labels[first + r]}\t{names[c]}\t"
+                    + f"{values[r - 1, c]}\t{values[r, c]}"
+                )
+            previous = values[-1:]
+        elif baseline is not None:
+            for r, c in changes(values, baseline):
+                print(f"{labels[first + r]}\t{names[c]}\t{baseline[c]}\t{values[r, c]}")
+        else:
+            for r in range(len(values)):
+                shown = (
+                    values[r] != defaults
+                    if args.non_default
+                    else np.ones(len(cols), dtype=bool)
+                )
+                for c in np.nonzero(shown)[0]:
+                    print(f"{labels[first + r]}\t{names[c]}\t{values[r, c]}")
@@ -0,0 +1,293 @@
+#!/usr/bin/env python3
+
+"""
+`sir0.py` is a command line utility and Python module for reading SIR0 files
+(the game's relocatable data container, translated at load time by
+`HandleSir0Translation` and `ConvertPointersSir0` in arm9) through typed,
+zero-copy views based on the C headers.
+
+A SIR0 file starts with a 16-byte header:
+    0x0: magic "SIR0" ("SirO" once translated by the game)
+    0x4: pointer to the content (the data returned by HandleSir0Translation)
+    0x8: pointer to the pointer offset list
+    0xC: padding
+Pointers embedded in the file are stored as file offsets. The pointer offset
+list encodes the location of every pointer in the file (including the two
+in the header), as a sequence of deltas from the previous location. Each
+delta is a big-endian base-128 varint (the high bit of each byte is set on
+all but the last byte), and the list ends with a 0 byte.
+
+When the game loads a SIR0 file, it adds the load address to every listed
+pointer and changes the magic to "SirO". Rather than copying the file and
+rewriting its pointers like the game does, a `Sir0File` memory-maps the file
+and resolves pointers lazily: a pointer read through a view is just an offset
+into the mapped file, so following it is a matter of creating another view
+at that offset. The pointer offset list is only decoded if needed (to check
+whether a location holds a pointer, or to produce a relocated copy).
+
+Files that have already been translated (e.g., read from a RAM dump, with
+the "SirO" magic) can be read the same way by passing the address they were
+loaded at. AT-compressed SIR0 files (see `at_compression.py`) are
+decompressed into memory first.
+
+Example usage:
+python3 sir0.py file.bin
+python3 sir0.py -t "struct mission_rewards" file.bin
+python3 sir0.py -t "struct mission_rewards" -p some.path file.bin
+python3 sir0.py --pointers file.bin
+python3 sir0.py --relocate 0x2300000 -o relocated.bin file.bin
+
+Library usage:
+    layouts = Layouts.from_headers()
+    with Sir0File("file.bin", layouts) as sir0:
+        header = sir0.content_view("struct some_header")
+        table = sir0.deref("struct some_entry", header.entries)
+"""
+
+import argparse
+from bisect import bisect_left
+import struct
+from typing import Any, List, NamedTuple, Optional, Union
+
+import at_compression
+import layouts as layouts_mod
+import offsets
+
+MAGIC = b"SIR0"
+MAGIC_TRANSLATED = b"SirO"
+HEADER_LEN = 16
+
+
+class Sir0Header(NamedTuple):
+    magic: bytes
+    content: int  # Offset of the content
+    pointer_list: int  # Offset of the pointer offset list
+
+
+def is_sir0(data: Union[bytes, memoryview]) -> bool:
+    return bytes(data[:4]) in (MAGIC, MAGIC_TRANSLATED)
+
+
+def decode_pointer_offsets(data: Union[bytes, memoryview], start: int) -> List[int]:
+    """Decodes the pointer offset list starting at the given offset"""
+    offsets_: List[int] = []
+    location = 0
+    value = 0
+    for i in range(start, len(data)):
+        byte = data[i]
+        if byte == 0 and value == 0:
+            break
+        value = (value << 7) | (byte & 0x7F)
+        if not byte & 0x80:
+            location += value
+            offsets_.append(location)
+            value = 0
+    return offsets_
+
+
+def encode_pointer_offsets(pointer_offsets: List[int]) -> bytes:
+    """Encodes a list of pointer locations in the SIR0 format"""
+    out = bytearray()
+    prev = 0
+    for location in sorted(pointer_offsets):
+        delta = location - prev
+        prev = location
+        groups = [delta & 0x7F]
+        delta >>= 7
+        while delta:
+            groups.append(0x80 | (delta & 0x7F))
+            delta >>= 7
+        out += bytes(reversed(groups))
+    out.append(0)
+    return bytes(out)
+
+
+class Sir0File:
+    """
+    A SIR0 file, memory-mapped read-only (or wrapping an existing buffer).
+    Pointers read from views are file offsets; use `deref()` to follow them.
+    """
+
+    def __init__(
+        self,
+        source: Union[str, bytes, bytearray, memoryview],
+        layouts: Optional[layouts_mod.Layouts] = None,
+        load_address: Optional[int] = None,
+    ):
+        self.layouts = layouts
+        self._mapped: Optional[offsets.MappedBinary] = None
+        if isinstance(source, str):
+            self.path = source
+            self._mapped = offsets.MappedBinary(source)
+            self.contents: Any = self._mapped.contents
+            if at_compression.is_at_container(self.contents[:5]):
+                self.contents = at_compression.decompress(self.contents)
+                self._mapped.close()
+                self._mapped = None
+        else:
+            self.path = "<buffer>"
+            self.contents = source
+        if len(self.contents) < HEADER_LEN or not is_sir0(self.contents):
+            self.close()
+            raise ValueError(f"{self.path} is not a SIR0 file")
+
+        magic = bytes(self.contents[:4])
+        if magic == MAGIC_TRANSLATED and load_address is None:
+            self.close()
+            raise ValueError(
+                f"{self.path} has already been translated; its load address is needed"
+            )
+        # Pointers in the buffer are relative to this base
+        self.base = load_address if magic == MAGIC_TRANSLATED else 0
+        content, pointer_list = struct.unpack_from("<II", self.contents, 4)
+        self.header = Sir0Header(magic, content - self.base, pointer_list - self.base)
+        self._pointer_offsets: Optional[List[int]] = None
+
+    def __enter__(self) -> "Sir0File":
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    def close(self):
+        if self._mapped is not None:
+            self._mapped.close()
+            self._mapped = None
+
+    def __len__(self) -> int:
+        return len(self.contents)
+
+    @property
+    def pointer_offsets(self) -> List[int]:
+        """The (sorted) locations of all pointers in the file, decoded on demand"""
+        if self._pointer_offsets is None:
+            self._pointer_offsets = decode_pointer_offsets(
+                self.contents, self.header.pointer_list
+            )
+        return self._pointer_offsets
+
+    def is_pointer(self, location: int) -> bool:
+        """Whether the 4 bytes at a file offset hold a relocatable pointer"""
+        ptrs = self.pointer_offsets
+        i = bisect_left(ptrs, location)
+        return i < len(ptrs) and ptrs[i] == location
+
+    def offset_of(self, pointer: int) -> Optional[int]:
+        """Converts a pointer read from the file to a file offset (None if null)"""
+        if pointer == 0:
+            return None
+        offset = pointer - self.base
+        if not 0 <= offset < len(self.contents):
+            raise ValueError(f"pointer {pointer:#x} is outside of {self.path}")
+        return offset
+
+    def read_pointer(self, location: int) -> Optional[int]:
+        """Reads a pointer at a file offset, as a file offset (None if null)"""
+        (pointer,) = struct.unpack_from("<I", self.contents, location)
+        return self.offset_of(pointer)
+
+    def _require_layouts(self) -> layouts_mod.Layouts:
+        if self.layouts is None:
+            raise ValueError("no layouts given for typed views")
+        return self.layouts
+
+    def view(self, type_name: str, offset: int) -> Any:
+        """
+        A typed view at a file offset. Aggregates are returned as zero-copy
+        views, other types as values. Array types (e.g. "int16_t[4]") are
+        returned as array views.
+        """
+        base, pointer, dims = layouts_mod.parse_type_name(type_name)
+        return self._require_layouts().read(base, pointer, dims, self.contents, offset)
+
+    def content_view(self, type_name: str) -> Any:
+        """A typed view of the content (the data the header points to)"""
+        return self.view(type_name, self.header.content)
+
+    def deref(self, type_name: str, pointer: int, index: int = 0) -> Any:
+        """
+        Follows a pointer read from the file, returning a typed view of the
+        pointed-to data (or its index-th element), or None if null.
+        """
+        offset = self.offset_of(pointer)
+        if offset is None:
+            return None
+        if index:
+            offset += index * self._require_layouts().sizeof(type_name)
+        return self.view(type_name, offset)
+
+    def relocated(self, load_address: int) -> bytes:
+        """
+        A copy of the file translated like HandleSir0Translation would at the
+        given load address: all pointers relocated and the magic set to SirO.
+        """
+        out = bytearray(self.contents)
+        delta = load_address - self.base
+        for location in self.pointer_offsets:
+            (pointer,) = struct.unpack_from("<I", out, location)
+            struct.pack_into("<I", out, location, (pointer + delta) & 0xFFFFFFFF)
+        out[:4] = MAGIC_TRANSLATED
+        return bytes(out)
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Read SIR0 files with typed views")
+    parser.add_argument("file", help="SIR0 file (optionally AT-compressed)")
+    parser.add_argument(
+        "-t", "--type", help="type of the content to print, e.g. 'struct x'"
+    )
+    parser.add_argument(
+        "-p", "--path", help="field path within the content type to print"
+    )
+    parser.add_argument(
+        "--load-address",
+        type=lambda x: int(x, 0),
+        help="address the file was loaded at, if already translated (SirO)",
+    )
+    parser.add_argument(
+        "--pointers",
+        action="store_true",
+        help="list the locations and targets of all pointers",
+    )
+    parser.add_argument(
+        "--relocate",
+        type=lambda x: int(x, 0),
+        metavar="ADDRESS",
+        help="write a copy translated to the given load address",
+    )
+    parser.add_argument("-o", "--output", help="output file for --relocate")
+    args = parser.parse_args()
+
+    if args.relocate is not None and not args.output:
+        parser.error("--relocate requires -o/--output")
+
+    lts = layouts_mod.Layouts.from_headers() if args.type else None
+    with Sir0File(args.file, lts, args.load_address) as sir0:
+        h = sir0.header
+        print(
+            f"{args.file}: {h.magic.decode()}, {len(sir0):#x} bytes, "
+            + f"content at {h.content:#x}, pointer list at {h.pointer_list:#x} "
+            + f"({len(sir0.pointer_offsets)} pointers)"
+        )
+        if args.pointers:
+            for location in sir0.pointer_offsets:
+                target = sir0.read_pointer(location)
+                print(
+                    f"  {location:#x} -> "
+                    + ("null" if target is None else f"{target:#x}")
+                )
+        if args.type:
+            type_name = args.type
+            offset = h.content
+            if args.path:
+                offset, type_name, pointer, dims = lts.resolve_path(
+                    args.type, args.path
+                )
+                offset += h.content
+                value = lts.read(type_name, pointer, dims, sir0.contents, offset)
+            else:
+                value = sir0.content_view(type_name)
+            print(layouts_mod.format_value(lts, value, type_name))
+        if args.relocate is not None:
+            with open(args.output, "wb") as f:
+                f.write(sir0.relocated(args.relocate))
@@ -0,0 +1,299 @@
+#!/usr/bin/env python3
+
+"""
+`snapshot_diff.py` is a command line utility and Python module for diffing a
+sequence of snapshots of a struct (by default, `struct dungeon`, as stored in
+DUNGEON_STRUCT) field by field, to find out which fields change in response
+to something happening in game.
+
+Snapshots can be given as RAM dumps (the global is located through the
+symbol tables, like in `layouts.py`), or as a stream of raw frames, each
+exactly sizeof(type) bytes long, as produced by an emulator script that
+writes out the struct every frame.
+
+Consecutive frames are compared in bulk (with numpy if available, which is
+vectorized, otherwise in chunks with bytes comparisons), producing a list of
+changed byte ranges. Only those ranges are mapped back to field paths with
+`Layouts.leaves()`, so the cost of a frame mostly depends on how much of the
+struct changed rather than on its size. Every leaf (scalar or bitfield) that
+overlaps a changed range is read from both frames, and reported if its value
+differs; this filters out changes to unrelated bits of a shared byte.
+
+Example usage:
+python3 snapshot_diff.py ram0.bin ram1.bin ram2.bin
+python3 snapshot_diff.py --stream frames.bin -x "^unknown_file_buffer"
+python3 snapshot_diff.py -l layouts.bin --stream frames.bin -f jsonl
+python3 snapshot_diff.py -t "struct floor_properties" --stream - -s < frames.bin
+
+Library usage:
+    differ = SnapshotDiffer(Layouts.load("layouts.bin"))
+    for change in differ.diff(old_frame, new_frame):
+        print(change.path, change.old, change.new)
+"""
+
+import argparse
+from collections import Counter
+import json
+import re
+import sys
+from typing import BinaryIO, Iterator, List, NamedTuple, Optional, Set, Tuple
+
+try:
+    import numpy as np
+except ImportError:
+    np = None
+
+from layouts import Buffer, Layouts, Leaf, RamDump
+
+DEFAULT_TYPE = "struct dungeon"
+DEFAULT_GLOBAL = "DUNGEON_STRUCT"
+# Changed bytes at most this far apart are treated as one range, to save on
+# leaf lookups when changes are clustered
+MERGE_GAP = 8
+# Chunk size for the comparison fallback without numpy
+CHUNK_LEN = 256
+
+
+class Change(NamedTuple):
+    path: str
+    offset: int
+    old: int
+    new: int
+    leaf: Leaf
+
+
+def changed_ranges(
+    old: Buffer, new: Buffer, gap: int = MERGE_GAP
+) -> List[Tuple[int, int]]:
+    """
+    Finds the byte ranges [start, end) that differ between two equally long
+    buffers, merging ranges separated by at most `gap` unchanged bytes.
+    """
+    if len(old) != len(new):
+        raise ValueError(f"buffer lengths differ ({len(old)} != {len(new)})")
+    if np is not None:
+        a = np.frombuffer(old, dtype=np.uint8)
+        b = np.frombuffer(new, dtype=np.uint8)
+        idx = np.flatnonzero(a != b)
+        if idx.size == 0:
+            return []
+        breaks = np.flatnonzero(np.diff(idx) > gap + 1)
+        starts = np.concatenate(([idx[0]], idx[breaks + 1]))
+        ends = np.concatenate((idx[breaks], [idx[-1]])) + 1
+        return list(zip(starts.tolist(), ends.tolist()))
+
+    old, new = memoryview(old).cast("B"), memoryview(new).cast("B")
+    ranges: List[Tuple[int, int]] = []
+    for chunk in range(0, len(old), CHUNK_LEN):
+        stop = min(chunk + CHUNK_LEN, len(old))
+        if old[chunk:stop] == new[chunk:stop]:
+            continue
+        for i in range(chunk, stop):
+            if old[i] != new[i]:
+                if ranges and i - ranges[-1][1] <= gap:
+                    ranges[-1] = (ranges[-1][0], i + 1)
+                else:
+                    ranges.append((i, i + 1))
+    return ranges
+
+
+class SnapshotDiffer:
+    """Diffs snapshots of a type field by field"""
+
+    def __init__(
+        self,
+        layouts: Layouts,
+        type_name: str = DEFAULT_TYPE,
+        include: Optional[str] = None,
+        exclude: Optional[str] = None,
+    ):
+        self.layouts = layouts
+        self.type_name = type_name
+        self.size = layouts.sizeof(type_name)
+        self._include = re.compile(include) if include else None
+        self._exclude = re.compile(exclude) if exclude else None
+
+    def _wanted(self, path: str) -> bool:
+        if self._include is not None and not self._include.search(path):
+            return False
+        return self._exclude is None or not self._exclude.search(path)
+
+    def diff(self, old: Buffer, new: Buffer) -> Iterator[Change]:
+        """Yields the fields whose values differ between two snapshots"""
+        # A leaf can overlap two adjacent ranges; don't report it twice
+        carried: Set[str] = set()
+        for start, end in changed_ranges(old, new):
+            seen = carried
+            carried = set()
+            for leaf in self.layouts.leaves(self.type_name, start, end):
+                if leaf.offset + leaf.size > end:
+                    carried.add(leaf.path)
+                if leaf.offset < start and leaf.path in seen:
+                    continue
+                if not self._wanted(leaf.path):
+                    continue
+                a = self.layouts.read_leaf(leaf, old)
+                b = self.layouts.read_leaf(leaf, new)
+                if a != b:
+                    yield Change(leaf.path, leaf.offset, a, b, leaf)
+
+    def diff_frames(self, frames: Iterator[Buffer]) -> Iterator[Tuple[int, Change]]:
+        """Yields (frame number, change) pairs over a sequence of snapshots"""
+        prev = None
+        for i, frame in enumerate(frames):
+            if len(frame) != self.size:
+                raise ValueError(
+                    f"frame {i} is {len(frame)} bytes, expected {self.size}"
+                )
+            if prev is not None:
+                for change in self.diff(prev, frame):
+                    yield i, change
+            prev = frame
+
+
+def read_stream(f: BinaryIO, frame_len: int) -> Iterator[bytes]:
+    """Reads fixed-size frames from a stream, ignoring a trailing partial frame"""
+    while True:
+        frame = f.read(frame_len)
+        if len(frame) < frame_len:
+            if frame:
+                print(
+                    f"Warning: ignoring trailing partial frame ({len(frame)} bytes)",
+                    file=sys.stderr,
+                )
+            return
+        yield frame
+
+
+def read_dumps(
+    paths: List[str], layouts: Layouts, name: str, version: str
+) -> Iterator[bytes]:
+    """Reads a RAM global out of each of a list of RAM dumps"""
+    g = layouts.globals.get(name)
+    if g is None or g.binary != "ram":
+        raise KeyError(f"'{name}' is not declared in data/ram.h")
+    size = layouts.sizeof(g.type, g.pointer)
+    for path in paths:
+        with RamDump(path, layouts, version) as dump:
+            start = dump.mapped.relative(dump.address_of(name))
+            yield bytes(dump.contents[start : start + size])
+
+
+def format_change(layouts: Layouts, change: Change) -> str:
+    def fmt(value: int) -> str:
+        if change.leaf.type.startswith("enum "):
+            name = layouts.enum_name(change.leaf.type, value)
+            if name is not None:
+                return name
+        if change.leaf.pointer:
+            return f"{value:#x}"
+        return str(value)
+
+    return (
+        f"{change.path} (+{change.offset:#x}): {fmt(change.old)} -> {fmt(change.new)}"
+    )
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(
+        description="Diff snapshots of a struct field by field"
+    )
+    parser.add_argument("dumps", nargs="*", help="RAM dumps, one per frame")
+    parser.add_argument(
+        "--stream",
+        help="file of raw concatenated frames of sizeof(type) bytes ('-' for stdin)",
+    )
+    parser.add_argument(
+        "-t",
+        "--type",
+        help=f"type of the frames in a stream (default: '{DEFAULT_TYPE}')",
+    )
+    parser.add_argument(
+        "-g",
+        "--global",
+        dest="global_name",
+        default=DEFAULT_GLOBAL,
+        help=f"RAM global to read from dumps (default: {DEFAULT_GLOBAL})",
+    )
+    parser.add_argument(
+        "-v",
+        "--version",
+        choices=["NA", "EU", "JP"],
+        default="NA",
+        help="game version of the RAM dumps",
+    )
+    parser.add_argument(
+        "-l",
+        "--layouts",
+        help="load previously emitted layout tables instead of the headers",
+    )
+    parser.add_argument(
+        "-i", "--include", help="only report field paths matching this regex"
+    )
+    parser.add_argument(
+        "-x", "--exclude", help="don't report field paths matching this regex"
+    )
+    parser.add_argument(
+        "-f",
+        "--format",
+        choices=["text", "jsonl"],
+        default="text",
+        help="output format for changes",
+    )
+    parser.add_argument(
+        "-s",
+        "--summary",
+        action="store_true",
+        help="only print how many times each field changed",
+    )
+    args = parser.parse_args()
+
+    if (args.stream is None) == (not args.dumps):
+        parser.error("give either RAM dumps or --stream, but not both")
+
+    layouts = Layouts.load(args.layouts) if args.layouts else Layouts.from_headers()
+    if args.stream is not None:
+        type_name = args.type or DEFAULT_TYPE
+    else:
+        g = layouts.globals.get(args.global_name)
+        if g is None or g.binary != "ram":
+            sys.exit(f"Unknown RAM global: '{args.global_name}'")
+        if g.pointer or g.dims:
+            sys.exit(f"'{args.global_name}' is not a struct or scalar")
+        type_name = g.type
+    differ = SnapshotDiffer(layouts, type_name, args.include, args.exclude)
+
+    if args.stream is None:
+        frames = read_dumps(args.dumps, layouts, args.global_name, args.version)
+        changes = differ.diff_frames(frames)
+    elif args.stream == "-":
+        changes = differ.diff_frames(read_stream(sys.stdin.buffer, differ.size))
+    else:
+        stream = open(args.stream, "rb")
+        changes = differ.diff_frames(read_stream(stream, differ.size))
+
+    counts: Counter = Counter()
+    frame = None
+    for i, change in changes:
+        if args.summary:
+            counts[change.path] += 1
+        elif args.format == "jsonl":
+            print(
+                json.dumps(
+                    {
+                        "frame": i,
+                        "path": change.path,
+                        "offset": change.offset,
+                        "old": change.old,
+                        "new": change.new,
+                    }
+                )
+            )
+        else:
+            if i != frame:
+                print(f"Frame {i}:")
+                frame = i
+            print(f"  {format_change(layouts, change)}")
+    if args.summary:
+        for path, count in counts.most_common():
+            print(f"{count:8} {path}")
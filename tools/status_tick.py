@@ -0,0 +1,472 @@
+#!/usr/bin/env python3
+
+"""
+`status_tick.py` is a command line utility and Python module for advancing
+the status conditions (struct statuses) and HP of many monsters turn by turn,
+with numpy, in a packed representation that is cheap to copy, hash and
+compare.
+
+Monsters are read from frames of DUNGEON_STRUCT like in `entity_query.py`
+(RAM dumps, a stream of raw frames, or a trace file written by
+`trace_store.py`), and every valid monster slot of every frame becomes a row
+of a `StatusState`. The layout of struct statuses is taken from the headers,
+and only the bytes that take part in a turn tick are kept, as a
+(monsters x columns) uint8 matrix:
+    - one column per status field (e.g., `sleep`, `burn`, `grudge`), holding
+      which status of the group is active, or 0;
+    - one column per turn counter (`<status>_turns`,
+      `<status>_damage_countdown`, `perish_song_turns`, and the
+      `speed_up_counters` and `speed_down_counters`);
+    - the speed stage (statuses::speed_stage), which is always in [0, 4].
+HP is kept alongside as an int16 column. Copying a roster is a single array
+copy, the active statuses of a monster are available as a 64-bit mask
+(`StatusSchema.flags`), and the rows can be compared as raw bytes
+(`StatusState.row_keys`, `StatusState.key`) or as 64-bit hashes
+(`StatusState.row_hashes`), e.g., to deduplicate states in a turn simulator.
+
+A turn (TickStatusAndHealthRegen) is modeled as follows:
+    - HP regenerates by a caller-supplied amount, up to max HP
+      (max_hp_stat + max_hp_boost). Monsters with 0 HP don't regenerate. The
+      regen formula itself (GetRegenSpeed, Poison Heal, Heal Ribbon, weather)
+      isn't documented well enough to be reproduced.
+    - The residual damage countdown of every active status ticks down, and
+      reaching 0 is reported as a residual damage event. The amount of damage
+      and how the countdown is reset afterwards are not modeled.
+    - The turn counter of every active status ticks down, and the status is
+      healed (its field and damage countdown are cleared) when the counter
+      reaches 0. Counters at 0 don't tick, and statuses whose counter is
+      already 0 are left alone.
+    - perish_song_turns ticks down, and reaching 0 is reported as an event
+      (the effect of Perish Song is not modeled).
+    - Every nonzero speed counter ticks down, and the speed stage is
+      recalculated as min(max({# nonzero speed_up_counters} -
+      {# nonzero speed_down_counters}, 0), 4), as documented on
+      statuses::speed_up_counters.
+Counters tick like TickStatusTurnCounter, which leaves a value of 0x7F
+(an indefinite duration) alone. The order of these steps within
+TickStatusAndHealthRegen, and any status-specific special cases, are not
+documented, so this is a model of the documented behavior rather than an
+exact reimplementation.
+
+Example usage:
+python3 status_tick.py -l layouts.bin ram.bin --turns 10
+python3 status_tick.py -l layouts.bin --stream frames.bin --turns 5 --events
+python3 status_tick.py -l layouts.bin ram.bin --benchmark 1000000
+
+Library usage:
+    schema = StatusSchema(layouts)
+    state, frame_ids, slots = schema.read(EntityTable(layouts, frames, base))
+    events = schema.tick(state, regen=1)  # modifies state in place
+"""
+
+import argparse
+import sys
+import time
+from typing import Dict, List, NamedTuple, Tuple
+
+import numpy as np
+
+from entity_query import (
+    DEFAULT_BATCH_FRAMES,
+    DUNGEON_TYPE,
+    MONSTER_TYPE,
+    EntityTable,
+    dump_frames,
+    dungeon_address,
+    stream_batches,
+    trace_batches,
+)
+from layouts import Layouts
+
+STATUSES_TYPE = "struct statuses"
+STATUSES_FIELD = "statuses"
+# TickStatusTurnCounter doesn't decrease counters with this value
+TURN_COUNTER_INDEFINITE = 0x7F
+NORMAL_SPEED_STAGE = 1
+MAX_SPEED_STAGE = 4
+TURNS_SUFFIX = "_turns"
+COUNTDOWN_SUFFIX = "_damage_countdown"
+SPEED_UP_COUNTERS = "speed_up_counters"
+SPEED_DOWN_COUNTERS = "speed_down_counters"
+SPEED_STAGE = "speed_stage"
+PERISH_SONG_TURNS = "perish_song_turns"
+# Fields of struct statuses that are neither status conditions nor timers
+NON_STATUS_FIELDS = {"boss_flag", "in_action", "no_slip_cap_counter", "bide_move_slot"}
+FNV_OFFSET_BASIS = np.uint64(0xCBF29CE484222325)
+FNV_PRIME = np.uint64(0x100000001B3)
+
+
+class StatusState:
+    """
+    Packed statuses and HP of a roster of monsters. Rows are monsters; the
+    columns of `data` are described by the `StatusSchema` that made the state.
+    """
+
+    def __init__(self, data: np.ndarray, hp: np.ndarray, max_hp: np.ndarray):
+        self.data = data
+        self.hp = hp
+        self.max_hp = max_hp
+
+    def __len__(self) -> int:
+        return self.data.shape[0]
+
+    def copy(self) -> "StatusState":
+        return StatusState(self.data.copy(), self.hp.copy(), self.max_hp)
+
+    def take(self, rows: np.ndarray) -> "StatusState":
+        """A new state with the given rows (e.g., to replicate a roster)"""
+        return StatusState(self.data[rows], self.hp[rows], self.max_hp[rows])
+
+    def row_keys(self) -> np.ndarray:
+        """
+        One fixed-size bytes value per monster covering every column and HP,
+        for hashing, comparison and np.unique()
+        """
+        hp = self.hp.astype("<i2").view(np.uint8).reshape(len(self), 2)
+        rows = np.ascontiguousarray(np.concatenate([self.data, hp], axis=1))
+        return rows.view(np.dtype((np.void, rows.shape[1]))).ravel()
+
+    def row_hashes(self) -> np.ndarray:
+        """
+        A 64-bit hash of each row of row_keys() (FNV-1a over 64-bit words),
+        which is much faster than the keys themselves to sort or deduplicate
+        """
+        keys = self.row_keys()
+        width = keys.dtype.itemsize
+        words = np.zeros((len(self), -(-width // 8) * 8), dtype=np.uint8)
+        words[:, :width] = keys.view(np.uint8).reshape(len(self), width)
+        h = np.full(len(self), FNV_OFFSET_BASIS, dtype=np.uint64)
+        for word in words.view("<u8").T:
+            h = (h ^ word) * FNV_PRIME
+        return h
+
+    def key(self) -> bytes:
+        """A hashable key for the state of the whole roster"""
+        return self.data.tobytes() + self.hp.astype("<i2").tobytes()
+
+    def equal(self, other: "StatusState") -> np.ndarray:
+        """Whether each monster is in the same state in both rosters"""
+        return (self.data == other.data).all(axis=1) & (self.hp == other.hp)
+
+
+class Timer(NamedTuple):
+    """A turn counter column, and the status column it belongs to (or -1)"""
+
+    name: str
+    column: int
+    owner: int
+
+
+class TickEvents(NamedTuple):
+    """What happened to each monster during a tick, as (monsters x n) arrays"""
+
+    # Statuses healed, per StatusSchema.turns
+    healed: np.ndarray
+    # Residual damage countdowns that reached 0, per StatusSchema.countdowns
+    residual: np.ndarray
+    # Whether perish_song_turns reached 0, shape (monsters,)
+    perish: np.ndarray
+
+
+class StatusSchema:
+    """
+    The packed columns of struct statuses, and the turn tick over them
+    """
+
+    def __init__(self, layouts: Layouts):
+        self.layouts = layouts
+        self.statuses_offset = layouts.resolve_path(MONSTER_TYPE, STATUSES_FIELD)[0]
+        fields: Dict[str, int] = {}
+        for leaf in layouts.leaves(STATUSES_TYPE):
+            name = leaf.path
+            if (
+                leaf.size != 1
+                or leaf.pointer
+                or "." in name
+                or name.startswith("field_")
+                or name in NON_STATUS_FIELDS
+            ):
+                continue
+            fields[name] = leaf.offset
+
+        timer_names = [
+            n
+            for n in fields
+            if n.endswith(TURNS_SUFFIX)
+            or n.endswith(COUNTDOWN_SUFFIX)
+            or n.startswith((SPEED_UP_COUNTERS, SPEED_DOWN_COUNTERS))
+        ]
+        # Status fields first, then timers, then the speed stage
+        self.status_names: List[str] = [n for n in fields if n not in timer_names]
+        if len(self.status_names) > 64:
+            raise ValueError("too many status fields for a 64-bit mask")
+        self.names: List[str] = self.status_names + timer_names + [SPEED_STAGE]
+        self.columns = {name: i for i, name in enumerate(self.names)}
+        self.byte_offsets = np.array(
+            [fields[n] for n in self.status_names + timer_names], dtype=np.int64
+        )
+        self.speed_stage_column = self.columns[SPEED_STAGE]
+
+        def owner(name: str, suffix: str) -> int:
+            return self.columns.get(name[: -len(suffix)], -1)
+
+        self.turns = [
+            Timer(n, self.columns[n], owner(n, TURNS_SUFFIX))
+            for n in timer_names
+            if n.endswith(TURNS_SUFFIX) and owner(n, TURNS_SUFFIX) >= 0
+        ]
+        self.countdowns = [
+            Timer(n, self.columns[n], owner(n, COUNTDOWN_SUFFIX))
+            for n in timer_names
+            if n.endswith(COUNTDOWN_SUFFIX) and owner(n, COUNTDOWN_SUFFIX) >= 0
+        ]
+        self.perish_column = self.columns.get(PERISH_SONG_TURNS, -1)
+        self.speed_up = np.array(
+            [self.columns[n] for n in timer_names if n.startswith(SPEED_UP_COUNTERS)],
+            dtype=np.int64,
+        )
+        self.speed_down = np.array(
+            [self.columns[n] for n in timer_names if n.startswith(SPEED_DOWN_COUNTERS)],
+            dtype=np.int64,
+        )
+
+        self._turn_cols = np.array([t.column for t in self.turns], dtype=np.int64)
+        self._turn_owners = np.array([t.owner for t in self.turns], dtype=np.int64)
+        self._cd_cols = np.array([t.column for t in self.countdowns], dtype=np.int64)
+        self._cd_owners = np.array([t.owner for t in self.countdowns], dtype=np.int64)
+        # For each turn counter, the damage countdown of the same status (or -1)
+        cd_by_owner = {t.owner: t.column for t in self.countdowns}
+        self._turn_cds = np.array(
+            [cd_by_owner.get(t.owner, -1) for t in self.turns], dtype=np.int64
+        )
+
+    def read(self, table: EntityTable) -> Tuple[StatusState, np.ndarray, np.ndarray]:
+        """
+        Packs the valid monsters of an entity table. Returns the state, and
+        the frame and slot of each row.
+        """
+        frames, slots = np.nonzero(table.valid)
+        offsets = table.monster_offsets[frames, slots] + self.statuses_offset
+        n = len(frames)
+        data = np.empty((n, len(self.names)), dtype=np.uint8)
+        data[:, : len(self.byte_offsets)] = table.frames[
+            frames[:, None], offsets[:, None] + self.byte_offsets
+        ]
+        speed_stage = table.field(f"{STATUSES_FIELD}.{SPEED_STAGE}")[frames, slots]
+        data[:, self.speed_stage_column] = np.clip(speed_stage, 0, MAX_SPEED_STAGE)
+        hp = table.field("hp")[frames, slots].astype(np.int16)
+        max_hp = table.field("max_hp_stat") + table.field("max_hp_boost")
+        return (
+            StatusState(data, hp, max_hp[frames, slots].astype(np.int16)),
+            frames + table.first_frame,
+            slots,
+        )
+
+    def flags(self, state: StatusState) -> np.ndarray:
+        """A uint64 mask of the active statuses of each monster (per status_names)"""
+        active = state.data[:, : len(self.status_names)] != 0
+        packed = np.packbits(active, axis=1, bitorder="little")
+        padded = np.zeros((len(state), 8), dtype=np.uint8)
+        padded[:, : packed.shape[1]] = packed
+        return padded.view("<u8").ravel()
+
+    @staticmethod
+    def _tick_counters(counters: np.ndarray, active: np.ndarray) -> np.ndarray:
+        """Ticks counters like TickStatusTurnCounter; returns which reached 0"""
+        ticking = active & (counters != 0) & (counters != TURN_COUNTER_INDEFINITE)
+        counters -= ticking.astype(np.uint8)
+        return ticking & (counters == 0)
+
+    def tick(self, state: StatusState, regen=0) -> TickEvents:
+        """
+        Advances every monster by one turn, in place. regen is the HP each
+        monster regenerates this turn (a scalar or a per-monster array).
+        """
+        data = state.data
+        regenerating = (state.hp > 0) & (state.hp < state.max_hp)
+        state.hp[:] = np.where(
+            regenerating,
+            np.minimum(state.hp + np.asarray(regen), state.max_hp),
+            state.hp,
+        ).astype(np.int16)
+
+        countdowns = data[:, self._cd_cols]
+        residual = self._tick_counters(countdowns, data[:, self._cd_owners] != 0)
+        data[:, self._cd_cols] = countdowns
+
+        turns = data[:, self._turn_cols]
+        owners = data[:, self._turn_owners]
+        healed = self._tick_counters(turns, owners != 0)
+        data[:, self._turn_cols] = turns
+        data[:, self._turn_owners] = np.where(healed, 0, owners)
+        has_cd = self._turn_cds >= 0
+        if has_cd.any():
+            cd_cols = self._turn_cds[has_cd]
+            data[:, cd_cols] = np.where(healed[:, has_cd], 0, data[:, cd_cols])
+
+        if self.perish_column >= 0:
+            perish_turns = data[:, self.perish_column]
+            perish = self._tick_counters(perish_turns, np.ones(len(state), dtype=bool))
+            data[:, self.perish_column] = perish_turns
+        else:
+            perish = np.zeros(len(state), dtype=bool)
+
+        speed_cols = np.concatenate([self.speed_up, self.speed_down])
+        speed = data[:, speed_cols]
+        self._tick_counters(speed, np.ones(speed.shape, dtype=bool))
+        data[:, speed_cols] = speed
+        n_up = (speed[:, : len(self.speed_up)] != 0).sum(axis=1)
+        n_down = (speed[:, len(self.speed_up) :] != 0).sum(axis=1)
+        data[:, self.speed_stage_column] = np.clip(n_up - n_down, 0, MAX_SPEED_STAGE)
+        return TickEvents(healed, residual, perish)
+
+    def describe(self, state: StatusState, row: int) -> str:
+        """The active statuses of a monster, as `name=value(turns left)`"""
+        values = state.data[row]
+        turns_by_owner = {t.owner: values[t.column] for t in self.turns}
+        parts = []
+        for i, name in enumerate(self.status_names):
+            if values[i]:
+                turns = turns_by_owner.get(i)
+                parts.append(
+                    f"{name}={values[i]}" + (f"({turns})" if turns is not None else "")
+                )
+        stage = int(values[self.speed_stage_column])
+        if stage != NORMAL_SPEED_STAGE:
+            parts.append(f"{SPEED_STAGE}={stage}")
+        if self.perish_column >= 0 and values[self.perish_column]:
+            parts.append(f"{PERISH_SONG_TURNS}={values[self.perish_column]}")
+        return " ".join(parts)
+
+
+def benchmark(schema: StatusSchema, state: StatusState, n_monsters: int) -> float:
+    """
+    Ticks a roster of n_monsters monsters (replicating the input) until every
+    monster has had its statuses cleared or 100 turns have passed, counting
+    distinct states (by row hash) after every turn. Returns monster-turns/s.
+    """
+    if len(state) == 0:
+        raise ValueError("no monsters to replicate")
+    roster = state.take(np.arange(n_monsters) % len(state))
+    start = time.perf_counter()
+    turns = 0
+    for _ in range(100):
+        schema.tick(roster)
+        np.unique(roster.row_hashes())
+        turns += 1
+        if not schema.flags(roster).any():
+            break
+    return n_monsters * turns / (time.perf_counter() - start)
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(
+        description="Advance status conditions and HP of monsters turn by turn"
+    )
+    parser.add_argument("dumps", nargs="*", help="RAM dumps, one per frame")
+    parser.add_argument(
+        "--stream",
+        help="file of raw concatenated frames of sizeof(struct dungeon) bytes",
+    )
+    parser.add_argument("--trace", help="trace file written by trace_store.py")
+    parser.add_argument(
+        "-t", "--turns", type=int, default=1, help="number of turns to advance"
+    )
+    parser.add_argument(
+        "--regen",
+        type=int,
+        default=0,
+        help="HP every monster regenerates per turn",
+    )
+    parser.add_argument(
+        "--events",
+        action="store_true",
+        help="print statuses healed and other events instead of the final state",
+    )
+    parser.add_argument(
+        "--benchmark",
+        type=int,
+        metavar="N",
+        help="tick a roster of N monsters (replicating the input) and report "
+        + "monster-turns/s",
+    )
+    parser.add_argument(
+        "-b",
+        "--batch",
+        type=int,
+        default=DEFAULT_BATCH_FRAMES,
+        help="number of frames to process at once",
+    )
+    parser.add_argument(
+        "--base",
+        type=lambda x: int(x, 0),
+        help="address of DUNGEON_STRUCT (default: from the symbol tables)",
+    )
+    parser.add_argument(
+        "-v",
+        "--version",
+        choices=["NA", "EU", "JP"],
+        default="NA",
+        help="game version of the frames",
+    )
+    parser.add_argument(
+        "-l",
+        "--layouts",
+        help="load previously emitted layout tables instead of the headers",
+    )
+    args = parser.parse_args()
+
+    if sum((bool(args.dumps), args.stream is not None, args.trace is not None)) != 1:
+        parser.error("give exactly one of RAM dumps, --stream or --trace")
+
+    layouts = Layouts.load(args.layouts) if args.layouts else Layouts.from_headers()
+    base = args.base if args.base is not None else dungeon_address(args.version)
+    frame_len = layouts.sizeof(DUNGEON_TYPE)
+    schema = StatusSchema(layouts)
+
+    if args.stream is not None:
+        batches = stream_batches(args.stream, frame_len, 0, None, args.batch)
+    elif args.trace is not None:
+        batches = trace_batches(args.trace, layouts, 0, None, args.batch)
+    else:
+        batches = iter([(0, dump_frames(args.dumps, layouts, args.version))])
+
+    if args.benchmark is not None:
+        first, frames = next(batches)
+        state = schema.read(EntityTable(layouts, frames, base, first))[0]
+        try:
+            rate = benchmark(schema, state, args.benchmark)
+        except ValueError as e:
+            sys.exit(str(e))
+        print(f"{rate:,.0f} monster-turns/s")
+        sys.exit(0)
+
+    healed_labels = [f"healed {schema.names[t.owner]}" for t in schema.turns]
+    residual_labels = [f"residual {schema.names[t.owner]}" for t in schema.countdowns]
+    if args.events:
+        print("\t".join(["frame", "slot", "turn", "event"]))
+    else:
+        print("\t".join(["frame", "slot", "hp", "statuses"]))
+    for first, frames in batches:
+        state, frame_ids, slots = schema.read(EntityTable(layouts, frames, base, first))
+        for turn in range(1, args.turns + 1):
+            events = schema.tick(state, args.regen)
+            if not args.events:
+                continue
+            rows: List[Tuple[int, str]] = []
+            for labels, mask in (
+                (healed_labels, events.healed),
+                (residual_labels, events.residual),
+            ):
+                for r, c in zip(*np.nonzero(mask)):
+                    rows.append((int(r), labels[c]))
+            for r in np.nonzero(events.perish)[0]:
+                rows.append((int(r), "perish song"))
+            for r, event in sorted(rows):
+                print(f"{frame_ids[r]}\t{slots[r]}\t{turn}\t{event}")
+        if not args.events:
+            for r in range(len(state)):
+                print(
+                    f"{frame_ids[r]}\t{slots[r]}\t{state.hp[r]}\t"
+                    + schema.describe(state, r)
+                )
@@ -59,7 +59,7 @@ from pathlib import Path
 import re
 import subprocess
 import sys
-from typing import Dict, Generator, Iterable, List, Optional, Union
+from typing import Dict, Generator, List, Optional, Union
 import yaml
 
 import arm5find
@@ -116,28 +116,6 @@ class SymbolTable:
             SymbolTable.fmt(str(self.path))
 
 
-def find_binary_files(dirname: str, binaries: Iterable[str]) -> Dict[str, str]:
-    """Locate the files corresponding to the given binaries within a directory.
-
-    Args:
-        dirname (str): path of the directory to search
-        binaries (Iterable[str]): collection of binaries to search for
-
-    Returns:
-        Dict[str, str]: mapping from binaries to located file paths
-    """
-    binary_files: Dict[str, str] = {}
-    binary_set = set(binaries)
-    for fpath in Path(dirname).glob("**/*.bin"):
-        name = fpath.name.rstrip(".bin")
-        if name.startswith("overlay"):
-            # overlay_0000 or overlay0000 -> overlay0, etc.
-            name = f"overlay{int(name.lstrip('overlay').lstrip('_'))}"
-        if name in binary_set:
-            binary_files[name] = str(fpath)
-    return binary_files
-
-
 class FillCounter:
     """Counters for printed summary statistics"""
 
@@ -165,7 +143,7 @@ class FillCounter:
 
 def function_fill_versions(
     function: dict,
-    file_contents_cache: Dict[str, bytes],
+    file_contents_cache: Dict[str, offsets.MappedBinary],
     file_by_version: Dict[str, str],
     bin_name: str,
     *,
@@ -177,8 +155,8 @@ def function_fill_versions(
 
     Args:
         function (dict): resymgen function symbol, can be mutated
-        file_contents_cache (Dict[str, bytes]): binary file contents by game
-            version, can be mutated
+        file_contents_cache (Dict[str, offsets.MappedBinary]): mapped binary
+            files by game version, can be mutated
         file_by_version (Dict[str, str]): binary file paths by game version
         bin_name (str): short name of the binary containing the function
         min_instr_count (int, optional): minimum instruction count for adaptive
@@ -252,10 +230,12 @@ def function_fill_versions(
         log_prefix = f"[{bin_name}, {dst_vers}] {function['name']}: "
 
         if dst_vers not in file_contents_cache:
-            # Read the binary file for the first time and cache it
-            with open(file_by_version[dst_vers], "rb") as f:
-                file_contents_cache[dst_vers] = f.read()
-        contents = file_contents_cache[dst_vers]
+            # Map the binary file for the first time and cache it
+            file_contents_cache[dst_vers] = offsets.MappedBinary(
+                file_by_version[dst_vers], dst_vers, bin_name
+            )
+        dst_binary = file_contents_cache[dst_vers]
+        contents = dst_binary.contents
 
         # Search for a single match. If there are multiple simultaneous
         # matches, the search was too permissive and the results don't count
@@ -348,9 +328,7 @@ def function_fill_versions(
 
         if match is not None:
             # Convert back to absolute address
-            match_addr = offsets.convert_offsets(dst_vers, [bin_name], [match.start()])[
-                0
-            ].get_mapped()[0]
+            match_addr = dst_binary.absolute(match.start())
             report(
                 f"{log_prefix}found address 0x{match_addr:X}",
                 0 if dry_run else 2,
@@ -392,8 +370,8 @@ def symbols_fill_versions(
     files_to_format: List[str] = []  # Only used in fast mode
 
     for bin_name, file_by_version in binaries.items():
-        # Keep a cache of file contents by version to avoid loading them many times
-        binary_contents: Dict[str, bytes] = {}
+        # Keep a cache of mapped files by version to avoid loading them many times
+        binary_contents: Dict[str, offsets.MappedBinary] = {}
 
         counters[bin_name] = FillCounter()
 
@@ -426,6 +404,9 @@ def symbols_fill_versions(
                     files_to_format.append(str(symbol_table.path))
             counters[bin_name] += table_counter
 
+        for mapped in binary_contents.values():
+            mapped.close()
+
     if files_to_format:
         SymbolTable.fmt(files_to_format)
 
@@ -482,7 +463,7 @@ if __name__ == "__main__":
     # Outer key is binary name, inner key is version, inner value is file path.
     files_by_version: Dict[str, Dict[str, str]] = {name: {} for name in args.binary}
     for vers, data_dir in data_dirs.items():
-        files = find_binary_files(data_dir, args.binary)
+        files = offsets.find_binary_files(data_dir, args.binary)
         if len(files) < len(args.binary):
             missing = sorted(set(args.binary) - set(files))
             raise SystemExit(f"Missing binaries from {data_dir}: {', '.join(missing)}")
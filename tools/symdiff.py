@@ -33,17 +33,23 @@ python3 symdiff.py -sdv <tag name, commit hash, or branch name>
 """
 
 import argparse
+import atexit
 import collections
+from concurrent.futures import ProcessPoolExecutor
 import difflib
 from io import StringIO
+import math
+import os
 from pathlib import Path
 import subprocess
 import sys
 from typing import (
+    Any,
     cast,
     Deque,
     Dict,
     Iterable,
+    Iterator,
     List,
     Optional,
     Set,
@@ -58,6 +64,9 @@ import ansi
 REPO_ROOT: Path = Path(__file__).resolve().parent.parent
 SYMBOL_DIR: Path = REPO_ROOT / "symbols"
 
+# Use the libyaml-based loader if it's available, since it's much faster
+YamlLoader = getattr(yaml, "CSafeLoader", yaml.SafeLoader)
+
 
 def git_cmd(args: List[str]) -> str:
     """
@@ -108,6 +117,91 @@ def ensure_revision_exists(revision: str):
         raise ValueError(e.stderr.decode())
 
 
+class GitBlobReader:
+    """
+    Reads files at a git revision through a single long-running
+    `git cat-file --batch` process, rather than spawning a new process for
+    every file.
+    """
+
+    def __init__(self, revision: str):
+        """
+        Args:
+            revision (str): git revision
+
+        Raises:
+            ValueError: revision does not exist
+        """
+        ensure_revision_exists(revision)
+        self.revision = revision
+        self.process = subprocess.Popen(
+            ["git", "-C", str(REPO_ROOT), "cat-file", "--batch"],
+            stdin=subprocess.PIPE,
+            stdout=subprocess.PIPE,
+        )
+
+    def read(self, path_from_root: str) -> str:
+        """Read a file at the reader's revision.
+
+        Args:
+            path_from_root (str): file path relative to the repository root,
+                with forward slashes
+
+        Raises:
+            FileNotFoundError: file path does not exist for the revision
+
+        Returns:
+            str: file contents
+        """
+        self.process.stdin.write(f"{self.revision}:{path_from_root}\n".encode())
+        self.process.stdin.flush()
+        # The header is "<object> <type> <size>" on success, or something like
+        # "<object> missing" on failure
+        header = self.process.stdout.readline().decode().split()
+        if len(header) != 3:
+            raise FileNotFoundError(
+                f"fatal: path '{path_from_root}' does not exist in '{self.revision}'"
+            )
+        # The contents are followed by a newline
+        contents = self.process.stdout.read(int(header[2]) + 1)[:-1]
+        if header[1] != "blob":
+            raise FileNotFoundError(
+                f"fatal: path '{path_from_root}' is not a file in '{self.revision}'"
+            )
+        return contents.decode()
+
+    def close(self):
+        self.process.stdin.close()
+        self.process.wait()
+
+
+# Shared GitBlobReaders by revision
+_blob_readers: Dict[str, GitBlobReader] = {}
+
+
+def get_blob_reader(revision: str) -> GitBlobReader:
+    """Get the shared GitBlobReader for a revision, creating it if necessary.
+
+    Args:
+        revision (str): git revision
+
+    Raises:
+        ValueError: revision does not exist
+
+    Returns:
+        GitBlobReader: reader for the revision
+    """
+    if revision not in _blob_readers:
+        _blob_readers[revision] = GitBlobReader(revision)
+    return _blob_readers[revision]
+
+
+@atexit.register
+def _close_blob_readers():
+    for reader in _blob_readers.values():
+        reader.close()
+
+
 def open_file_at_revision(path: Path, revision: Optional[str]) -> TextIO:
     """Read a file from the repository as it was at the given revision.
 
@@ -132,13 +226,7 @@ def open_file_at_revision(path: Path, revision: Optional[str]) -> TextIO:
     if revision is None:
         return path.open("r")
 
-    ensure_revision_exists(revision)
-    try:
-        return StringIO(git_cmd(["show", f"{revision}:{path_from_root}"]))
-    except subprocess.CalledProcessError as e:
-        # Since we already made sure the revision exists, assume a
-        # CalledProcessError means the file doesn't exist in the revision
-        raise FileNotFoundError(e.stderr.decode())
+    return StringIO(get_blob_reader(revision).read(path_from_root))
 
 
 class SymbolPath:
@@ -456,21 +544,41 @@ class Symbol:
         )
 
 
-class MatchRank:
-    """
-    Represents the quality of the match between two symbols. Functions as a
-    tuple (# matching addresses, whether or not the names match).
+def merge_join(left: List[Tuple], right: List[Tuple]) -> Iterator[Tuple[Any, Any]]:
     """
+    Sort-merge join of two sorted lists of (key, value) tuples. Yields
+    (left value, right value) for every pair of entries with equal keys.
 
-    def __init__(self, n_matches: int = 0, matching_name: bool = False):
-        self.n_matches = n_matches
-        self.matching_name = matching_name
-
-    def __repr__(self) -> str:
-        return repr(self.key())
+    Args:
+        left (List[Tuple]): sorted left entries
+        right (List[Tuple]): sorted right entries
 
-    def key(self) -> Tuple[int, bool]:
-        return (self.n_matches, self.matching_name)
+    Returns:
+        Iterator[Tuple[Any, Any]]: pairs of values with matching keys
+    """
+    i = 0
+    j = 0
+    while i < len(left) and j < len(right):
+        lkey = left[i][0]
+        rkey = right[j][0]
+        if lkey < rkey:
+            i += 1
+        elif lkey > rkey:
+            j += 1
+        else:
+            # Keys can be duplicated on both sides; take the cross product of
+            # the runs of equal keys
+            i_end = i
+            while i_end < len(left) and left[i_end][0] == lkey:
+                i_end += 1
+            j_end = j
+            while j_end < len(right) and right[j_end][0] == rkey:
+                j_end += 1
+            for _, lvalue in left[i:i_end]:
+                for _, rvalue in right[j:j_end]:
+                    yield lvalue, rvalue
+            i = i_end
+            j = j_end
 
 
 class SymbolList(list):
@@ -479,18 +587,39 @@ class SymbolList(list):
     def __init__(self, symbols: List[Symbol] = []):
         super().__init__(symbols)
 
+    def _address_keys(self) -> List[Tuple[Tuple[str, int], Tuple[int, int]]]:
+        """
+        Sorted ((version, address), (index, position)) entries for all
+        symbols, where position is the address's position within the symbol's
+        own address list
+        """
+        return sorted(
+            ((version, addr), (i, pos))
+            for i, s in enumerate(cast(List[Symbol], self))
+            for pos, (version, addr) in enumerate(
+                (version, addr)
+                for version, addrs in s.address.items()
+                for addr in addrs
+            )
+        )
+
+    def _name_keys(self) -> List[Tuple[str, int]]:
+        """Sorted (name, index) entries for all symbols"""
+        return sorted((s.name, i) for i, s in enumerate(cast(List[Symbol], self)))
+
     def _build_match_graph(self, base: "SymbolList") -> List[Dict[int, List[int]]]:
         """
         Find all candidate matches between symbols in self and symbols in base.
         This is a graph where the symbols are nodes and the matches are edges.
 
-        First, the symbols in base are indexed by (version, address) and by
-        name. Then, the indexes are queried for each (version, address) and
-        name of each symbol in self. Candidate matches are drawn when the query
-        returns a valid result, and the number and kind of valid query results
-        are tallied to assign each candidate match with a "match rank", which
-        measures the quality of the match. The match rank for a symbol pair is
-        defined as the tuple (# matching addresses, whether the names match).
+        First, the symbols in both lists are sorted by (version, address) and
+        by name. Then, the sorted lists are merge-joined to find all pairs of
+        symbols with a common (version, address) or a common name. Candidate
+        matches are drawn for each joined pair, and the number and kind of
+        joins are tallied to assign each candidate match with a "match rank",
+        which measures the quality of the match. The match rank for a symbol
+        pair is defined as the tuple (# matching addresses, whether the names
+        match).
 
         The collection of candidate matches are then grouped by match rank,
         and the groups are returned in descending order of rank.
@@ -503,36 +632,37 @@ class SymbolList(list):
                 descending order of match rank. Each dictionary element
                 corresponds to edges within a match rank group, and maps
                 {self index -> list of matching base indexes} for one or more
-                self indexes.
+                self indexes, in ascending order of self index.
+
+                Base indexes are ordered by the first address of the self
+                symbol that matched them, followed by base indexes that only
+                matched by name, and then in ascending order. This is the order
+                in which a symbol-by-symbol lookup would find them, and it
+                decides which pair wins a conflict that has several maximum
+                cardinality matchings.
         """
-        # Build lookup tables by address/name. The values need to be lists
-        # since addresses and names can technically be duplicated (although
-        # they shouldn't be)
-        base_addr_to_idx: Dict[Tuple[str, int], List[int]] = {}
-        base_name_to_idx: Dict[str, List[int]] = {}
-        for i, s in enumerate(cast(List[Symbol], base)):
-            for version, addrs in s.address.items():
-                for addr in addrs:
-                    base_addr_to_idx.setdefault((version, addr), []).append(i)
-            base_name_to_idx.setdefault(s.name, []).append(i)
-
-        # Matches in base for each element in self, alongside a "match rank"
-        matches: List[Dict[int, MatchRank]] = [{} for _ in range(len(self))]
-        for s, match_list in zip(cast(List[Symbol], self), matches):
-            for version, addrs in s.address.items():
-                for addr in addrs:
-                    for i_base in base_addr_to_idx.get((version, addr), []):
-                        match_list.setdefault(i_base, MatchRank()).n_matches += 1
-            for i_base in base_name_to_idx.get(s.name, []):
-                match_list.setdefault(i_base, MatchRank()).matching_name = True
-
-        # Aggregate the match list entries by match rank
+        # Addresses and names can technically be duplicated (although they
+        # shouldn't be), so the joins can produce the same pair more than once
+        addr_matches: Dict[Tuple[int, int], int] = collections.Counter()
+        # The position of the first address of the self symbol matching each
+        # pair
+        addr_positions: Dict[Tuple[int, int], int] = {}
+        for (i, pos), (j, _) in merge_join(self._address_keys(), base._address_keys()):
+            addr_matches[(i, j)] += 1
+            if pos < addr_positions.get((i, j), pos + 1):
+                addr_positions[(i, j)] = pos
+        name_matches: Set[Tuple[int, int]] = set(
+            merge_join(self._name_keys(), base._name_keys())
+        )
+
+        def lookup_order(pair: Tuple[int, int]) -> Tuple[int, float, int]:
+            return (pair[0], addr_positions.get(pair, math.inf), pair[1])
+
+        # Aggregate the candidate matches by match rank
         matches_by_rank: Dict[Tuple[int, bool], Dict[int, List[int]]] = {}
-        for i, mlist in enumerate(matches):
-            for m, rank in mlist.items():
-                matches_by_rank.setdefault(
-                    rank.key(), collections.OrderedDict()
-                ).setdefault(i, []).append(m)
+        for pair in sorted(addr_matches.keys() | name_matches, key=lookup_order):
+            rank = (addr_matches.get(pair, 0), pair in name_matches)
+            matches_by_rank.setdefault(rank, {}).setdefault(pair[0], []).append(pair[1])
         # Sort descending by rank, then throw out the ranks since we no longer
         # need them.
         return [
@@ -542,6 +672,59 @@ class SymbolList(list):
             )
         ]
 
+    @staticmethod
+    def _conflict_components(
+        edges: Dict[int, List[int]]
+    ) -> Tuple[List[Tuple[int, int]], List[Dict[int, List[int]]]]:
+        """
+        Split a bipartite graph into its unambiguous edges and its conflicts.
+
+        Args:
+            edges (Dict[int, List[int]]): Graph edges, as described by the
+                one-sided mapping of {left node -> right node neighbors}.
+                Neighbor lists are assumed to be nonempty.
+
+        Returns:
+            List[Tuple[int, int]]: edges (left node, right node) where both
+                nodes have no other incident edges
+            List[Dict[int, List[int]]]: the remaining connected components of
+                the graph, in the same format as the input
+        """
+        right_degree: Dict[int, int] = collections.Counter(
+            j for neighbors in edges.values() for j in neighbors
+        )
+        unambiguous: List[Tuple[int, int]] = []
+        # Union-find over the conflicting part of the graph. Left nodes are
+        # keyed by ("l", i) and right nodes by ("r", j)
+        parent: Dict[Tuple[str, int], Tuple[str, int]] = {}
+
+        def find(node: Tuple[str, int]) -> Tuple[str, int]:
+            root = node
+            while parent[root] != root:
+                root = parent[root]
+            while parent[node] != root:
+                parent[node], node = root, parent[node]
+            return root
+
+        for i, neighbors in edges.items():
+            if len(neighbors) == 1 and right_degree[neighbors[0]] == 1:
+                unambiguous.append((i, neighbors[0]))
+                continue
+            parent.setdefault(("l", i), ("l", i))
+            for j in neighbors:
+                parent.setdefault(("r", j), ("r", j))
+                root_i = find(("l", i))
+                root_j = find(("r", j))
+                if root_i != root_j:
+                    parent[root_j] = root_i
+
+        # Group the conflicting left nodes by component, preserving order
+        components: Dict[Tuple[str, int], Dict[int, List[int]]] = {}
+        for i, neighbors in edges.items():
+            if ("l", i) in parent:
+                components.setdefault(find(("l", i)), {})[i] = neighbors
+        return unambiguous, list(components.values())
+
     @staticmethod
     def _maximum_bipartite_matching(
         edges: Dict[int, List[int]]
@@ -665,19 +848,21 @@ class SymbolList(list):
         for edges in matches:
             # Filter out already indexes that we've already paired; higher
             # match ranks always win conflicts
-            edges = collections.OrderedDict(
-                (
-                    i_self,
-                    [i_base for i_base in base_idxs if i_base not in paired_base_idxs],
-                )
-                for i_self, base_idxs in edges.items()
-                if i_self not in self_to_base_idx
+            unpaired_edges: Dict[int, List[int]] = {}
+            for i_self, base_idxs in edges.items():
+                if i_self in self_to_base_idx:
+                    continue
+                base_idxs = [i for i in base_idxs if i not in paired_base_idxs]
                 # Make sure no keys correspond to an empty list
-                and not (set(base_idxs) <= paired_base_idxs)
-            )
+                if base_idxs:
+                    unpaired_edges[i_self] = base_idxs
             # Assign pairs from matches among the same rank by computing a
-            # maximum cardinality matching
-            pairs = SymbolList._maximum_bipartite_matching(edges)
+            # maximum cardinality matching. In the vast majority of cases there
+            # are no conflicts, so only run the full matching algorithm on the
+            # connected components that actually have conflicts
+            pairs, conflicts = SymbolList._conflict_components(unpaired_edges)
+            for component in conflicts:
+                pairs += SymbolList._maximum_bipartite_matching(component)
             self_to_base_idx.update(pairs)
             paired_base_idxs.update(p[1] for p in pairs)
 
@@ -771,7 +956,7 @@ class SymbolTable:
         self.blocks: Dict[str, SymbolBlock] = {}
         try:
             with open_file_at_revision(path, revision) as f:
-                contents = yaml.safe_load(f)
+                contents = yaml.load(f, Loader=YamlLoader)
             self.valid = True
         except FileNotFoundError:
             # This file doesn't exist in the given revision; mark it as invalid
@@ -821,7 +1006,7 @@ class SymbolTable:
                 sub_path = subregions.pop()
                 try:
                     with open_file_at_revision(sub_path, revision) as f:
-                        sub_contents = yaml.safe_load(f)
+                        sub_contents = yaml.load(f, Loader=YamlLoader)
                 except FileNotFoundError:
                     continue
                 process_subregion(sub_path, sub_contents)
@@ -859,6 +1044,60 @@ class SymbolTable:
         return symdiff
 
 
+def load_symbol_tables(
+    paths: List[Path], revision: Optional[str], descriptions: bool = False
+) -> List[SymbolTable]:
+    """Load a list of symbol tables at the given revision.
+
+    Args:
+        paths (List[Path]): paths to symbol table files. Must be within the
+            pmdsky-debug repository
+        revision (Optional[str]): revision, or None for the working tree
+        descriptions (bool, optional): whether or not to load symbol
+            descriptions. Defaults to False.
+
+    Returns:
+        List[SymbolTable]: loaded symbol tables, in the same order as paths
+    """
+    return [
+        SymbolTable(path, revision=revision, descriptions=descriptions)
+        for path in paths
+    ]
+
+
+def load_revisions(
+    paths: List[Path], base: str, target: Optional[str], descriptions: bool = False
+) -> Tuple[List[SymbolTable], List[SymbolTable]]:
+    """Load a list of symbol tables at both a base and a target revision.
+
+    If more than one CPU is available, the base revision is loaded in a worker
+    process while the target revision is loaded in this one. Each process reads
+    blobs through its own `git cat-file --batch` reader and parses YAML
+    independently, so the two loads run in parallel.
+
+    Args:
+        paths (List[Path]): paths to symbol table files. Must be within the
+            pmdsky-debug repository
+        base (str): base revision
+        target (Optional[str]): target revision, or None for the working tree
+        descriptions (bool, optional): whether or not to load symbol
+            descriptions. Defaults to False.
+
+    Returns:
+        Tuple[List[SymbolTable], List[SymbolTable]]: loaded symbol tables at
+            the base and target revisions, in the same order as paths
+    """
+    if (os.cpu_count() or 1) < 2:
+        return (
+            load_symbol_tables(paths, base, descriptions),
+            load_symbol_tables(paths, target, descriptions),
+        )
+    with ProcessPoolExecutor(max_workers=1) as executor:
+        old_future = executor.submit(load_symbol_tables, paths, base, descriptions)
+        new_tables = load_symbol_tables(paths, target, descriptions)
+        return old_future.result(), new_tables
+
+
 def print_symbol_diff(
     path: Path,
     base: str,
@@ -868,6 +1107,8 @@ def print_symbol_diff(
     subregion_resolution: bool = False,
     descriptions: bool = False,
     preceding_newline: bool = False,
+    old_table: Optional[SymbolTable] = None,
+    new_table: Optional[SymbolTable] = None,
 ) -> bool:
     """Print a diff for the given symbol table file between two revisions.
 
@@ -885,12 +1126,20 @@ def print_symbol_diff(
             description changes in the diff. Defaults to False.
         preceding_newline (bool, optional): whether to print a newline before
             a nonempty symbol diff, for fenceposting. Defaults to False.
+        old_table (Optional[SymbolTable], optional): symbol table already
+            loaded at the base revision. Defaults to None, in which case it is
+            loaded from path.
+        new_table (Optional[SymbolTable], optional): symbol table already
+            loaded at the target revision. Defaults to None, in which case it
+            is loaded from path.
 
     Returns:
             bool: True if the symbol diff was nonempty
     """
-    old_table = SymbolTable(path, revision=base, descriptions=descriptions)
-    new_table = SymbolTable(path, revision=target, descriptions=descriptions)
+    if old_table is None:
+        old_table = SymbolTable(path, revision=base, descriptions=descriptions)
+    if new_table is None:
+        new_table = SymbolTable(path, revision=target, descriptions=descriptions)
     diff = new_table.diff(old_table, subregion_resolution)
     if diff and (old_table.valid or new_table.valid):
         if preceding_newline:
@@ -1071,8 +1320,12 @@ if __name__ == "__main__":
         path_list_str = ", ".join(f"'{p}'" for p in nonrepo_paths)
         raise SystemExit(f"error: paths outside of git repository: {path_list_str}")
 
+    old_tables, new_tables = load_revisions(
+        args.path, args.base, args.target, args.descriptions
+    )
+
     preceding_newline = False
-    for path in args.path:
+    for path, old_table, new_table in zip(args.path, old_tables, new_tables):
         preceding_newline |= print_symbol_diff(
             path,
             args.base,
@@ -1081,4 +1334,6 @@ if __name__ == "__main__":
             subregion_resolution=args.subregion_resolution,
             descriptions=args.descriptions,
             preceding_newline=preceding_newline,
+            old_table=old_table,
+            new_table=new_table,
         )
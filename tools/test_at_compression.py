@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+
+"""
+Tests for `at_compression.py`: PX decompression must follow the nibble pattern
+rules of the ppmdu and SkyTemple decoders, the streaming decompressor must
+match the one-shot one, and compressed containers must decompress back to the
+original data.
+
+Usage (from the tools directory):
+python3 -m unittest test_at_compression
+"""
+
+import random
+import struct
+import unittest
+
+import at_compression as at
+
+# A PKDPX container with the control flags 0-8 (so the high nibble of a
+# pattern operation is its flag index), assembled by hand. The first command
+# has 8 pattern operations with low nibble 5, for flags 0-7. The second has a
+# pattern operation for flag 8, the literals "AB", and a back-reference of
+# 12 bytes at distance 4.
+PX_FLAGS = bytes(range(9))
+PX_DATA = (
+    bytes([0x00, 0x05, 0x15, 0x25, 0x35, 0x45, 0x55, 0x65, 0x75])
+    + bytes([0x60, 0x85])
+    + b"AB"
+    + bytes([0x9F, 0xFC])
+)
+PX_CONTAINER = (
+    b"PKDPX"
+    + struct.pack("<H", 20 + len(PX_DATA))
+    + PX_FLAGS
+    + struct.pack("<I", 32)
+    + PX_DATA
+)
+# With n = 5, the decoders start every nibble at 5, except that flag 1 starts
+# them at 6 and flag 5 at 4. Flags 1-4 then decrement nibble (flag - 1), and
+# flags 5-8 increment nibble (flag - 5).
+PX_EXPECTED = bytes.fromhex(
+    "5555"  # flag 0: 5 5 5 5
+    "5666"  # flag 1: 5 6 6 6
+    "5455"  # flag 2: 5 4 5 5
+    "5545"  # flag 3: 5 5 4 5
+    "5554"  # flag 4: 5 5 5 4
+    "5444"  # flag 5: 5 4 4 4
+    "5655"  # flag 6: 5 6 5 5
+    "5565"  # flag 7: 5 5 6 5
+    "5556"  # flag 8: 5 5 5 6
+    "4142"  # literals
+    "555641425556414255564142"  # back-reference
+)
+
+
+def sample_data(seed: int, size: int) -> bytes:
+    """Data with runs, repeats and slowly varying nibbles, like sprite data"""
+    rng = random.Random(seed)
+    out = bytearray()
+    while len(out) < size:
+        kind = rng.randrange(4)
+        if kind == 0:
+            out += bytes([rng.randrange(256)]) * rng.randrange(1, 40)
+        elif kind == 1 and out:
+            start = rng.randrange(len(out))
+            out += out[start : start + rng.randrange(3, 30)]
+        elif kind == 2:
+            n = rng.randrange(1, 15)
+            for _ in range(rng.randrange(1, 20)):
+                nibbles = [n + rng.choice((-1, 0, 0, 1)) for _ in range(4)]
+                out += bytes(
+                    [nibbles[0] << 4 | nibbles[1], nibbles[2] << 4 | nibbles[3]]
+                )
+        else:
+            out += bytes(rng.randrange(256) for _ in range(rng.randrange(1, 10)))
+    return bytes(out[:size])
+
+
+class TestDecompress(unittest.TestCase):
+    def test_nibble_patterns(self):
+        self.assertEqual(at.decompress(PX_CONTAINER), PX_EXPECTED)
+
+    def test_streaming(self):
+        for chunk_size in (1, 3, 17):
+            decomp = at.AtDecompressor()
+            out = bytearray()
+            for i in range(0, len(PX_CONTAINER), chunk_size):
+                out += decomp.feed(PX_CONTAINER[i : i + chunk_size])
+            self.assertTrue(decomp.finished)
+            self.assertEqual(bytes(out), PX_EXPECTED)
+
+    def test_truncated(self):
+        with self.assertRaises(ValueError):
+            at.decompress(PX_CONTAINER[:-1])
+
+
+class TestCompress(unittest.TestCase):
+    def test_round_trip(self):
+        for seed, size in enumerate((0, 1, 2, 100, 5000, 20000)):
+            data = sample_data(seed, size)
+            for magic in at.FORMATS:
+                with self.subTest(seed=seed, magic=magic):
+                    self.assertEqual(at.decompress(at.compress(data, magic)), data)
+
+    def test_uses_every_pattern(self):
+        data = sample_data(10, 20000)
+        container = at.compress(data, b"PKDPX")
+        header = at.parse_header(container)
+        flags = {flag & 0xF: i for i, flag in reversed(list(enumerate(header.flags)))}
+        # Collect the flag indexes of the pattern operations in the output
+        used = set()
+        pos = header.header_length
+        produced = 0
+        while produced < len(data):
+            cmd = container[pos]
+            pos += 1
+            for bit in range(7, -1, -1):
+                if produced >= len(data):
+                    break
+                if cmd >> bit & 1:
+                    pos += 1
+                    produced += 1
+                elif container[pos] >> 4 in flags:
+                    used.add(flags[container[pos] >> 4])
+                    pos += 1
+                    produced += 2
+                else:
+                    produced += (container[pos] >> 4) + at.MIN_MATCH
+                    pos += 2
+        self.assertEqual(used, set(range(at.N_FLAGS)))
+
+
+if __name__ == "__main__":
+    unittest.main()
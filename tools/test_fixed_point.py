@@ -0,0 +1,299 @@
+#!/usr/bin/env python3
+
+"""
+Tests for `fixed_point.py`: every batch function is checked against its
+scalar counterpart, exhaustively where the input space is small enough and
+with dense sweeps around the edges of the 32-bit and 64-bit ranges otherwise,
+and the scalar functions are checked against known values.
+
+Usage (from the tools directory):
+python3 -m unittest test_fixed_point
+"""
+
+import unittest
+from typing import Callable, List, Sequence
+
+import fixed_point as fp
+
+INT32_MIN = -(1 << 31)
+INT32_MAX = (1 << 31) - 1
+INT64_MIN = -(1 << 63)
+INT64_MAX = (1 << 63) - 1
+# 1.0 as an fx64 value
+ONE = 1 << fp.FX64_FRACTION_BITS
+
+
+def edge_sweep(bits: int, radius: int = 2, small: int = 300) -> List[int]:
+    """
+    Signed values within `radius` of every power of two (and its negation) up
+    to the given bit width, plus every value in [-small, small], clamped to
+    the signed range of the bit width.
+    """
+    lo, hi = -(1 << (bits - 1)), (1 << (bits - 1)) - 1
+    values = set(range(-small, small + 1))
+    for k in range(bits):
+        for d in range(-radius, radius + 1):
+            values.add((1 << k) + d)
+            values.add(-(1 << k) + d)
+    return sorted(v for v in values if lo <= v <= hi) + [lo, hi]
+
+
+class BatchTestCase(unittest.TestCase):
+    def setUp(self):
+        if fp.np is None:
+            self.skipTest("the batch functions only differ from scalar with numpy")
+
+    def assert_matches(
+        self, batch: Sequence, expected: Sequence[int], inputs: Sequence, name: str
+    ):
+        actual = [int(v) for v in batch]
+        self.assertEqual(len(actual), len(expected))
+        mismatches = [i for i, (a, e) in enumerate(zip(actual, expected)) if a != e]
+        if mismatches:
+            i = mismatches[0]
+            self.fail(
+                f"{name}: {len(mismatches)} mismatch(es), first at input"
+                + f" {inputs[i]}: batch {actual[i]}, scalar {expected[i]}"
+            )
+
+    def check_binary64(
+        self,
+        batch_fn: Callable,
+        scalar_fn: Callable[[int, int], int],
+        xs: Sequence[int],
+        ys: Sequence[int],
+    ):
+        # Full cross product of the operands
+        left = [x for x in xs for _ in ys]
+        right = [y for _ in xs for y in ys]
+        expected = [scalar_fn(x, y) for x, y in zip(left, right)]
+        self.assert_matches(
+            batch_fn(left, right), expected, list(zip(left, right)), batch_fn.__name__
+        )
+
+
+class TestFx64Batch(BatchTestCase):
+    operands = edge_sweep(64, small=40)
+
+    def test_multiply(self):
+        self.check_binary64(
+            fp.multiply_fixed_point64_batch,
+            fp.multiply_fixed_point64,
+            self.operands,
+            self.operands,
+        )
+
+    def test_umultiply(self):
+        self.check_binary64(
+            fp.umultiply_fixed_point64_batch,
+            fp.umultiply_fixed_point64,
+            self.operands,
+            self.operands,
+        )
+
+    def test_divide(self):
+        self.check_binary64(
+            fp.divide_fixed_point64_batch,
+            fp.divide_fixed_point64,
+            self.operands,
+            self.operands,
+        )
+
+    def test_add(self):
+        self.check_binary64(
+            fp.add_fixed_point64_batch,
+            fp.add_fixed_point64,
+            self.operands,
+            self.operands,
+        )
+
+
+class TestFx32Batch(BatchTestCase):
+    values = edge_sweep(32)
+    multipliers = edge_sweep(32, small=600)
+
+    def test_multiply_by_fixed_point_edges(self):
+        for mult in self.multipliers:
+            expected = [fp.multiply_by_fixed_point(x, mult) for x in self.values]
+            self.assert_matches(
+                fp.multiply_by_fixed_point_batch(self.values, mult),
+                expected,
+                self.values,
+                f"multiply_by_fixed_point_batch(mult={mult})",
+            )
+
+    def test_multiply_by_fixed_point_int16(self):
+        # Every 16-bit input, with multipliers around the common range of the
+        # damage formula constants
+        xs = list(range(-(1 << 15), 1 << 15))
+        for mult in range(-512, 513, 7):
+            expected = [fp.multiply_by_fixed_point(x, mult) for x in xs]
+            self.assert_matches(
+                fp.multiply_by_fixed_point_batch(xs, mult),
+                expected,
+                xs,
+                f"multiply_by_fixed_point_batch(mult={mult})",
+            )
+
+    def test_out_of_range_inputs(self):
+        # Inputs outside the 32-bit range wrap, like in the scalar versions
+        xs = [1 << 31, (1 << 32) - 1, (1 << 32) + 5, INT32_MIN - 1, -(1 << 40)]
+        for batch_fn, scalar_fn in (
+            (fp.multiply_by_fixed_point_batch, fp.multiply_by_fixed_point),
+            (fp.umultiply_by_fixed_point_batch, fp.umultiply_by_fixed_point),
+        ):
+            self.assert_matches(
+                batch_fn(xs, 0x180),
+                [scalar_fn(x, 0x180) for x in xs],
+                xs,
+                batch_fn.__name__,
+            )
+
+    def test_umultiply_by_fixed_point_edges(self):
+        xs = sorted({v & fp.MASK32 for v in self.values})
+        for mult in self.multipliers:
+            mult &= fp.MASK32
+            expected = [fp.umultiply_by_fixed_point(x, mult) for x in xs]
+            self.assert_matches(
+                fp.umultiply_by_fixed_point_batch(xs, mult),
+                expected,
+                xs,
+                f"umultiply_by_fixed_point_batch(mult={mult})",
+            )
+
+    def test_umultiply_by_fixed_point_uint16(self):
+        xs = list(range(1 << 16))
+        for mult in range(0, 1025, 7):
+            expected = [fp.umultiply_by_fixed_point(x, mult) for x in xs]
+            self.assert_matches(
+                fp.umultiply_by_fixed_point_batch(xs, mult),
+                expected,
+                xs,
+                f"umultiply_by_fixed_point_batch(mult={mult})",
+            )
+
+
+class TestClampedLnBatch(BatchTestCase):
+    def test_clamped_ln(self):
+        table = fp.approximate_ln_table()
+        # Every input that can reach the table unclamped, with margins on both
+        # sides, plus the edges of the 32-bit range
+        xs = list(range(-(1 << 16), 1 << 16)) + edge_sweep(32)
+        expected = [fp.clamped_ln(x, table) for x in xs]
+        self.assert_matches(
+            fp.clamped_ln_batch(xs, table), expected, xs, "clamped_ln_batch"
+        )
+
+
+class TestScalar(unittest.TestCase):
+    def test_parts_round_trip(self):
+        for x in edge_sweep(64):
+            self.assertEqual(fp.fx64_from_parts(*fp.fx64_to_parts(x)), x)
+
+    def test_int_conversions(self):
+        for x in edge_sweep(32):
+            fx = fp.int_to_fixed_point64(x)
+            self.assertEqual(fx, x << fp.FX64_FRACTION_BITS)
+            self.assertEqual(fp.fixed_point64_to_int(fx), x)
+
+
+class TestKnownValues(unittest.TestCase):
+    """
+    Values pinned down by the symbol table documentation alone. Products and
+    quotients here are exact in both formats, so they hold regardless of how
+    the ARM routines round.
+    """
+
+    def test_multiply_by_fixed_point(self):
+        # 0x100 is 1.0 with 8 fraction bits
+        for x, mult, expected in (
+            (100, 0x100, 100),
+            (100, 0x180, 150),
+            (-100, 0x180, -150),
+            (100, -0x40, -25),
+            (-100, -0x200, 200),
+            (0x7FFFFF, 0x200, 0xFFFFFE),
+        ):
+            with self.subTest(x=x, mult=mult):
+                self.assertEqual(fp.multiply_by_fixed_point(x, mult), expected)
+
+    def test_umultiply_by_fixed_point(self):
+        for x, mult, expected in (
+            (100, 0x180, 150),
+            (0xFFFFFF, 0x100, 0xFFFFFF),
+            (0x800000, 0x80, 0x400000),
+        ):
+            with self.subTest(x=x, mult=mult):
+                self.assertEqual(fp.umultiply_by_fixed_point(x, mult), expected)
+
+    def test_fx64_arithmetic(self):
+        for fn, x, y, expected in (
+            (fp.multiply_fixed_point64, 3 * ONE // 2, -2 * ONE, -3 * ONE),
+            (fp.multiply_fixed_point64, -ONE // 4, -ONE // 4, ONE // 16),
+            (fp.multiply_fixed_point64, 1 << 40, ONE, 1 << 40),
+            (fp.umultiply_fixed_point64, 3 * ONE // 2, 3 * ONE // 2, 9 * ONE // 4),
+            (fp.divide_fixed_point64, 3 * ONE, -ONE // 2, -6 * ONE),
+            (fp.divide_fixed_point64, -ONE, 8 * ONE, -ONE // 8),
+            (fp.udivide_fixed_point64, 9 * ONE // 4, 3 * ONE // 2, 3 * ONE // 2),
+            (fp.add_fixed_point64, ONE // 2, -3 * ONE // 4, -ONE // 4),
+        ):
+            with self.subTest(fn=fn.__name__, x=x, y=y):
+                self.assertEqual(fn(x, y), expected)
+
+    def test_division_by_zero(self):
+        # (INT64_MAX >> 16) + (UINT16_MAX * 2^-16)
+        expected = ((fp.FX64_MAX >> 16) << 16) + 0xFFFF
+        for dividend in (0, 5, -5):
+            self.assertEqual(fp.divide_fixed_point64(dividend, 0), expected)
+            self.assertEqual(fp.udivide_fixed_point64(dividend, 0), expected)
+
+    def test_struct_fields(self):
+        # struct fx64 holds the upper and lower 32 bits of the raw value
+        self.assertEqual(fp.fx64_to_parts(5 * ONE + ONE // 2), (0, 0x58000))
+        self.assertEqual(fp.fx64_to_parts(-ONE), (-1, 0xFFFF0000))
+        self.assertEqual(fp.fx64_from_parts(1, 0), 1 << 32)
+
+    def test_clamped_ln(self):
+        # NATURAL_LOG_VALUE_TABLE entries are ln(x) with 12 fraction bits,
+        # and ClampedLn clamps its input to [1, 2047]
+        table = list(range(fp.LN_TABLE_SIZE))
+        for x, index in (
+            (1, 1),
+            (100, 100),
+            (2047, 2047),
+            (0, 1),
+            (-7, 1),
+            (5000, 2047),
+        ):
+            with self.subTest(x=x):
+                self.assertEqual(fp.clamped_ln(x, table), index << 4)
+        approx = fp.approximate_ln_table()
+        self.assertEqual(approx[1], 0)
+        self.assertEqual(approx[2], 2839)  # ln(2) = 0.693147 ~ 2839 / 4096
+        self.assertEqual(approx[2047], 31228)  # ln(2047) = 7.624131 ~ 31228 / 4096
+
+
+class TestAssumedRounding(unittest.TestCase):
+    """
+    Inexact results, which depend on the rounding behavior inferred in the
+    `fixed_point.py` docstring. These pin the assumed behavior down so that
+    it doesn't change by accident, but they have not been checked against
+    the ARM routines.
+    """
+
+    def test_multiply_by_fixed_point(self):
+        # Rounds toward negative infinity (arithmetic shift of the product)
+        self.assertEqual(fp.multiply_by_fixed_point(1, 0x80), 0)
+        self.assertEqual(fp.multiply_by_fixed_point(-1, 0x80), -1)
+        self.assertEqual(fp.multiply_by_fixed_point(-3, 0x155), -4)
+
+    def test_fx64_arithmetic(self):
+        # Rounds toward zero (operates on magnitudes, then applies the sign)
+        self.assertEqual(fp.divide_fixed_point64(ONE, 3 * ONE), 0x5555)
+        self.assertEqual(fp.divide_fixed_point64(-ONE, 3 * ONE), -0x5555)
+        self.assertEqual(fp.multiply_fixed_point64(-1, 1), 0)
+        self.assertEqual(fp.multiply_fixed_point64(-3, ONE // 2), -1)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,128 @@
+#!/usr/bin/env python3
+
+"""
+Tests for `mem_arena.py`: the indexed free block lookup must produce the same
+heaps as the linear search, including when an allocation takes up all the
+free space of a vacant block.
+
+Usage (from the tools directory):
+python3 -m unittest test_mem_arena
+"""
+
+import os
+import random
+import subprocess
+import sys
+import tempfile
+import unittest
+from typing import List
+
+import mem_arena as ma
+
+TOOLS_DIR = os.path.dirname(os.path.abspath(__file__))
+
+
+def random_trace(seed: int, n_events: int = 4000) -> List[str]:
+    """
+    A random sequence of object and non-object allocations and frees. Sizes
+    are drawn from a small set so that exact fits are common.
+    """
+    rng = random.Random(seed)
+    lines = []
+    live = []
+    next_ptr = 0x1000
+    for _ in range(n_events):
+        if live and rng.random() < 0.45:
+            lines.append(f"free {live.pop(rng.randrange(len(live))):#x}")
+        else:
+            length = rng.choice([0x10, 0x100, 0x200, 0x800, 2371, 5317])
+            flags = rng.choice([0x100, 0x200, 0x300, 0x700])
+            lines.append(f"alloc {length} {flags:#x} ={next_ptr:#x}")
+            live.append(next_ptr)
+            next_ptr += 8
+    return lines
+
+
+def layout(heap: ma.Heap):
+    return [[(b.data, b.used, b.available) for b in a.blocks] for a in heap.arenas]
+
+
+class TestExactFit(unittest.TestCase):
+    def setUp(self):
+        self.heaps = [ma.Heap.fresh(0, 0x1000, 16, indexed=m) for m in (False, True)]
+
+    def test_alloc_whole_block(self):
+        for heap in self.heaps:
+            arena = heap.default
+            block = arena.alloc(0x1000, 0x100)
+            self.assertEqual(block.data, 0)
+            # The vacant block is left empty, at the same address
+            self.assertEqual(arena.n_blocks, 2)
+            self.assertEqual(arena.index_of(0), 1)
+            self.assertEqual(arena.free_bytes, 0)
+            self.assertTrue(arena.free(0))
+            self.assertEqual(layout(heap), [[(0, 0, 0x1000)]])
+            self.assertEqual(arena.free_bytes, 0x1000)
+
+    def test_refill_hole(self):
+        for heap in self.heaps:
+            arena = heap.default
+            hi = arena.alloc(0x400, 0x100).data
+            mid = arena.alloc(0x400, 0x100).data
+            arena.alloc(0x400, 0x100)
+            self.assertTrue(arena.free(mid))
+            # Best fit is the hole left by mid, not the larger block at 0
+            self.assertEqual(arena.alloc(0x400, 0x100).data, mid)
+            self.assertTrue(arena.free(hi))
+            self.assertEqual(arena.alloc(0x400, 0x200).data, hi)
+            # Frees the refilled block, not the empty one before it
+            self.assertTrue(arena.free(mid))
+            self.assertEqual(arena.free_bytes, 0x800)
+            self.assertEqual(arena.alloc(0x400, 0x100).data, mid)
+        self.assertEqual(layout(self.heaps[0]), layout(self.heaps[1]))
+
+
+class TestLookupModes(unittest.TestCase):
+    def test_random_traces(self):
+        for seed in range(8):
+            events = ma.parse_trace_lines(random_trace(seed))
+            heaps = [ma.Heap.fresh(0, 0x200000, 1024, indexed=m) for m in (False, True)]
+            for i, event in enumerate(events):
+                errors = [str(h.replay([event], keep_going=True)) for h in heaps]
+                self.assertEqual(errors[0], errors[1], f"seed {seed}, event {i}")
+                self.assertEqual(
+                    layout(heaps[0]), layout(heaps[1]), f"seed {seed}, event {i}"
+                )
+            for heap in heaps:
+                arena = heap.default
+                self.assertEqual(
+                    arena.free_bytes,
+                    sum(b.available for b in arena.blocks if not b.in_use),
+                )
+                self.assertTrue(all(b.available >= 0 for b in arena.blocks))
+
+    def test_compare_cli(self):
+        with tempfile.NamedTemporaryFile("w", suffix=".txt", delete=False) as f:
+            f.write("\n".join(random_trace(0)) + "\n")
+        try:
+            result = subprocess.run(
+                [
+                    sys.executable,
+                    os.path.join(TOOLS_DIR, "mem_arena.py"),
+                    "--compare",
+                    "--size",
+                    "0x200000",
+                    "--max-blocks",
+                    "1024",
+                    f.name,
+                ],
+                capture_output=True,
+                text=True,
+            )
+        finally:
+            os.unlink(f.name)
+        self.assertEqual(result.returncode, 0, result.stderr)
+
+
+if __name__ == "__main__":
+    unittest.main()
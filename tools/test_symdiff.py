@@ -0,0 +1,150 @@
+#!/usr/bin/env python3
+
+"""
+Tests for `symdiff.py`: the merge-join candidate matching must produce the
+same match graph (including edge order, which decides conflicts with several
+maximum cardinality matchings) and the same symbol pairings as a
+symbol-by-symbol dict lookup, on the symbol tables in this repository with
+randomized renames, relocations and conflicts.
+
+Usage (from the tools directory):
+python3 -m unittest test_symdiff
+"""
+
+import copy
+import random
+from typing import Dict, List, Set, Tuple
+import unittest
+
+import symdiff
+from symdiff import Symbol, SymbolList, SymbolTable
+
+N_ROUNDS = 3
+
+
+def lookup_match_graph(
+    target: SymbolList, base: SymbolList
+) -> List[Dict[int, List[int]]]:
+    """Reference match graph built by looking up each symbol of target"""
+    base_addr_to_idx: Dict[Tuple[str, int], List[int]] = {}
+    base_name_to_idx: Dict[str, List[int]] = {}
+    for i, s in enumerate(base):
+        for version, addrs in s.address.items():
+            for addr in addrs:
+                base_addr_to_idx.setdefault((version, addr), []).append(i)
+        base_name_to_idx.setdefault(s.name, []).append(i)
+
+    # {base index -> [# matching addresses, whether the names match]}
+    matches: List[Dict[int, List]] = [{} for _ in range(len(target))]
+    for s, match_list in zip(target, matches):
+        for version, addrs in s.address.items():
+            for addr in addrs:
+                for i_base in base_addr_to_idx.get((version, addr), []):
+                    match_list.setdefault(i_base, [0, False])[0] += 1
+        for i_base in base_name_to_idx.get(s.name, []):
+            match_list.setdefault(i_base, [0, False])[1] = True
+
+    matches_by_rank: Dict[Tuple[int, bool], Dict[int, List[int]]] = {}
+    for i, mlist in enumerate(matches):
+        for m, rank in mlist.items():
+            matches_by_rank.setdefault(tuple(rank), {}).setdefault(i, []).append(m)
+    return [
+        match
+        for _, match in sorted(
+            matches_by_rank.items(), key=lambda x: x[0], reverse=True
+        )
+    ]
+
+
+def lookup_pairs(target: SymbolList, base: SymbolList) -> List[Tuple[int, int]]:
+    """
+    Reference pairing that runs the maximum cardinality matching on each whole
+    match rank group
+    """
+    self_to_base_idx: Dict[int, int] = {}
+    paired_base_idxs: Set[int] = set()
+    for edges in lookup_match_graph(target, base):
+        unpaired_edges = {
+            i: [j for j in base_idxs if j not in paired_base_idxs]
+            for i, base_idxs in edges.items()
+            if i not in self_to_base_idx
+        }
+        unpaired_edges = {i: js for i, js in unpaired_edges.items() if js}
+        pairs = SymbolList._maximum_bipartite_matching(unpaired_edges)
+        self_to_base_idx.update(pairs)
+        paired_base_idxs.update(p[1] for p in pairs)
+    return sorted(self_to_base_idx.items())
+
+
+def perturb(symbols: List[Symbol], rng: random.Random) -> List[Symbol]:
+    """
+    Randomly rename, relocate, duplicate, delete and reorder symbols, with
+    enough address and name collisions to produce conflicting matches
+    """
+    out: List[Symbol] = []
+    for s in symbols:
+        roll = rng.random()
+        if roll < 0.05:
+            continue
+        s = copy.deepcopy(s)
+        if roll < 0.15:
+            s.name += "Renamed"
+        elif roll < 0.2:
+            s.name = rng.choice(symbols).name
+        if rng.random() < 0.15:
+            version = rng.choice(list(s.address))
+            s.address[version] = [a + 4 for a in s.address[version]]
+        if rng.random() < 0.1:
+            other = rng.choice(symbols)
+            for version, addrs in other.address.items():
+                s.address.setdefault(version, []).extend(addrs)
+        out.append(s)
+        if rng.random() < 0.03:
+            out.append(copy.deepcopy(s))
+    # Swap some neighbors so the two lists aren't in the same order
+    for i in range(0, len(out) - 1, 17):
+        out[i], out[i + 1] = out[i + 1], out[i]
+    return out
+
+
+class TestSymbolMatching(unittest.TestCase):
+    @classmethod
+    def setUpClass(cls):
+        cls.symbol_lists: List[List[Symbol]] = []
+        for path in sorted(symdiff.SYMBOL_DIR.glob("*.yml")):
+            for block in SymbolTable(path).blocks.values():
+                for symbols in (block.functions, block.data):
+                    if symbols:
+                        cls.symbol_lists.append(list(symbols))
+
+    def test_symbol_tables_found(self):
+        self.assertTrue(self.symbol_lists)
+
+    def test_match_graph(self):
+        rng = random.Random(0)
+        for n in range(N_ROUNDS):
+            for symbols in self.symbol_lists:
+                base = SymbolList(symbols)
+                target = SymbolList(perturb(symbols, rng))
+                with self.subTest(round=n, block=symbols[0].blockname):
+                    graph = target._build_match_graph(base)
+                    expected = lookup_match_graph(target, base)
+                    # Compare item lists, since dict order matters
+                    self.assertEqual(
+                        [list(g.items()) for g in graph],
+                        [list(g.items()) for g in expected],
+                    )
+
+    def test_pairs(self):
+        rng = random.Random(1)
+        for n in range(N_ROUNDS):
+            for symbols in self.symbol_lists:
+                base = SymbolList(symbols)
+                target = SymbolList(perturb(symbols, rng))
+                with self.subTest(round=n, block=symbols[0].blockname):
+                    pairs, _, _ = target.locate_pairs(base)
+                    self.assertEqual(pairs, lookup_pairs(target, base))
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,545 @@
+#!/usr/bin/env python3
+
+"""
+`trace_store.py` is a command line utility and Python module for storing long
+captures of per-frame snapshots of a struct (by default, `struct dungeon`, as
+stored in DUNGEON_STRUCT) compactly, while keeping random access to any frame
+and any field.
+
+Snapshots are split into columns following the struct layout from the C
+headers (see `layouts.py`): each top-level field is a column, except that
+large fields are split further (arrays of structs into one column per
+element, large scalar arrays into chunks, and large structs into their
+fields), and runs of small neighboring fields are merged into one column.
+Frames are grouped into blocks of a fixed number of frames. Within a block,
+each column is stored as the column's bytes in the first frame followed by
+the XOR of each frame's bytes with the previous frame's, compressed with
+zlib. Since most fields don't change from one frame to the next, the deltas
+are mostly zeros and compress extremely well.
+
+Reading a field at some frame only decompresses the columns covering the
+field, in the block containing the frame, and XORs the deltas up to the
+frame. Reading a field over a range of frames decodes each block of each
+covering column once.
+
+File format (all integers little-endian):
+    header:
+        magic "PMDT", u16 format version, u16 reserved
+        u32 frame length, u32 frames per block, u32 number of columns
+        u16 type name length, type name (UTF-8)
+        per column: u32 offset, u32 length, u16 name length, name (UTF-8)
+    blocks, one after the other:
+        per column: the compressed column data for the block
+    index:
+        u32 number of frames, u32 number of blocks
+        per block: u64 block offset, u32 compressed length per column
+    footer:
+        u64 index offset, magic "PMDT"
+
+Example usage:
+python3 trace_store.py write -l layouts.bin -o capture.pmdt frames.bin
+python3 trace_store.py info capture.pmdt
+python3 trace_store.py query -l layouts.bin -p monsters[0].hp capture.pmdt
+python3 trace_store.py query -p gen_info.n_rooms -r 1000-2000 capture.pmdt
+python3 trace_store.py extract -r 500 -o frame500.bin capture.pmdt
+
+Library usage:
+    with TraceWriter("capture.pmdt", layouts) as writer:
+        for frame in frames:
+            writer.append(frame)
+    with TraceReader("capture.pmdt", layouts) as trace:
+        hp = trace.values("monsters[0].hp")
+"""
+
+import argparse
+from bisect import bisect_right
+from collections import OrderedDict
+import os
+import struct
+import sys
+from typing import Any, BinaryIO, Iterator, List, NamedTuple, Optional, Tuple
+import zlib
+
+try:
+    import numpy as np
+except ImportError:
+    np = None
+
+from layouts import Buffer, Layouts, format_value
+import offsets
+
+MAGIC = b"PMDT"
+FORMAT_VERSION = 1
+FOOTER_LEN = 12
+DEFAULT_TYPE = "struct dungeon"
+DEFAULT_BLOCK_FRAMES = 64
+# Fields larger than this are split into several columns
+MAX_COLUMN_LEN = 4096
+# Neighboring fields are merged into one column up to this length
+MIN_COLUMN_LEN = 64
+# Number of decoded (block, column) chunks to keep around
+CACHE_CHUNKS = 64
+
+
+class Column(NamedTuple):
+    name: str
+    offset: int
+    length: int
+
+
+def plan_columns(
+    layouts: Layouts,
+    type_name: str,
+    max_len: int = MAX_COLUMN_LEN,
+    min_len: int = MIN_COLUMN_LEN,
+) -> List[Column]:
+    """
+    Splits a type into columns along its fields, covering every byte of the
+    type exactly once.
+    """
+    pieces: List[Column] = []
+
+    def split(t: str, pointer: int, dims: Tuple[int, ...], base: int, path: str):
+        t, pointer = layouts.resolve_typedef(t, pointer)
+        elem_len = layouts.sizeof(t, pointer)
+        for d in dims[1:]:
+            elem_len *= d
+        length = elem_len * dims[0] if dims else elem_len
+        agg = layouts.aggregates.get(t) if not pointer else None
+        if length <= max_len or (not dims and (agg is None or agg.kind != "struct")):
+            pieces.append(Column(path, base, length))
+        elif dims and (elem_len >= min_len or len(dims) > 1):
+            for i in range(dims[0]):
+                split(t, pointer, dims[1:], base + i * elem_len, f"{path}[{i}]")
+        elif dims:
+            per_piece = max(1, max_len // elem_len)
+            for i in range(0, dims[0], per_piece):
+                j = min(i + per_piece, dims[0])
+                pieces.append(
+                    Column(f"{path}[{i}:{j}]", base + i * elem_len, (j - i) * elem_len)
+                )
+        else:
+            for f in agg.fields:
+                f_path = f"{path}.{f.name}" if path else f.name
+                if f.is_bitfield():
+                    pieces.append(Column(f_path, base + f.offset, 1))
+                else:
+                    split(f.type, f.pointer, f.dims, base + f.offset, f_path)
+
+    base_type, pointer = layouts.resolve_typedef(type_name)
+    total = layouts.sizeof(base_type, pointer)
+    agg = layouts.aggregates.get(base_type)
+    if agg is not None and agg.kind == "struct":
+        for f in agg.fields:
+            if f.is_bitfield():
+                pieces.append(Column(f.name, f.offset, 1))
+            else:
+                split(f.type, f.pointer, f.dims, f.offset, f.name)
+    else:
+        pieces.append(Column(type_name, 0, total))
+
+    # Make the pieces contiguous: overlapping pieces (unions, bitfields) and
+    # padding are folded into the preceding piece
+    columns: List[Column] = []
+    for piece in sorted(pieces, key=lambda c: c.offset):
+        end = piece.offset + piece.length
+        if columns:
+            prev = columns[-1]
+            prev_end = prev.offset + prev.length
+            if piece.offset < prev_end:
+                columns[-1] = prev._replace(length=max(prev_end, end) - prev.offset)
+                continue
+            columns[-1] = prev._replace(length=piece.offset - prev.offset)
+        elif piece.offset > 0:
+            piece = Column(piece.name, 0, end)
+        columns.append(piece)
+    if columns:
+        last = columns[-1]
+        columns[-1] = last._replace(length=total - last.offset)
+
+    # Merge runs of small columns
+    merged: List[Column] = []
+    first_name = None
+    for col in columns:
+        if (
+            merged
+            and merged[-1].length < min_len
+            and merged[-1].length + col.length <= min_len
+        ):
+            prev = merged[-1]
+            merged[-1] = Column(
+                f"{first_name}..{col.name}", prev.offset, prev.length + col.length
+            )
+        else:
+            first_name = col.name
+            merged.append(col)
+    return merged
+
+
+def _xor(a: bytes, b: bytes) -> bytes:
+    return (int.from_bytes(a, "little") ^ int.from_bytes(b, "little")).to_bytes(
+        len(a), "little"
+    )
+
+
+def _write_str(out: bytearray, s: str):
+    data = s.encode("utf-8")
+    out += struct.pack("<H", len(data)) + data
+
+
+class TraceWriter:
+    """Writes a trace file, one frame at a time"""
+
+    def __init__(
+        self,
+        path: str,
+        layouts: Layouts,
+        type_name: str = DEFAULT_TYPE,
+        block_frames: int = DEFAULT_BLOCK_FRAMES,
+        level: int = 6,
+        columns: Optional[List[Column]] = None,
+    ):
+        self.type_name = type_name
+        self.frame_len = layouts.sizeof(type_name)
+        self.block_frames = block_frames
+        self.level = level
+        self.columns = columns or plan_columns(layouts, type_name)
+        self.n_frames = 0
+        self._block = bytearray()
+        self._index: List[Tuple[int, List[int]]] = []
+        self._f: BinaryIO = open(path, "wb")
+
+        header = bytearray(MAGIC)
+        header += struct.pack(
+            "<HHIII",
+            FORMAT_VERSION,
+            0,
+            self.frame_len,
+            block_frames,
+            len(self.columns),
+        )
+        _write_str(header, type_name)
+        for col in self.columns:
+            header += struct.pack("<II", col.offset, col.length)
+            _write_str(header, col.name)
+        self._f.write(header)
+
+    def __enter__(self) -> "TraceWriter":
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    def append(self, frame: Buffer):
+        """Adds a frame to the trace"""
+        if len(frame) != self.frame_len:
+            raise ValueError(f"frame is {len(frame)} bytes, expected {self.frame_len}")
+        self._block += frame
+        self.n_frames += 1
+        if len(self._block) == self.block_frames * self.frame_len:
+            self._flush()
+
+    def _flush(self):
+        n = len(self._block) // self.frame_len
+        if n == 0:
+            return
+        chunks = []
+        if np is not None:
+            frames = np.frombuffer(self._block, dtype=np.uint8).reshape(
+                n, self.frame_len
+            )
+            deltas = frames.copy()
+            deltas[1:] ^= frames[:-1]
+            for col in self.columns:
+                data = deltas[:, col.offset : col.offset + col.length].tobytes()
+                chunks.append(zlib.compress(data, self.level))
+        else:
+            view = memoryview(self._block)
+            for col in self.columns:
+                rows = [
+                    view[i * self.frame_len + col.offset :][: col.length]
+                    for i in range(n)
+                ]
+                data = [bytes(rows[0])]
+                data.extend(_xor(rows[i - 1], rows[i]) for i in range(1, n))
+                chunks.append(zlib.compress(b"".join(data), self.level))
+        self._index.append((self._f.tell(), [len(c) for c in chunks]))
+        for c in chunks:
+            self._f.write(c)
+        self._block = bytearray()
+
+    def close(self):
+        if self._f.closed:
+            return
+        self._flush()
+        index_offset = self._f.tell()
+        index = bytearray(struct.pack("<II", self.n_frames, len(self._index)))
+        for offset, lengths in self._index:
+            index += struct.pack(f"<Q{len(lengths)}I", offset, *lengths)
+        index += struct.pack("<Q", index_offset) + MAGIC
+        self._f.write(index)
+        self._f.close()
+
+
+class TraceReader:
+    """A memory-mapped trace file, with random access to frames and fields"""
+
+    def __init__(self, path: str, layouts: Optional[Layouts] = None):
+        self.path = path
+        self.layouts = layouts
+        self._mapped = offsets.MappedBinary(path)
+        data = self._mapped.contents
+        if len(data) < 24 + FOOTER_LEN or data[:4] != MAGIC or data[-4:] != MAGIC:
+            self.close()
+            raise ValueError(f"{path} is not a trace file")
+        version, _, self.frame_len, self.block_frames, n_columns = struct.unpack_from(
+            "<HHIII", data, 4
+        )
+        if version != FORMAT_VERSION:
+            self.close()
+            raise ValueError(f"{path}: unsupported format version {version}")
+        pos = 20
+
+        def read_str() -> str:
+            nonlocal pos
+            (n,) = struct.unpack_from("<H", data, pos)
+            s = bytes(data[pos + 2 : pos + 2 + n]).decode("utf-8")
+            pos += 2 + n
+            return s
+
+        self.type_name = read_str()
+        self.columns: List[Column] = []
+        for _ in range(n_columns):
+            col_offset, length = struct.unpack_from("<II", data, pos)
+            pos += 8
+            self.columns.append(Column(read_str(), col_offset, length))
+        self._column_ends = [c.offset + c.length for c in self.columns]
+
+        (index_offset,) = struct.unpack_from("<Q", data, len(data) - FOOTER_LEN)
+        self.n_frames, n_blocks = struct.unpack_from("<II", data, index_offset)
+        pos = index_offset + 8
+        # Per block: absolute offsets of the compressed chunk of each column
+        self._chunks: List[List[Tuple[int, int]]] = []
+        for _ in range(n_blocks):
+            (block_offset,) = struct.unpack_from("<Q", data, pos)
+            lengths = struct.unpack_from(f"<{n_columns}I", data, pos + 8)
+            pos += 8 + 4 * n_columns
+            chunk_offsets = []
+            for length in lengths:
+                chunk_offsets.append((block_offset, length))
+                block_offset += length
+            self._chunks.append(chunk_offsets)
+        self._cache: "OrderedDict[Tuple[int, int], Any]" = OrderedDict()
+
+    def __enter__(self) -> "TraceReader":
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    def close(self):
+        self._mapped.close()
+
+    def __len__(self) -> int:
+        return self.n_frames
+
+    def _block_len(self, block: int) -> int:
+        return min(self.block_frames, self.n_frames - block * self.block_frames)
+
+    def _decoded(self, block: int, column: int) -> Any:
+        """
+        Decodes a column over a block: a list of the column's bytes in each
+        frame (or a 2D numpy array with one row per frame).
+        """
+        key = (block, column)
+        cached = self._cache.get(key)
+        if cached is not None:
+            self._cache.move_to_end(key)
+            return cached
+        offset, length = self._chunks[block][column]
+        data = zlib.decompress(self._mapped.contents[offset : offset + length])
+        n = self._block_len(block)
+        col_len = self.columns[column].length
+        if np is not None:
+            rows = np.bitwise_xor.accumulate(
+                np.frombuffer(data, dtype=np.uint8).reshape(n, col_len), axis=0
+            )
+        else:
+            rows = [data[:col_len]]
+            for i in range(1, n):
+                rows.append(_xor(rows[-1], data[i * col_len : (i + 1) * col_len]))
+        self._cache[key] = rows
+        if len(self._cache) > CACHE_CHUNKS:
+            self._cache.popitem(last=False)
+        return rows
+
+    def _columns_for(self, offset: int, length: int) -> range:
+        first = bisect_right(self._column_ends, offset)
+        last = bisect_right(self._column_ends, offset + length - 1)
+        return range(first, last + 1)
+
+    def _check_range(self, start: int, stop: Optional[int]) -> Tuple[int, int]:
+        if stop is None:
+            stop = self.n_frames
+        if not 0 <= start <= stop <= self.n_frames:
+            raise IndexError(f"frames {start}-{stop} out of range ({self.n_frames})")
+        return start, stop
+
+    def read_bytes(
+        self, offset: int, length: int, start: int = 0, stop: Optional[int] = None
+    ) -> Iterator[bytes]:
+        """Yields a byte range of the snapshot for each frame in [start, stop)"""
+        start, stop = self._check_range(start, stop)
+        if not 0 <= offset <= offset + length <= self.frame_len:
+            raise ValueError(f"range {offset:#x}+{length:#x} is outside of the frame")
+        columns = self._columns_for(offset, length)
+        for block in range(start // self.block_frames, -(-stop // self.block_frames)):
+            first = block * self.block_frames
+            lo, hi = (
+                max(start, first) - first,
+                min(stop, first + self._block_len(block)) - first,
+            )
+            parts = []
+            for c in columns:
+                col = self.columns[c]
+                a = max(offset, col.offset) - col.offset
+                b = min(offset + length, col.offset + col.length) - col.offset
+                parts.append((self._decoded(block, c), a, b))
+            for i in range(lo, hi):
+                yield b"".join(bytes(rows[i][a:b]) for rows, a, b in parts)
+
+    def frame(self, index: int) -> bytes:
+        """Reconstructs a whole snapshot"""
+        return next(self.read_bytes(0, self.frame_len, index, index + 1))
+
+    def values(
+        self, path: str, start: int = 0, stop: Optional[int] = None
+    ) -> Iterator[Any]:
+        """Yields the value of a field (by path) for each frame in [start, stop)"""
+        if self.layouts is None:
+            raise ValueError("no layouts given to resolve field paths")
+        lts = self.layouts
+        try:
+            offset, t, pointer, dims = lts.resolve_path(self.type_name, path)
+        except ValueError:
+            # Maybe a bitfield
+            leaf = lts.leaf(self.type_name, path)
+            for buf in self.read_bytes(leaf.offset, leaf.size, start, stop):
+                yield lts.read_leaf(leaf, buf, -leaf.offset)
+            return
+        length = lts.sizeof(t, pointer)
+        for d in dims:
+            length *= d
+        for buf in self.read_bytes(offset, length, start, stop):
+            yield lts.read(t, pointer, dims, buf, 0)
+
+
+def parse_frame_range(spec: Optional[str], n: int) -> Tuple[int, int]:
+    """Parses frame ranges like "100-200" (inclusive) or "100" """
+    if spec is None:
+        return 0, n
+    lo, _, hi = spec.partition("-")
+    start = int(lo, 0)
+    stop = int(hi, 0) + 1 if hi else start + 1
+    return start, min(stop, n)
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(
+        description="Store and query captures of per-frame struct snapshots"
+    )
+    subparsers = parser.add_subparsers(dest="command", required=True)
+    sub_write = subparsers.add_parser("write", help="write a trace file")
+    sub_write.add_argument(
+        "frames",
+        help="file of raw concatenated frames of sizeof(type) bytes ('-' for stdin)",
+    )
+    sub_write.add_argument("-o", "--output", required=True, help="output trace file")
+    sub_write.add_argument(
+        "-t", "--type", default=DEFAULT_TYPE, help="type of the frames"
+    )
+    sub_write.add_argument(
+        "-b",
+        "--block-frames",
+        type=int,
+        default=DEFAULT_BLOCK_FRAMES,
+        help="number of frames per block (trades off size and access speed)",
+    )
+    sub_write.add_argument(
+        "-c", "--level", type=int, default=6, help="zlib compression level (0-9)"
+    )
+    sub_info = subparsers.add_parser("info", help="describe a trace file")
+    sub_info.add_argument(
+        "-c", "--columns", action="store_true", help="list the columns"
+    )
+    sub_query = subparsers.add_parser("query", help="print a field over time")
+    sub_query.add_argument("-p", "--path", required=True, help="field path")
+    sub_extract = subparsers.add_parser("extract", help="extract raw frames")
+    sub_extract.add_argument("-o", "--output", required=True, help="output file")
+    for sub in (sub_info, sub_query, sub_extract):
+        sub.add_argument("trace", help="trace file")
+    for sub in (sub_query, sub_extract):
+        sub.add_argument(
+            "-r", "--range", help="frame or inclusive frame range, e.g. 100-200"
+        )
+    for sub in (sub_write, sub_query):
+        sub.add_argument(
+            "-l",
+            "--layouts",
+            help="load previously emitted layout tables instead of the headers",
+        )
+    args = parser.parse_args()
+
+    def load_layouts() -> Layouts:
+        return Layouts.load(args.layouts) if args.layouts else Layouts.from_headers()
+
+    if args.command == "write":
+        layouts = load_layouts()
+        src = sys.stdin.buffer if args.frames == "-" else open(args.frames, "rb")
+        with src, TraceWriter(
+            args.output, layouts, args.type, args.block_frames, args.level
+        ) as writer:
+            while True:
+                frame = src.read(writer.frame_len)
+                if len(frame) < writer.frame_len:
+                    if frame:
+                        print(
+                            "Warning: ignoring trailing partial frame "
+                            + f"({len(frame)} bytes)",
+                            file=sys.stderr,
+                        )
+                    break
+                writer.append(frame)
+        print(f"Wrote {writer.n_frames} frames to {args.output}")
+    elif args.command == "info":
+        with TraceReader(args.trace) as trace:
+            size = os.path.getsize(args.trace)
+            raw = trace.n_frames * trace.frame_len
+            print(
+                f"{args.trace}: {trace.n_frames} frames of {trace.type_name} "
+                + f"({trace.frame_len:#x} bytes), {len(trace.columns)} columns, "
+                + f"{trace.block_frames} frames per block"
+            )
+            print(f"  {size} bytes ({raw / max(size, 1):.1f}x smaller than raw frames)")
+            if args.columns:
+                for col in trace.columns:
+                    print(f"  {col.offset:#07x} {col.length:#06x} {col.name}")
+    elif args.command == "query":
+        with TraceReader(args.trace, load_layouts()) as trace:
+            start, stop = parse_frame_range(args.range, trace.n_frames)
+            t = None
+            try:
+                t = trace.layouts.resolve_path(trace.type_name, args.path)[1]
+            except ValueError:
+                pass
+            for i, value in enumerate(trace.values(args.path, start, stop), start):
+                text = format_value(trace.layouts, value, t) if t else str(value)
+                if "\n" in text:
+                    print(f"{i}:\n{text}")
+                else:
+                    print(f"{i}: {text}")
+    else:
+        with TraceReader(args.trace) as trace, open(args.output, "wb") as f:
+            start, stop = parse_frame_range(args.range, trace.n_frames)
+            for frame in trace.read_bytes(0, trace.frame_len, start, stop):
+                f.write(frame)
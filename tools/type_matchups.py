@@ -0,0 +1,322 @@
+#!/usr/bin/env python3
+
+"""
+`type_matchups.py` is a command line utility (and importable module) for
+looking up type effectiveness in bulk, from the type matchup tables in
+overlay10 (TYPE_MATCHUP_TABLE, a struct type_matchup_table, and
+TYPE_MATCHUP_COMBINATOR_TABLE, a struct type_matchup_combinator_table).
+
+As in GetTypeMatchup, the matchup of a move type against a single defender
+type is looked up in TYPE_MATCHUP_TABLE, except that Ghost's immunity to
+Normal and Fighting moves (see IsTypeIneffectiveAgainstGhost) is hard-coded
+rather than encoded in the table, and doesn't apply if the defender is
+exposed. As in GetTypeMatchupBothTypes, the matchups against both defender
+types are then combined with TYPE_MATCHUP_COMBINATOR_TABLE. Other
+conditional effects handled by GetTypeMatchup (exclusive items, statuses,
+etc.) are not modeled.
+
+`TypeMatchups` validates the tables when it is constructed (dimensions, value
+ranges, the symmetry of the combinator table, and Ghost's matchups being
+encoded as documented), and then folds them into two small lookup tables
+indexed by (exposed, move type, defender type), and by (exposed, move type,
+defender type 1, defender type 2). The second one holds the final matchup of
+every possible combination, so resolving a whole array of inputs is a single
+gather with no branches, which is vectorized with numpy if it is installed.
+
+Example usage:
+python3 type_matchups.py -d rom_data --move-type FIRE
+python3 type_matchups.py -d rom_data --defender-type GHOST/DARK --exposed
+python3 type_matchups.py -d rom_data --validate
+"""
+
+import argparse
+import sys
+from typing import List, Sequence
+
+try:
+    import numpy as np
+except ImportError:
+    np = None
+
+import layouts
+
+# Dimensions of struct type_matchup_table (all types except TYPE_NEUTRAL)
+N_TYPES = 18
+# Dimensions of struct type_matchup_combinator_table (see enum type_matchup)
+N_MATCHUPS = 4
+MATCHUP_IMMUNE = 0
+MATCHUP_NEUTRAL = 2
+
+
+class TypeMatchups:
+    """Validated, precombined type matchup tables"""
+
+    def __init__(
+        self,
+        type_matchups: Sequence[Sequence[int]],
+        matchup_combinations: Sequence[Sequence[int]],
+        ghost_type: int,
+        ghost_ineffective_types: Sequence[int],
+    ):
+        self.type_matchups = [list(row) for row in type_matchups]
+        self.matchup_combinations = [list(row) for row in matchup_combinations]
+        self.ghost_type = ghost_type
+        self.ghost_ineffective_types = list(ghost_ineffective_types)
+        problems = self.problems()
+        if problems:
+            raise ValueError("invalid type matchup tables: " + "; ".join(problems))
+
+        # individual[exposed][move_type][defender_type]
+        self.individual = [
+            [
+                [
+                    self._individual(move, defender, bool(exposed))
+                    for defender in range(N_TYPES)
+                ]
+                for move in range(N_TYPES)
+            ]
+            for exposed in range(2)
+        ]
+        # combined, flattened: (((exposed * N + move) * N + type1) * N + type2)
+        self.combined = [
+            self.matchup_combinations[ind[move][t1]][ind[move][t2]]
+            for ind in self.individual
+            for move in range(N_TYPES)
+            for t1 in range(N_TYPES)
+            for t2 in range(N_TYPES)
+        ]
+        if np is not None:
+            self._individual_array = np.array(self.individual, dtype=np.uint8)
+            self._combined_array = np.array(self.combined, dtype=np.uint8)
+
+    def problems(self) -> List[str]:
+        """Checks the tables against their documented structure"""
+        problems = []
+        if len(self.type_matchups) != N_TYPES or any(
+            len(row) != N_TYPES for row in self.type_matchups
+        ):
+            problems.append(f"type matchup table is not {N_TYPES}x{N_TYPES}")
+        elif any(not 0 <= m < N_MATCHUPS for row in self.type_matchups for m in row):
+            problems.append("type matchup table has out-of-range matchups")
+        if len(self.matchup_combinations) != N_MATCHUPS or any(
+            len(row) != N_MATCHUPS for row in self.matchup_combinations
+        ):
+            problems.append(f"combinator table is not {N_MATCHUPS}x{N_MATCHUPS}")
+        else:
+            c = self.matchup_combinations
+            if any(not 0 <= m < N_MATCHUPS for row in c for m in row):
+                problems.append("combinator table has out-of-range matchups")
+            if any(
+                c[i][j] != c[j][i]
+                for i in range(N_MATCHUPS)
+                for j in range(i + 1, N_MATCHUPS)
+            ):
+                problems.append("combinator table is not symmetric")
+        if problems:
+            return problems
+        types = [self.ghost_type] + self.ghost_ineffective_types
+        if any(not 0 <= t < N_TYPES for t in types):
+            problems.append("Ghost matchup types are out of range")
+        else:
+            for t in self.ghost_ineffective_types:
+                if self.type_matchups[t][self.ghost_type] != MATCHUP_NEUTRAL:
+                    problems.append(
+                        f"type {t} is not encoded as neutral against Ghost "
+                        + "(Ghost immunities are expected to be hard-coded)"
+                    )
+        return problems
+
+    def _individual(self, move_type: int, defender_type: int, exposed: bool) -> int:
+        if (
+            defender_type == self.ghost_type
+            and move_type in self.ghost_ineffective_types
+            and not exposed
+        ):
+            return MATCHUP_IMMUNE
+        return self.type_matchups[move_type][defender_type]
+
+    @classmethod
+    def load(cls, data: layouts.BinaryData) -> "TypeMatchups":
+        """Loads the tables from the binaries extracted from a ROM"""
+        matchup_table = data.read("overlay10", "TYPE_MATCHUP_TABLE").matchups
+        combinator = data.read("overlay10", "TYPE_MATCHUP_COMBINATOR_TABLE")
+        types = data.layouts.enums["enum type_id"]
+        return cls(
+            [[m.val for m in row] for row in matchup_table],
+            [list(row) for row in combinator.combination],
+            # See IsTypeIneffectiveAgainstGhost
+            types["TYPE_GHOST"],
+            [types["TYPE_NORMAL"], types["TYPE_FIGHTING"]],
+        )
+
+    def matchup(self, move_type: int, defender_type: int, exposed: bool = False) -> int:
+        """The matchup of a move type against a single defender type"""
+        return self.individual[int(bool(exposed))][move_type][defender_type]
+
+    def matchup_both(
+        self,
+        move_type: int,
+        defender_type1: int,
+        defender_type2: int,
+        exposed: bool = False,
+    ) -> int:
+        """The combined matchup of a move type against both defender types"""
+        idx = (int(bool(exposed)) * N_TYPES + move_type) * N_TYPES + defender_type1
+        return self.combined[idx * N_TYPES + defender_type2]
+
+    @staticmethod
+    def _check_range(*columns: "np.ndarray"):
+        for col in columns:
+            if col.size and (col.min() < 0 or col.max() >= N_TYPES):
+                raise IndexError(f"type IDs must be in [0, {N_TYPES - 1}]")
+
+    def matchup_batch(
+        self,
+        move_types: Sequence[int],
+        defender_types: Sequence[int],
+        exposed: Sequence[int],
+    ) -> Sequence[int]:
+        """
+        matchup() over columns of inputs (which are broadcast together if
+        numpy is available). Returns an int64 array if numpy is available, or
+        a list otherwise.
+        """
+        if np is None:
+            return [
+                self.matchup(m, d, e)
+                for m, d, e in zip(move_types, defender_types, exposed)
+            ]
+        move, defender, exp = np.broadcast_arrays(
+            np.asarray(move_types, dtype=np.int64),
+            np.asarray(defender_types, dtype=np.int64),
+            np.asarray(exposed, dtype=np.int64) != 0,
+        )
+        self._check_range(move, defender)
+        return self._individual_array[exp.astype(np.int64), move, defender].astype(
+            np.int64
+        )
+
+    def matchup_both_batch(
+        self,
+        move_types: Sequence[int],
+        defender_types1: Sequence[int],
+        defender_types2: Sequence[int],
+        exposed: Sequence[int],
+    ) -> Sequence[int]:
+        """
+        matchup_both() over columns of inputs (which are broadcast together if
+        numpy is available). Returns an int64 array if numpy is available, or
+        a list otherwise.
+        """
+        if np is None:
+            return [
+                self.matchup_both(m, d1, d2, e)
+                for m, d1, d2, e in zip(
+                    move_types, defender_types1, defender_types2, exposed
+                )
+            ]
+        move, t1, t2, exp = np.broadcast_arrays(
+            np.asarray(move_types, dtype=np.int64),
+            np.asarray(defender_types1, dtype=np.int64),
+            np.asarray(defender_types2, dtype=np.int64),
+            np.asarray(exposed, dtype=np.int64) != 0,
+        )
+        self._check_range(move, t1, t2)
+        idx = ((exp.astype(np.int64) * N_TYPES + move) * N_TYPES + t1) * N_TYPES + t2
+        return self._combined_array[idx].astype(np.int64)
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Look up EoS type matchups")
+    parser.add_argument(
+        "-d", "--data-dir", required=True, help="data directory for unpacked EoS ROM"
+    )
+    parser.add_argument(
+        "-v",
+        "--version",
+        choices=["NA", "EU", "JP"],
+        default="NA",
+        help="game version of the ROM",
+    )
+    parser.add_argument(
+        "-l",
+        "--layouts",
+        help="load previously emitted layout tables instead of the headers",
+    )
+    group = parser.add_mutually_exclusive_group(required=True)
+    group.add_argument(
+        "--move-type",
+        help="print the matchups of a move type against every defender typing",
+    )
+    group.add_argument(
+        "--defender-type",
+        help="print the matchups of every move type against a defender typing "
+        + "(e.g., GRASS or WATER/GROUND)",
+    )
+    group.add_argument(
+        "--validate",
+        action="store_true",
+        help="only check the tables against their documented structure",
+    )
+    parser.add_argument(
+        "--exposed",
+        action="store_true",
+        help="the defender is exposed (no Ghost immunities)",
+    )
+    args = parser.parse_args()
+
+    lts = (
+        layouts.Layouts.load(args.layouts)
+        if args.layouts
+        else layouts.Layouts.from_headers()
+    )
+    types = lts.enums["enum type_id"]
+
+    def type_id(name: str) -> int:
+        key = name.upper()
+        key = key if key.startswith("TYPE_") else f"TYPE_{key}"
+        if key not in types or types[key] >= N_TYPES:
+            sys.exit(f"Unknown type: '{name}'")
+        return types[key]
+
+    def type_name(t: int) -> str:
+        return (lts.enum_name("enum type_id", t) or str(t)).replace("TYPE_", "")
+
+    def matchup_name(m: int) -> str:
+        return lts.enum_name("enum type_matchup", m) or str(m)
+
+    try:
+        with layouts.BinaryData(args.data_dir, lts, args.version) as data:
+            table = TypeMatchups.load(data)
+    except ValueError as e:
+        sys.exit(str(e))
+    if args.validate:
+        print("Type matchup tables are valid")
+        sys.exit(0)
+
+    exposed = int(args.exposed)
+    all_types = range(1, N_TYPES)
+    if args.move_type is not None:
+        move = type_id(args.move_type)
+        # Every unordered defender typing, with TYPE_NONE as a missing second type
+        typings: List[tuple] = [
+            (t1, t2) for t1 in all_types for t2 in [0, *all_types] if t2 == 0 or t2 > t1
+        ]
+        result = table.matchup_both_batch(
+            [move] * len(typings),
+            [t for t, _ in typings],
+            [t for _, t in typings],
+            [exposed] * len(typings),
+        )
+        for (t1, t2), m in zip(typings, result):
+            label = type_name(t1) + (f"/{type_name(t2)}" if t2 else "")
+            print(f"{label}: {matchup_name(int(m))}")
+    else:
+        names = (args.defender_type.split("/") + ["NONE"])[:2]
+        t1, t2 = (type_id(n) for n in names)
+        moves = list(all_types)
+        result = table.matchup_both_batch(
+            moves, [t1] * len(moves), [t2] * len(moves), [exposed] * len(moves)
+        )
+        for move, m in zip(moves, result):
+            print(f"{type_name(move)}: {matchup_name(int(m))}")
@@ -0,0 +1,582 @@
+#!/usr/bin/env python3
+
+"""
+`wan.py` is a command line utility and Python module for decoding WAN sprite
+files, with a size-bounded LRU cache of decoded sprites modeled on the game's
+own WAN table (`LoadWanTableEntry`, `FindWanTableEntry`,
+`GetLoadedWanTableEntry`, `DeleteWanTableEntry`, `ReplaceWanFromBinFile` in
+arm9).
+
+Like the game's WAN table, cache entries are keyed either by the Pack
+archive and file index they were loaded from (`GetLoadedWanTableEntry`'s
+bin_file_id and file_id, e.g., (PACK_ARCHIVE_MONSTER, 5)), or by the file
+name they were loaded from (`FindWanTableEntry`). The cache is bounded by
+the total size of the decoded sprites rather than a number of entries, and
+is safe to share across threads: concurrent requests for a sprite that
+isn't cached yet decode it once.
+
+WAN files are SIR0 files (see `sir0.py`), possibly AT-compressed (see
+`at_compression.py`). The WAN format isn't covered by the symbol tables (the
+WAN table functions only have unverified notes), so decoding follows the
+community documentation of the format:
+    WAN header: pointer to the animation info, pointer to the image data
+        info, u16 image type, u16 unknown
+    Animation info: pointer to the meta-frame table, pointer to the
+        particle offsets, pointer to the animation group table, u16 number
+        of animation groups, ...
+    Animation group: pointer to an array of animation sequence pointers,
+        u16 number of sequences, u16 unknown
+    Animation sequence: frames of {u8 duration, u8 flags, u16 meta-frame
+        index, s16 x/y offset, s16 shadow x/y offset}, ending with a frame
+        with duration 0
+    Image data info: pointer to the image table, pointer to the palette
+        info, u16 unknown, u16 8bpp flag, u16 unknown, u16 number of images
+    Image: strips of {pointer to pixel data (or null for zeroes), u16 length
+        in bytes, u16 unknown, u32 z-index}, ending with a null strip of
+        length 0
+    Palette info: pointer to the colors (4 bytes each), u16 unknown, u16
+        colors per row, ...
+    Meta-frame table: pointers to meta-frames, which are lists of pieces of
+        {s16 image index, u16 unknown, u16 attr0, u16 attr1, u16 attr2},
+        ending with the piece that has the last flag (attr1 & 0x800) set.
+        The attributes follow the NDS OAM attributes: attr0 holds the y
+        offset (10 bits), 8bpp flag and shape; attr1 holds the x offset
+        (9 bits), flips and size; attr2 holds the palette bank.
+Decoded images are the concatenated pixel data of their strips (in the
+tiled 4bpp or 8bpp NDS format). Each meta-frame referenced by an animation
+is then composed into a frame: a bitmap of palette indices (0 is
+transparent) covering all its pieces, with earlier pieces drawn on top like
+OAM priority. Pieces with image index -1 reuse tiles already in VRAM from
+another sprite and are left out.
+
+Cache entries hold the composed frames along with the images, so rendering
+an animation from a cached sprite doesn't redo any decoding.
+
+Example usage:
+python3 wan.py info sprite.wan
+python3 wan.py info -d rom PACK_ARCHIVE_MONSTER 5
+python3 wan.py images -d rom -o out PACK_ARCHIVE_MONSTER 5
+python3 wan.py frames -d rom -o out PACK_ARCHIVE_MONSTER 5
+
+Library usage:
+    with WanCache.from_rom("rom", max_bytes=64 << 20) as cache:
+        sprite = cache.get(("PACK_ARCHIVE_MONSTER", 5))
+        pixels = sprite.images[0]
+        frame = sprite.frames[sprite.animations[0][0][0].meta_frame]
+"""
+
+import argparse
+from collections import OrderedDict
+import os
+import struct
+import threading
+from typing import Callable, Dict, Hashable, List, NamedTuple, Optional, Tuple
+
+import at_compression
+import layouts
+import pack_archive
+import sir0
+
+
+class WanFrame(NamedTuple):
+    duration: int
+    flags: int
+    meta_frame: int
+    offset: Tuple[int, int]
+    shadow_offset: Tuple[int, int]
+
+
+class WanPiece(NamedTuple):
+    """A piece of a meta-frame, drawn like an NDS OAM object"""
+
+    image: int  # -1 to reuse tiles already in VRAM
+    offset: Tuple[int, int]
+    size: Tuple[int, int]
+    hflip: bool
+    vflip: bool
+    palette_bank: int
+    is_8bpp: bool
+
+
+class ComposedFrame(NamedTuple):
+    """A meta-frame drawn into a bitmap"""
+
+    # Position of the top-left corner relative to the sprite's origin
+    origin: Tuple[int, int]
+    width: int
+    height: int
+    # Palette indices, row by row; 0 is transparent
+    pixels: bytes
+
+
+class WanSprite(NamedTuple):
+    image_type: int
+    is_8bpp: bool
+    # Animation sequences, indexed by animation group, then sequence
+    animations: List[List[List[WanFrame]]]
+    # Pixel data of each image, in the tiled NDS format
+    images: List[bytes]
+    # Palette colors as (r, g, b, x) tuples
+    palette: List[Tuple[int, int, int, int]]
+    colors_per_row: int
+    # Pieces of each meta-frame referenced by the animations
+    meta_frames: List[List[WanPiece]]
+    # Each meta-frame, composed (None if it has no drawable pieces)
+    frames: List[Optional[ComposedFrame]]
+
+    @property
+    def nbytes(self) -> int:
+        """Approximate memory footprint of the decoded data"""
+        n_frames = sum(len(seq) for group in self.animations for seq in group)
+        n_pieces = sum(len(m) for m in self.meta_frames)
+        n_pixels = sum(len(img) for img in self.images) + sum(
+            len(f.pixels) for f in self.frames if f is not None
+        )
+        return n_pixels + 4 * len(self.palette) + 16 * (n_frames + n_pieces)
+
+
+# OAM object dimensions, indexed by shape, then size
+OBJ_DIMENSIONS = [
+    [(8, 8), (16, 16), (32, 32), (64, 64)],
+    [(16, 8), (32, 8), (32, 16), (64, 32)],
+    [(8, 16), (8, 32), (16, 32), (32, 64)],
+]
+WAN_PIECE_LEN = 10
+WAN_PIECE_LAST = 0x800
+# Upper bound on the pieces in a meta-frame, in case the last flag is missing
+MAX_WAN_PIECES = 128
+
+
+def signed(value: int, bits: int) -> int:
+    return value - (1 << bits) if value & (1 << (bits - 1)) else value
+
+
+def decode_piece(buf, pos: int) -> Tuple[WanPiece, bool]:
+    """Decodes a meta-frame piece. Also returns whether it's the last one."""
+    image, _, attr0, attr1, attr2 = struct.unpack_from("<hHHHH", buf, pos)
+    shape = (attr0 >> 14) & 3
+    if shape == 3:
+        raise ValueError(f"meta-frame piece at {pos:#x} has an invalid shape")
+    piece = WanPiece(
+        image,
+        (signed(attr1 & 0x1FF, 9), signed(attr0 & 0x3FF, 10)),
+        OBJ_DIMENSIONS[shape][(attr1 >> 14) & 3],
+        bool(attr1 & 0x1000),
+        bool(attr1 & 0x2000),
+        (attr2 >> 12) & 0xF,
+        bool(attr0 & 0x2000),
+    )
+    return piece, bool(attr1 & WAN_PIECE_LAST)
+
+
+def piece_pixels(piece: WanPiece, image: bytes) -> bytes:
+    """
+    Untiles a piece's image into palette indices, row by row (unflipped).
+    Missing image data is transparent.
+    """
+    width, height = piece.size
+    tiles_per_row = width // 8
+    tile_len = 64 if piece.is_8bpp else 32
+    out = bytearray(width * height)
+    for t in range(tiles_per_row * (height // 8)):
+        tile = image[t * tile_len : (t + 1) * tile_len]
+        if piece.is_8bpp:
+            values = tile
+        else:
+            values = bytes(v for b in tile for v in (b & 0xF, b >> 4))
+        tx, ty = (t % tiles_per_row) * 8, (t // tiles_per_row) * 8
+        for i, v in enumerate(values):
+            if v:
+                if not piece.is_8bpp:
+                    v |= piece.palette_bank << 4
+                out[(ty + i // 8) * width + tx + i % 8] = v
+    return bytes(out)
+
+
+def compose_frame(
+    pieces: List[WanPiece], images: List[bytes]
+) -> Optional[ComposedFrame]:
+    """
+    Draws the pieces of a meta-frame into one bitmap. Earlier pieces are drawn
+    on top, like OAM objects with lower indices.
+    """
+    drawable = [p for p in pieces if 0 <= p.image < len(images)]
+    if not drawable:
+        return None
+    left = min(p.offset[0] for p in drawable)
+    top = min(p.offset[1] for p in drawable)
+    width = max(p.offset[0] + p.size[0] for p in drawable) - left
+    height = max(p.offset[1] + p.size[1] for p in drawable) - top
+    out = bytearray(width * height)
+    for piece in reversed(drawable):
+        pw, ph = piece.size
+        src = piece_pixels(piece, images[piece.image])
+        x0, y0 = piece.offset[0] - left, piece.offset[1] - top
+        for y in range(ph):
+            sy = ph - 1 - y if piece.vflip else y
+            row = src[sy * pw : (sy + 1) * pw]
+            if piece.hflip:
+                row = row[::-1]
+            base = (y0 + y) * width + x0
+            for x, v in enumerate(row):
+                if v:
+                    out[base + x] = v
+    return ComposedFrame((left, top), width, height, bytes(out))
+
+
+def decode_wan(data: bytes) -> WanSprite:
+    """Decodes a WAN file (SIR0-wrapped, optionally AT-compressed)"""
+    if at_compression.is_at_container(data):
+        data = at_compression.decompress(data)
+    f = sir0.Sir0File(data)
+    buf = f.contents
+
+    def ptr(location: int) -> Optional[int]:
+        return f.read_pointer(location)
+
+    header = f.header.content
+    anim_info = ptr(header)
+    image_info = ptr(header + 4)
+    (image_type,) = struct.unpack_from("<H", buf, header + 8)
+
+    animations: List[List[List[WanFrame]]] = []
+    if anim_info is not None:
+        groups = ptr(anim_info + 8)
+        (n_groups,) = struct.unpack_from("<H", buf, anim_info + 12)
+        for g in range(n_groups if groups is not None else 0):
+            seqs = ptr(groups + 8 * g)
+            (n_seqs,) = struct.unpack_from("<H", buf, groups + 8 * g + 4)
+            group = []
+            for s in range(n_seqs if seqs is not None else 0):
+                pos = ptr(seqs + 4 * s)
+                frames = []
+                while pos is not None:
+                    duration, flags, meta, x, y, sx, sy = struct.unpack_from(
+                        "<BBHhhhh", buf, pos
+                    )
+                    if duration == 0:
+                        break
+                    frames.append(WanFrame(duration, flags, meta, (x, y), (sx, sy)))
+                    pos += 12
+                group.append(frames)
+            animations.append(group)
+
+    images: List[bytes] = []
+    palette: List[Tuple[int, int, int, int]] = []
+    is_8bpp = False
+    colors_per_row = 16
+    if image_info is not None:
+        table = ptr(image_info)
+        palette_info = ptr(image_info + 4)
+        is_8bpp, n_images = struct.unpack_from("<2xH2xH", buf, image_info + 8)
+        is_8bpp = bool(is_8bpp)
+        for i in range(n_images if table is not None else 0):
+            pos = ptr(table + 4 * i)
+            pixels = bytearray()
+            while pos is not None:
+                src_ptr, length = struct.unpack_from("<IH", buf, pos)
+                if src_ptr == 0 and length == 0:
+                    break
+                src = f.offset_of(src_ptr)
+                if src is None:
+                    pixels += bytes(length)
+                else:
+                    pixels += buf[src : src + length]
+                pos += 12
+            images.append(bytes(pixels))
+        if palette_info is not None:
+            colors = ptr(palette_info)
+            (colors_per_row,) = struct.unpack_from("<H", buf, palette_info + 6)
+            # The colors run up to the palette info
+            if colors is not None and colors < palette_info:
+                palette = list(struct.iter_unpack("<4B", buf[colors:palette_info]))
+
+    meta_frames: List[List[WanPiece]] = []
+    n_meta_frames = 1 + max(
+        (f.meta_frame for g in animations for seq in g for f in seq), default=-1
+    )
+    table = ptr(anim_info) if anim_info is not None else None
+    for m in range(n_meta_frames if table is not None else 0):
+        pos = ptr(table + 4 * m)
+        pieces = []
+        while pos is not None and len(pieces) < MAX_WAN_PIECES:
+            piece, last = decode_piece(buf, pos)
+            pieces.append(piece)
+            if last:
+                break
+            pos += WAN_PIECE_LEN
+        meta_frames.append(pieces)
+    frames = [compose_frame(pieces, images) for pieces in meta_frames]
+    return WanSprite(
+        image_type,
+        is_8bpp,
+        animations,
+        images,
+        palette,
+        colors_per_row,
+        meta_frames,
+        frames,
+    )
+
+
+class CacheStats(NamedTuple):
+    entries: int
+    nbytes: int
+    hits: int
+    misses: int
+    evictions: int
+
+
+class WanCache:
+    """
+    Thread-safe LRU cache of decoded WAN sprites, bounded by the total size
+    of the decoded data. The loader maps a key to the raw WAN file.
+    """
+
+    def __init__(
+        self,
+        loader: Callable[[Hashable], bytes],
+        max_bytes: int = 64 << 20,
+        decoder: Callable[[bytes], WanSprite] = decode_wan,
+        on_close: Optional[Callable[[], None]] = None,
+    ):
+        self.loader = loader
+        self.decoder = decoder
+        self._on_close = on_close
+        self.max_bytes = max_bytes
+        self._entries: "OrderedDict[Hashable, WanSprite]" = OrderedDict()
+        self._nbytes = 0
+        self._lock = threading.Lock()
+        # Keys currently being decoded, with an event set when done
+        self._pending: Dict[Hashable, threading.Event] = {}
+        self._hits = self._misses = self._evictions = 0
+
+    @classmethod
+    def from_rom(
+        cls,
+        data_dir: str,
+        max_bytes: int = 64 << 20,
+        version: str = "NA",
+        lts: Optional[layouts.Layouts] = None,
+    ) -> "WanCache":
+        """
+        A cache over an extracted ROM, keyed by (pack_file_id, file index) for
+        files in Pack archives, or by file path relative to the ROM. Pack
+        archives are opened on first use and closed along with the cache.
+        """
+        packs: Dict[str, pack_archive.PackArchive] = {}
+        packs_lock = threading.Lock()
+
+        def load(key: Hashable) -> bytes:
+            nonlocal lts
+            if isinstance(key, tuple):
+                pack_id, index = key
+                with packs_lock:
+                    if pack_id not in packs:
+                        if lts is None:
+                            lts = layouts.Layouts.from_headers()
+                        packs[pack_id] = pack_archive.PackArchive(
+                            pack_archive.locate_pack(data_dir, pack_id, version, lts)
+                        )
+                    pack = packs[pack_id]
+                    with pack[index] as view:
+                        return bytes(view)
+            with open(os.path.join(data_dir, str(key)), "rb") as f:
+                return f.read()
+
+        def close():
+            with packs_lock:
+                for pack in packs.values():
+                    pack.close()
+                packs.clear()
+
+        return cls(load, max_bytes, on_close=close)
+
+    def __enter__(self) -> "WanCache":
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    def close(self):
+        """Releases the loader's resources (like open Pack archives)"""
+        if self._on_close is not None:
+            self._on_close()
+
+    def get(self, key: Hashable) -> WanSprite:
+        """LoadWanTableEntry: gets a sprite, decoding it if not cached"""
+        while True:
+            with self._lock:
+                sprite = self._entries.get(key)
+                if sprite is not None:
+                    self._entries.move_to_end(key)
+                    self._hits += 1
+                    return sprite
+                event = self._pending.get(key)
+                if event is None:
+                    event = self._pending[key] = threading.Event()
+                    self._misses += 1
+                    break
+            # Another thread is decoding this sprite
+            event.wait()
+        try:
+            sprite = self.decoder(self.loader(key))
+            with self._lock:
+                self._insert(key, sprite)
+        finally:
+            with self._lock:
+                del self._pending[key]
+            event.set()
+        return sprite
+
+    def _insert(self, key: Hashable, sprite: WanSprite):
+        old = self._entries.pop(key, None)
+        if old is not None:
+            self._nbytes -= old.nbytes
+        self._entries[key] = sprite
+        self._nbytes += sprite.nbytes
+        while self._nbytes > self.max_bytes and len(self._entries) > 1:
+            _, evicted = self._entries.popitem(last=False)
+            self._nbytes -= evicted.nbytes
+            self._evictions += 1
+
+    def find(self, key: Hashable) -> Optional[WanSprite]:
+        """
+        FindWanTableEntry/GetLoadedWanTableEntry: a cached sprite, or None if
+        not loaded (without decoding it)
+        """
+        with self._lock:
+            sprite = self._entries.get(key)
+            if sprite is not None:
+                self._entries.move_to_end(key)
+            return sprite
+
+    def delete(self, key: Hashable) -> bool:
+        """DeleteWanTableEntry: evicts a sprite. Returns whether it was cached."""
+        with self._lock:
+            sprite = self._entries.pop(key, None)
+            if sprite is None:
+                return False
+            self._nbytes -= sprite.nbytes
+            return True
+
+    def replace(self, key: Hashable, data: bytes) -> WanSprite:
+        """ReplaceWanFromBinFile: replaces a sprite with one decoded from data"""
+        sprite = self.decoder(data)
+        with self._lock:
+            self._insert(key, sprite)
+        return sprite
+
+    def stats(self) -> CacheStats:
+        with self._lock:
+            return CacheStats(
+                len(self._entries),
+                self._nbytes,
+                self._hits,
+                self._misses,
+                self._evictions,
+            )
+
+
+def print_info(name: str, sprite: WanSprite):
+    n_seqs = sum(len(g) for g in sprite.animations)
+    n_frames = sum(len(s) for g in sprite.animations for s in g)
+    print(
+        f"{name}: image type {sprite.image_type}, "
+        + f"{'8' if sprite.is_8bpp else '4'}bpp, {len(sprite.images)} images, "
+        + f"{len(sprite.palette)} colors, {len(sprite.animations)} animation "
+        + f"groups ({n_seqs} sequences, {n_frames} frames)"
+    )
+    for i, img in enumerate(sprite.images):
+        print(f"  image {i}: {len(img):#x} bytes")
+    for i, frame in enumerate(sprite.frames):
+        if frame is None:
+            print(f"  frame {i}: empty")
+        else:
+            print(
+                f"  frame {i}: {frame.width}x{frame.height} at {frame.origin}, "
+                + f"{len(sprite.meta_frames[i])} pieces"
+            )
+
+
+def write_pam(path: str, frame: ComposedFrame, palette: List[Tuple[int, ...]]):
+    """Writes a composed frame as an RGBA PAM image (index 0 is transparent)"""
+    rgba = bytearray()
+    for v in frame.pixels:
+        if v == 0 or v >= len(palette):
+            rgba += bytes(4)
+        else:
+            rgba += bytes(palette[v][:3]) + b"\xff"
+    with open(path, "wb") as f:
+        f.write(
+            f"P7\nWIDTH {frame.width}\nHEIGHT {frame.height}\nDEPTH 4\n".encode()
+            + b"MAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n"
+        )
+        f.write(rgba)
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Decode WAN sprite files")
+    subparsers = parser.add_subparsers(dest="command", required=True)
+    for name, help_text in (
+        ("info", "print a summary of a sprite"),
+        ("images", "write the decoded images and palette"),
+        ("frames", "write the composed frames as PAM images"),
+    ):
+        sub = subparsers.add_parser(name, help=help_text)
+        sub.add_argument(
+            "file", help="WAN file, or with -d, a pack_file_id or ROM-relative path"
+        )
+        sub.add_argument(
+            "index", nargs="?", type=int, help="file index within the Pack archive"
+        )
+        sub.add_argument("-d", "--data-dir", help="extracted ROM directory")
+        sub.add_argument(
+            "-v",
+            "--version",
+            choices=["NA", "EU", "JP"],
+            default="NA",
+            help="game version of the ROM",
+        )
+        sub.add_argument(
+            "-l",
+            "--layouts",
+            help="load previously emitted layout tables instead of the headers",
+        )
+        if name != "info":
+            sub.add_argument("-o", "--output", required=True, help="output directory")
+    args = parser.parse_args()
+
+    if args.data_dir is not None:
+        lts = None
+        if args.layouts:
+            lts = layouts.Layouts.load(args.layouts)
+        key = (args.file, args.index) if args.index is not None else args.file
+        with WanCache.from_rom(args.data_dir, version=args.version, lts=lts) as cache:
+            sprite = cache.get(key)
+    else:
+        with open(args.file, "rb") as f:
+            sprite = decode_wan(f.read())
+
+    if args.command == "info":
+        print_info(args.file, sprite)
+    elif args.command == "frames":
+        os.makedirs(args.output, exist_ok=True)
+        n = 0
+        for i, frame in enumerate(sprite.frames):
+            if frame is not None:
+                write_pam(
+                    os.path.join(args.output, f"frame_{i:04}.pam"),
+                    frame,
+                    sprite.palette,
+                )
+                n += 1
+        print(f"Wrote {n} frames to {args.output}")
+    else:
+        os.makedirs(args.output, exist_ok=True)
+        for i, img in enumerate(sprite.images):
+            with open(os.path.join(args.output, f"image_{i:04}.bin"), "wb") as f:
+                f.write(img)
+        with open(os.path.join(args.output, "palette.bin"), "wb") as f:
+            f.write(b"".join(bytes(c) for c in sprite.palette))
+        print(f"Wrote {len(sprite.images)} images to {args.output}")